@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "easy_ffmpeg/easy_ffmpeg.hpp"
+
+// Usage: easy_ffmpeg-bench [--json path/to/results.json] [path/to/video...]
+// Runs headlessly and prints the timings of each benchmark, for each video.
+// If no video is given, it generates synthetic ones (with several codecs, resolutions and GOP lengths) in the temporary directory, so that the results are comparable from one machine to another.
+// Give it one video per codec you care about, since the savings of some settings (e.g. DecodingQuality::Preview) depend a lot on the codec.
+// With --json, the results are also written to a file, so that you can track regressions between versions.
+
+namespace {
+
+auto measure_in_milliseconds(std::function<void()> const& job) -> double
+{
+    auto const start = std::chrono::steady_clock::now();
+    job();
+    return std::chrono::duration<double, std::milli>{std::chrono::steady_clock::now() - start}.count();
+}
+
+/// Quoted, with its quotes and backslashes escaped (e.g. the ones of Windows paths)
+auto json_string(std::string const& value) -> std::string
+{
+    auto json = std::string{"\""};
+    for (char const c : value)
+    {
+        if (c == '"' || c == '\\')
+            json += '\\';
+        json += c;
+    }
+    return json + "\"";
+}
+
+/// JSON has no representation for NaN and infinities
+auto json_number(double value) -> std::string
+{
+    return std::isfinite(value) ? std::to_string(value) : "null";
+}
+
+/// Results of all the benchmarks of one video. Flat, so that they are easy to compare between runs.
+class Results {
+public:
+    explicit Results(std::filesystem::path const& path)
+    {
+        add("video", json_string(path.generic_string()));
+    }
+
+    void add(std::string const& key, double value)
+    {
+        std::printf("%-36s %12.3f\n", key.c_str(), value); // NOLINT(*vararg)
+        add(key, json_number(value));
+    }
+
+    /// Adds the median, 90th and 99th percentiles, and the maximum of the `values`
+    void add_distribution(std::string const& key, std::vector<double> values)
+    {
+        if (values.empty())
+            return;
+        std::sort(values.begin(), values.end());
+        auto const percentile = [&](double p) {
+            return values[std::min(values.size() - 1, static_cast<size_t>(p * static_cast<double>(values.size())))];
+        };
+        add(key + ".p50", percentile(0.5));  // NOLINT(*magic-numbers)
+        add(key + ".p90", percentile(0.9));  // NOLINT(*magic-numbers)
+        add(key + ".p99", percentile(0.99)); // NOLINT(*magic-numbers)
+        add(key + ".max", values.back());
+    }
+
+    [[nodiscard]] auto to_json() const -> std::string
+    {
+        auto json = std::string{"    {"};
+        for (size_t i = 0; i < _fields.size(); ++i)
+            json += (i == 0 ? "\n" : ",\n") + std::string{"        "} + json_string(_fields[i].first) + ": " + _fields[i].second;
+        return json + "\n    }";
+    }
+
+private:
+    void add(std::string const& key, std::string const& serialized_value)
+    {
+        _fields.emplace_back(key, serialized_value);
+    }
+
+private:
+    std::vector<std::pair<std::string, std::string>> _fields{};
+};
+
+/// Random times, with a fixed seed so that all the runs (and all the versions of the library) seek to the same times
+auto random_times(double duration_in_seconds, int count) -> std::vector<double>
+{
+    auto rng          = std::mt19937{42}; // NOLINT(*magic-numbers)
+    auto distribution = std::uniform_real_distribution<double>{0., duration_in_seconds};
+    auto times        = std::vector<double>{};
+    for (int i = 0; i < count; ++i)
+        times.push_back(distribution(rng));
+    return times;
+}
+
+/// Reads all the frames in order, like during playback
+void play(ffmpeg::VideoDecoder& decoder)
+{
+    for (double time = 0.;; time += 1. / 30.)
+    {
+        auto const frame = decoder.get_frame_at(time, ffmpeg::SeekMode::Exact);
+        if (!frame || frame->is_last_frame)
+            return;
+    }
+}
+
+/// Jumps around the video, like when dragging the cursor of a timeline
+void scrub(ffmpeg::VideoDecoder& decoder)
+{
+    for (double const time : random_times(decoder.duration_in_seconds(), 200)) // NOLINT(*magic-numbers)
+        std::ignore = decoder.get_frame_at(time, ffmpeg::SeekMode::Exact);
+}
+
+/// Seeks around the video without waiting for the exact frames, like when dragging the cursor of a timeline quickly
+void fast_scrub(ffmpeg::VideoDecoder& decoder)
+{
+    for (double const time : random_times(decoder.duration_in_seconds(), 200)) // NOLINT(*magic-numbers)
+    {
+        for (int j = 0; j < 10; ++j) // NOLINT(*magic-numbers) Keep asking for the same time for a few frames, so that the decoder catches up with it
+            std::ignore = decoder.get_frame_at(time, ffmpeg::SeekMode::Fast);
+    }
+}
+
+void bench_open_latency(std::filesystem::path const& path, Results& results)
+{
+    auto latencies = std::vector<double>{};
+    for (int i = 0; i < 10; ++i) // NOLINT(*magic-numbers)
+    {
+        latencies.push_back(measure_in_milliseconds([&]() {
+            auto decoder = ffmpeg::VideoDecoder{path, AV_PIX_FMT_RGBA};
+            std::ignore  = decoder.get_frame_at(0., ffmpeg::SeekMode::Exact);
+        }));
+    }
+    results.add_distribution("open_and_first_frame_ms", latencies);
+}
+
+void bench_playback(std::filesystem::path const& path, Results& results)
+{
+    auto         decoder     = ffmpeg::VideoDecoder{path, AV_PIX_FMT_RGBA};
+    double const duration_ms = measure_in_milliseconds([&]() { play(decoder); });
+    auto const   stats       = decoder.stats();
+    results.add("playback_fps", duration_ms > 0. ? 1000. * static_cast<double>(stats.frames_returned) / duration_ms : 0.); // NOLINT(*magic-numbers)
+    results.add("playback_decoding_throughput_fps", stats.decoding.throughput());
+}
+
+void bench_seek_latency(std::filesystem::path const& path, Results& results)
+{
+    for (auto const& [name, seek_mode] : {std::pair{"exact_seek_ms", ffmpeg::SeekMode::Exact}, std::pair{"fast_seek_ms", ffmpeg::SeekMode::Fast}})
+    {
+        auto decoder   = ffmpeg::VideoDecoder{path, AV_PIX_FMT_RGBA};
+        auto latencies = std::vector<double>{};
+        for (double const time : random_times(decoder.duration_in_seconds(), 100)) // NOLINT(*magic-numbers)
+            latencies.push_back(measure_in_milliseconds([&]() { std::ignore = decoder.get_frame_at(time, seek_mode); }));
+        results.add_distribution(name, latencies);
+    }
+}
+
+void bench_conversion(std::filesystem::path const& path, Results& results)
+{
+    for (auto const& [name, pixel_format] : {
+             std::pair{"rgba", AV_PIX_FMT_RGBA},
+             std::pair{"rgb24", AV_PIX_FMT_RGB24},
+             std::pair{"bgra", AV_PIX_FMT_BGRA},
+             std::pair{"gray8", AV_PIX_FMT_GRAY8},
+             std::pair{"rgba64", AV_PIX_FMT_RGBA64},
+         })
+    {
+        auto decoder = ffmpeg::VideoDecoder{path, pixel_format};
+        play(decoder);
+        results.add(std::string{"conversion_fps."} + name, decoder.stats().conversion.throughput());
+    }
+}
+
+void bench_file_vs_memory_map(std::filesystem::path const& path, Results& results)
+{
+    for (auto const& [name, job] : {std::pair{"playback", &play}, std::pair{"scrubbing", &scrub}})
+    {
+        auto file_decoder   = ffmpeg::VideoDecoder{path, AV_PIX_FMT_RGBA};
+        auto mapped_decoder = ffmpeg::VideoDecoder{std::make_shared<ffmpeg::MappedFileDataSource>(path), AV_PIX_FMT_RGBA};
+
+        results.add(std::string{name} + "_ms.file", measure_in_milliseconds([&]() { job(file_decoder); }));
+        results.add(std::string{name} + "_ms.mmap", measure_in_milliseconds([&]() { job(mapped_decoder); }));
+    }
+}
+
+void bench_decoding_quality(std::filesystem::path const& path, Results& results)
+{
+    for (auto const& [name, job] : {std::pair{"playback", &play}, std::pair{"fast_scrubbing", &fast_scrub}})
+    {
+        auto full_decoder    = ffmpeg::VideoDecoder{path, AV_PIX_FMT_RGBA};
+        auto preview_decoder = ffmpeg::VideoDecoder{path, AV_PIX_FMT_RGBA};
+        preview_decoder.set_decoding_quality(ffmpeg::DecodingQuality::Preview);
+
+        results.add(std::string{name} + "_ms.full_quality", measure_in_milliseconds([&]() { job(full_decoder); }));
+        results.add(std::string{name} + "_ms.preview_quality", measure_in_milliseconds([&]() { job(preview_decoder); }));
+    }
+}
+
+auto generate_synthetic_videos() -> std::vector<std::filesystem::path>
+{
+    auto paths = std::vector<std::filesystem::path>{};
+    for (ffmpeg::TestVideoOptions const& video : {
+             ffmpeg::TestVideoOptions{.codec = "mpeg4", .width = 640, .height = 360, .keyframes_interval = 12},
+             ffmpeg::TestVideoOptions{.codec = "mpeg4", .width = 640, .height = 360, .keyframes_interval = 120},
+             ffmpeg::TestVideoOptions{.codec = "mpeg4", .width = 1920, .height = 1080, .keyframes_interval = 12},
+             ffmpeg::TestVideoOptions{.codec = "mpeg4", .width = 1920, .height = 1080, .keyframes_interval = 120},
+             ffmpeg::TestVideoOptions{.codec = "mjpeg", .width = 1920, .height = 1080, .keyframes_interval = 1},
+             ffmpeg::TestVideoOptions{.codec = "libx264", .width = 1920, .height = 1080, .keyframes_interval = 120, .max_b_frames = 3},
+             ffmpeg::TestVideoOptions{.codec = "ffv1", .width = 1920, .height = 1080, .keyframes_interval = 1},
+         })
+    {
+        auto const path = std::filesystem::temp_directory_path()
+                          / ("easy_ffmpeg_bench_" + video.codec + "_" + std::to_string(video.height) + "p_gop" + std::to_string(video.keyframes_interval) + "_b" + std::to_string(video.max_b_frames) + ".mkv");
+        if (!std::filesystem::exists(path))
+        {
+            try
+            {
+                ffmpeg::generate_test_video(path, video);
+            }
+            catch (std::exception const& e) // Typically because this build of FFmpeg doesn't have the encoder (e.g. libx264 is GPL)
+            {
+                std::filesystem::remove(path);
+                std::fprintf(stderr, "Skipping %s: %s\n", video.codec.c_str(), e.what()); // NOLINT(*vararg)
+                continue;
+            }
+        }
+        paths.push_back(path);
+    }
+    return paths;
+}
+
+} // namespace
+
+auto main(int argc, char* argv[]) -> int
+{
+    auto paths     = std::vector<std::filesystem::path>{};
+    auto json_path = std::optional<std::filesystem::path>{};
+    for (int i = 1; i < argc; ++i)
+    {
+        auto const arg = std::string{argv[i]}; // NOLINT(*pointer-arithmetic)
+        if (arg == "--json" && i + 1 < argc)
+            json_path = argv[++i]; // NOLINT(*pointer-arithmetic)
+        else
+            paths.emplace_back(arg);
+    }
+
+    try
+    {
+        if (paths.empty())
+            paths = generate_synthetic_videos();
+
+        auto all_results = std::vector<Results>{};
+        for (auto const& path : paths)
+        {
+            std::printf("======%s======\n", path.string().c_str()); // NOLINT(*vararg)
+            auto& results = all_results.emplace_back(path);
+            bench_open_latency(path, results);
+            bench_playback(path, results);
+            bench_seek_latency(path, results);
+            bench_conversion(path, results);
+            bench_file_vs_memory_map(path, results);
+            bench_decoding_quality(path, results);
+        }
+
+        if (json_path.has_value())
+        {
+            auto file = std::ofstream{*json_path};
+            file << "[\n";
+            for (size_t i = 0; i < all_results.size(); ++i)
+                file << all_results[i].to_json() << (i + 1 < all_results.size() ? ",\n" : "\n");
+            file << "]\n";
+        }
+    }
+    catch (std::exception const& e)
+    {
+        std::fprintf(stderr, "Error: %s\n", e.what()); // NOLINT(*vararg)
+        return 1;
+    }
+}
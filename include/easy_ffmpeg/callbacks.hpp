@@ -8,8 +8,8 @@ namespace ffmpeg {
 /// NB: this will be called from a separate thread, so make sure your callback is thread-safe!
 void set_fast_seeking_callback(std::function<void()>);
 
-/// Callback called whenever an error occurs while decoding a frame from the video (which shouldn't happen, unless your video file is corrupted)
-/// NB: this will NOT report errors that occur during the construction of a VideoDecoder (i.e. when we first open the file, and check that it exists and is a supported video format) Those errors are thrown as exceptions instead.
+/// Callback called whenever an error occurs while decoding a frame from the video or a chunk of audio (which shouldn't happen, unless your file is corrupted)
+/// NB: this will NOT report errors that occur during the construction of a VideoDecoder / AudioDecoder (i.e. when we first open the file, and check that it exists and is a supported video format) Those errors are thrown as exceptions instead.
 /// NB: this will be called from a separate thread, so make sure your callback is thread-safe!
 void set_frame_decoding_error_callback(std::function<void(std::string const& error_message)>);
 
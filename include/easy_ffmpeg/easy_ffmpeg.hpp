@@ -1,3 +1,16 @@
 #pragma once
+#include "../src/AudioDecoder.hpp"
+#include "../src/Demuxer.hpp"
+#include "../src/FrameStream.hpp"
+#include "../src/Input.hpp"
+#include "../src/MappedFileDataSource.hpp"
+#include "../src/ProxyVideoDecoder.hpp"
+#include "../src/Trace.hpp"
+#include "../src/Transcoder.hpp"
 #include "../src/VideoDecoder.hpp"
-#include "callbacks.hpp"
\ No newline at end of file
+#include "../src/VideoEncoder.hpp"
+#include "../src/decode_range.hpp"
+#include "../src/remux.hpp"
+#include "../src/test_video.hpp"
+#include "../src/thumbnails.hpp"
+#include "callbacks.hpp"
\ No newline at end of file
@@ -0,0 +1,422 @@
+#include "AudioDecoder.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <tuple>
+#include <utility>
+#include "utils.hpp"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/mathematics.h>
+#include <libswresample/swresample.h>
+}
+
+namespace ffmpeg {
+
+static constexpr int64_t no_seek{-1};
+static constexpr int     max_consecutive_errors_count{5};
+static constexpr double  max_skip_without_seeking_in_seconds{1.}; // Decoding and dropping that much audio is cheaper than seeking the Demuxer, which would also move the other streams
+
+AudioDecoder::AudioDecoder(Input const& input, AVSampleFormat sample_format, int sample_rate, int channels_count, double buffer_duration_in_seconds)
+    : AudioDecoder{std::make_shared<Demuxer>(input, std::vector{AVMEDIA_TYPE_AUDIO}), sample_format, sample_rate, channels_count, buffer_duration_in_seconds}
+{}
+
+AudioDecoder::AudioDecoder(std::shared_ptr<Demuxer> demuxer, AVSampleFormat sample_format, int sample_rate, int channels_count, double buffer_duration_in_seconds)
+    : _demuxer{std::move(demuxer)}
+    , _sample_format{sample_format}
+    , _sample_rate{sample_rate}
+    , _channels_count{channels_count}
+{
+    if (av_sample_fmt_is_planar(sample_format))
+        throw_error("The sample format must be interleaved (e.g. AV_SAMPLE_FMT_FLT), not planar (e.g. AV_SAMPLE_FMT_FLTP)");
+    if (sample_rate <= 0 || channels_count <= 0)
+        throw_error("The sample rate and the number of channels must be positive");
+
+    auto const audio_stream_idx = _demuxer->stream_index(AVMEDIA_TYPE_AUDIO);
+    if (!audio_stream_idx.has_value())
+        throw_error("Could not find audio stream. Make sure your file contains some audio");
+    _audio_stream_idx = *audio_stream_idx;
+    _packets_queue    = _demuxer->take_packets(_audio_stream_idx);
+    _packets_serial   = _packets_queue->serial();
+    _decoder_ctx      = open_decoder(*audio_stream().codecpar);
+    if (_decoder_ctx->ch_layout.order == AV_CHANNEL_ORDER_UNSPEC) // The resampler needs to know which channel is which
+        av_channel_layout_default(&_decoder_ctx->ch_layout, _decoder_ctx->ch_layout.nb_channels);
+
+    {
+        AVChannelLayout output_layout{};
+        av_channel_layout_default(&output_layout, channels_count);
+        int const err = swr_alloc_set_opts2(&_swr_ctx, &output_layout, sample_format, sample_rate, &_decoder_ctx->ch_layout, _decoder_ctx->sample_fmt, _decoder_ctx->sample_rate, 0, nullptr);
+        av_channel_layout_uninit(&output_layout);
+        if (err < 0)
+            throw_error("Failed to create resampling context", err);
+    }
+    {
+        int const err = swr_init(_swr_ctx);
+        if (err < 0)
+            throw_error("Failed to create resampling context", err);
+    }
+
+    _packet = av_packet_alloc();
+    if (!_packet)
+        throw_error("Not enough memory to open the audio file");
+
+    _bytes_per_sample_frame = static_cast<size_t>(av_get_bytes_per_sample(sample_format)) * static_cast<size_t>(channels_count);
+    _capacity               = std::max(static_cast<int64_t>(std::llround(buffer_duration_in_seconds * sample_rate)), int64_t{1});
+    _ring_buffer.resize(static_cast<size_t>(_capacity) * _bytes_per_sample_frame);
+    _end_position = std::isinf(duration_in_seconds())
+                        ? std::numeric_limits<int64_t>::max()
+                        : static_cast<int64_t>(std::llround(duration_in_seconds() * sample_rate));
+
+    // Once the context is created, we can spawn the thread that will use this context and start decoding the audio
+    _decoding_thread = std::thread{&AudioDecoder::decoding_thread_job, std::ref(*this)};
+}
+
+AudioDecoder::~AudioDecoder()
+{
+    // Must first stop the decoding thread, because it might be reading from the context, etc.
+    _wants_to_stop_decoding_thread.store(true);
+    wake_up_decoding_thread();
+    {
+        std::unique_lock lock{_packets_queue->mutex()}; // Make sure the thread is not between the check of its predicate and the start of its wait, otherwise it would miss the notification
+    }
+    _packets_queue->waiting_for_queue_to_fill_up().notify_all();
+    _decoding_thread.join();
+
+    avcodec_free_context(&_decoder_ctx);
+    swr_free(&_swr_ctx);
+    av_packet_free(&_packet);
+}
+
+auto AudioDecoder::read_samples(double time_in_seconds, std::span<uint8_t> output) -> size_t
+{
+    auto const sample_frames_count = static_cast<int64_t>(output.size() / _bytes_per_sample_frame);
+    auto const requested_position  = std::max(static_cast<int64_t>(std::llround(time_in_seconds * _sample_rate)), int64_t{0});
+    auto const is_after_the_end    = requested_position >= _end_position; // No need to seek there, there is nothing to decode
+    auto       available_count     = int64_t{0};
+
+    auto const pending_seek = _seek_target.load(std::memory_order_acquire);
+    if (pending_seek != no_seek) // The decoding thread hasn't moved to the last requested position yet
+    {
+        if ((requested_position < pending_seek || requested_position > pending_seek + _capacity) && !is_after_the_end)
+            request_seek(requested_position);
+    }
+    else
+    {
+        auto const read_position  = _read_position.load(std::memory_order_relaxed); // Only this thread writes it
+        auto const write_position = _write_position.load(std::memory_order_acquire);
+        if (requested_position < read_position || requested_position > write_position + _capacity) // Not in the ring buffer, and not coming soon either
+        {
+            if (!is_after_the_end)
+                request_seek(requested_position);
+        }
+        else if (requested_position <= write_position)
+        {
+            available_count = std::min(sample_frames_count, write_position - requested_position);
+
+            // Copy in two parts, because the samples might wrap around the end of the ring buffer
+            auto const begin             = static_cast<size_t>(requested_position % _capacity);
+            auto const first_part_count  = std::min(static_cast<size_t>(available_count), static_cast<size_t>(_capacity) - begin);
+            auto const second_part_count = static_cast<size_t>(available_count) - first_part_count;
+            std::copy_n(_ring_buffer.begin() + static_cast<std::ptrdiff_t>(begin * _bytes_per_sample_frame), first_part_count * _bytes_per_sample_frame, output.begin());
+            std::copy_n(_ring_buffer.begin(), second_part_count * _bytes_per_sample_frame, output.begin() + static_cast<std::ptrdiff_t>(first_part_count * _bytes_per_sample_frame));
+
+            _read_position.store(requested_position + available_count, std::memory_order_release);
+            wake_up_decoding_thread(); // There is room for new samples
+        }
+        else // The decoding thread hasn't reached the requested position yet, but it is on its way
+        {
+            // We won't need the samples before the requested position anymore. Dropping them makes room for the decoding thread, which would otherwise stay stuck with a full buffer whenever the requested position is more than _capacity after _read_position
+            _read_position.store(write_position, std::memory_order_release);
+            wake_up_decoding_thread();
+        }
+    }
+
+    uint8_t* const output_data = output.data();
+    av_samples_set_silence(&output_data, static_cast<int>(available_count), static_cast<int>(sample_frames_count - available_count), _channels_count, _sample_format);
+    return static_cast<size_t>(available_count);
+}
+
+void AudioDecoder::request_seek(int64_t position)
+{
+    _read_position.store(position, std::memory_order_release); // Must be set before the seek target, so that the decoding thread never sees a seek target that doesn't match the read position
+    _seek_target.store(position, std::memory_order_release);
+    wake_up_decoding_thread();
+}
+
+void AudioDecoder::wake_up_decoding_thread()
+{
+    _wake_up_count.fetch_add(1, std::memory_order_release);
+    _wake_up_count.notify_one();
+}
+
+void AudioDecoder::wait_for_reader(uint32_t wake_up_count)
+{
+    _wake_up_count.wait(wake_up_count, std::memory_order_acquire);
+}
+
+void AudioDecoder::decoding_thread_job(AudioDecoder& This)
+{
+    try
+    {
+        This.decode_all();
+    }
+    catch (std::exception const& e) // Can only happen if we run out of memory, read_samples() will just keep returning silence
+    {
+        report_frame_decoding_error(e.what());
+    }
+}
+
+void AudioDecoder::decode_all()
+{
+    FrameRaii const frame{};
+    int             consecutive_errors_count{0};
+    bool            has_flushed_resampler{false};
+    while (!_wants_to_stop_decoding_thread.load())
+    {
+        auto seek_target = _seek_target.load(std::memory_order_acquire);
+        if (seek_target != no_seek)
+        {
+            seek_to(seek_target);
+            consecutive_errors_count = 0;
+            has_flushed_resampler    = false;
+            _seek_target.compare_exchange_strong(seek_target, no_seek, std::memory_order_release); // If it fails, another seek has been requested in the meantime, and we will handle it on the next iteration
+            continue;
+        }
+        if (has_flushed_resampler && _packets_queue->serial() != _packets_serial) // We had reached the end of the file, but another decoder moved the Demuxer back
+        {
+            _packets_serial = _packets_queue->serial();
+            follow_demuxer_seek();
+            consecutive_errors_count = 0;
+            has_flushed_resampler    = false;
+            continue;
+        }
+
+        auto const wake_up_count = _wake_up_count.load(std::memory_order_acquire); // Must be read before checking if there is something to do, otherwise we might miss a wake up that happens in between
+        if (consecutive_errors_count < max_consecutive_errors_count)
+        {
+            try
+            {
+                if (decode_next_frame(frame.frame))
+                {
+                    std::ignore              = write_frame(frame.frame); // If it gets interrupted, the next iteration will handle the seek / the destruction
+                    consecutive_errors_count = 0;
+                    continue;
+                }
+                if (is_interrupted()) // The next iteration will handle the seek / the destruction
+                    continue;
+                if (!has_flushed_resampler) // We have reached the end of the file, output the last samples that the resampler was holding
+                {
+                    has_flushed_resampler = true;
+                    std::ignore           = write_frame(nullptr);
+                    continue;
+                }
+            }
+            catch (std::exception const& e)
+            {
+                report_frame_decoding_error(e.what());
+                consecutive_errors_count++;
+                continue;
+            }
+        }
+
+        // We have reached the end of the file (or we are stuck on errors), there is nothing to do until we are asked to seek somewhere else
+        if (_seek_target.load(std::memory_order_acquire) == no_seek && !_wants_to_stop_decoding_thread.load())
+            wait_for_reader(wake_up_count);
+    }
+}
+
+auto AudioDecoder::decode_next_frame(AVFrame* frame) -> bool
+{
+    while (true)
+    {
+        { // Check if the decoder already has a frame ready for us (a packet can contain several audio frames)
+            int const err = avcodec_receive_frame(_decoder_ctx, frame);
+            if (err >= 0)
+                return true;
+            if (err == AVERROR_EOF) // The decoder has been fully drained, there are no more frames in the file
+                return false;
+            if (err != AVERROR(EAGAIN))
+                throw_error("Error while decoding the audio", err);
+        }
+
+        PacketRaii packet_raii{_packet}; // Will unref the packet when exiting the scope
+
+        { // Get the next packet of the audio stream, read by the Demuxer
+            int const err = read_packet(_packet);
+            if (err == AVERROR_EXIT)
+                return false;
+            if (err == AVERROR_EOF)
+            {
+                if (_is_draining_decoder) // Should never happen, the decoder always ends up returning AVERROR_EOF once it has been drained
+                    return false;
+                _is_draining_decoder = true;
+                avcodec_send_packet(_decoder_ctx, nullptr); // Tells the decoder to output all the frames it still has buffered
+                continue;
+            }
+            if (err < 0)
+                throw_error("Failed to read audio packet", err);
+        }
+
+        { // Send the packet to the decoder
+            int const err = avcodec_send_packet(_decoder_ctx, _packet);
+            if (err < 0 && err != AVERROR(EAGAIN))
+                throw_error("Error submitting an audio packet for decoding", err);
+        }
+    }
+}
+
+auto AudioDecoder::read_packet(AVPacket* packet) -> int
+{
+    int  err{};
+    bool has_been_moved_by_another_decoder{};
+    {
+        std::unique_lock lock{_packets_queue->mutex()};
+        if (_packets_queue->is_empty_no_lock())
+            _packets_queue->count_decoder_wait_no_lock();
+        while (_packets_queue->is_empty_no_lock())
+        {
+            if (is_interrupted())
+                return AVERROR_EXIT;
+            _packets_queue->waiting_for_queue_to_fill_up().wait_for(lock, std::chrono::milliseconds{10}); // Seek requests come from read_samples(), which can't notify a condition variable (it would need to lock its mutex, and must never block), so we need to poll them
+        }
+        has_been_moved_by_another_decoder = _packets_queue->serial_no_lock() != _packets_serial;
+        _packets_serial                   = _packets_queue->serial_no_lock();
+        err                               = _packets_queue->pop_no_lock(packet);
+    }
+    _packets_queue->waiting_for_queue_to_empty_out().notify_one();
+
+    if (has_been_moved_by_another_decoder)
+        follow_demuxer_seek();
+    return err;
+}
+
+auto AudioDecoder::is_interrupted() const -> bool
+{
+    return _wants_to_stop_decoding_thread.load() || _seek_target.load(std::memory_order_acquire) != no_seek;
+}
+
+void AudioDecoder::seek_to(int64_t position)
+{
+    bool const has_been_moved_by_another_decoder = _packets_queue->serial() != _packets_serial; // Typically the VideoDecoder has been asked for the same time as us, and has already moved the Demuxer there
+    auto const upcoming_position                 = [&]() -> std::optional<int64_t> { // IIFE
+        if (has_been_moved_by_another_decoder)
+            return std::llround(_demuxer->last_seek_time_in_seconds() * _sample_rate); // The packets start a bit before that
+        if (_is_draining_decoder)
+            return std::nullopt;
+        return _next_sample_position;
+    }();
+    bool const can_skip_seeking = upcoming_position.has_value()
+                                  && *upcoming_position <= position
+                                  && position - *upcoming_position < std::llround(max_skip_without_seeking_in_seconds * _sample_rate);
+
+    if (!can_skip_seeking && !_demuxer->seek_to(static_cast<double>(position) / _sample_rate)) // We will continue from where we were, the samples will still end up at the right place thanks to their timestamps
+        report_frame_decoding_error("Failed to seek in the audio");
+    if (!can_skip_seeking || has_been_moved_by_another_decoder)
+    {
+        _packets_serial = _packets_queue->serial();
+        follow_demuxer_seek();
+    }
+    _discard_until_position = position;
+    _write_position.store(position, std::memory_order_release);
+}
+
+void AudioDecoder::follow_demuxer_seek()
+{
+    avcodec_flush_buffers(_decoder_ctx);
+    _is_draining_decoder = false;
+    swr_init(_swr_ctx); // Drops the samples that were still buffered in the resampler
+    _next_sample_position.reset();
+    _discard_until_position = _write_position.load(std::memory_order_relaxed); // Only this thread writes it. The samples before it have already been written, and the ones after it will be placed according to their timestamps
+}
+
+auto AudioDecoder::write_frame(AVFrame const* frame) -> bool
+{
+    int const input_count     = frame ? frame->nb_samples : 0; // No frame means that we want to flush the resampler
+    int const max_output_size = swr_get_out_samples(_swr_ctx, input_count);
+    if (max_output_size < 0)
+        throw_error("Failed to resample the audio", max_output_size);
+    if (_resampled_samples.size() < static_cast<size_t>(max_output_size) * _bytes_per_sample_frame)
+        _resampled_samples.resize(static_cast<size_t>(max_output_size) * _bytes_per_sample_frame);
+
+    uint8_t*  output_data  = _resampled_samples.data();
+    int const output_count = swr_convert(_swr_ctx, &output_data, max_output_size, frame ? frame->extended_data : nullptr, input_count);
+    if (output_count < 0)
+        throw_error("Failed to resample the audio", output_count);
+
+    if (!_next_sample_position.has_value()) // First frame after seeking, use its timestamp to know where its samples go
+    {
+        auto const timestamp  = frame && frame->best_effort_timestamp != AV_NOPTS_VALUE ? frame->best_effort_timestamp : AV_NOPTS_VALUE;
+        _next_sample_position = timestamp != AV_NOPTS_VALUE
+                                    ? av_rescale_q(timestamp, audio_stream().time_base, AVRational{1, _sample_rate})
+                                    : _discard_until_position;
+    }
+    auto const position = *_next_sample_position;
+    *_next_sample_position += output_count;
+
+    auto const write_position = _write_position.load(std::memory_order_relaxed); // Only this thread writes it
+    if (position > write_position)                                              // The first frame after seeking starts after the requested position, fill the gap with silence
+    {
+        if (!write_to_ring_buffer(nullptr, position - write_position))
+            return false;
+    }
+    auto const discarded_count = std::clamp(_discard_until_position - position, int64_t{0}, int64_t{output_count}); // Seeking brings us a bit before the requested position, drop the samples that come before it
+    return write_to_ring_buffer(_resampled_samples.data() + static_cast<size_t>(discarded_count) * _bytes_per_sample_frame, output_count - discarded_count);
+}
+
+auto AudioDecoder::write_to_ring_buffer(uint8_t const* samples, int64_t sample_frames_count) -> bool
+{
+    while (sample_frames_count > 0)
+    {
+        auto const wake_up_count = _wake_up_count.load(std::memory_order_acquire); // Must be read before checking if there is room, otherwise we might miss a wake up that happens in between
+        if (_wants_to_stop_decoding_thread.load() || _seek_target.load(std::memory_order_acquire) != no_seek)
+            return false;
+
+        auto const write_position = _write_position.load(std::memory_order_relaxed); // Only this thread writes it
+        auto const read_position  = _read_position.load(std::memory_order_acquire);
+        auto const free_count     = _capacity - std::clamp(write_position - read_position, int64_t{0}, _capacity);
+        if (free_count == 0)
+        {
+            wait_for_reader(wake_up_count);
+            continue;
+        }
+
+        auto const count = std::min(sample_frames_count, free_count);
+        // Copy in two parts, because the samples might wrap around the end of the ring buffer
+        auto const begin            = static_cast<size_t>(write_position % _capacity);
+        auto const first_part_count = std::min(static_cast<size_t>(count), static_cast<size_t>(_capacity) - begin);
+        auto const parts            = std::array{std::pair{begin, first_part_count}, std::pair{size_t{0}, static_cast<size_t>(count) - first_part_count}};
+        for (auto const& [part_begin, part_count] : parts)
+        {
+            uint8_t* const destination = _ring_buffer.data() + part_begin * _bytes_per_sample_frame;
+            if (samples)
+            {
+                std::copy_n(samples, part_count * _bytes_per_sample_frame, destination);
+                samples += part_count * _bytes_per_sample_frame; // NOLINT(*pointer-arithmetic)
+            }
+            else
+            {
+                uint8_t* destination_ptr = destination;
+                av_samples_set_silence(&destination_ptr, 0, static_cast<int>(part_count), _channels_count, _sample_format);
+            }
+        }
+
+        _write_position.store(write_position + count, std::memory_order_release);
+        sample_frames_count -= count;
+    }
+    return true;
+}
+
+auto AudioDecoder::audio_stream() const -> AVStream const&
+{
+    return _demuxer->stream(_audio_stream_idx);
+}
+
+} // namespace ffmpeg
@@ -0,0 +1,126 @@
+#pragma once
+extern "C"
+{
+#include <libavutil/samplefmt.h>
+}
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <thread>
+#include <vector>
+#include "Demuxer.hpp"
+#include "Input.hpp"
+#include "PacketsQueue.hpp"
+
+struct AVCodecContext;
+struct AVFrame;
+struct AVStream;
+struct AVPacket;
+struct SwrContext;
+
+namespace ffmpeg {
+
+/// Decodes the best audio stream of a file, and resamples it to the format you ask for.
+/// A thread decodes the audio ahead of you into a ring buffer, so that reading the samples never has to wait for the decoding.
+class AudioDecoder {
+public:
+    /// Throws a `std::runtime_error` if the creation fails (file not found / no audio stream / format not supported, etc.)
+    /// `input` can be a path to a file, a buffer in memory, or your own DataSource.
+    /// `sample_format` is the format of the samples you will receive. It must be an interleaved format, typically `AV_SAMPLE_FMT_FLT` or `AV_SAMPLE_FMT_S16`.
+    /// The audio is resampled to `sample_rate`, and remixed to `channels_count` channels (using the default layout for that number of channels, e.g. stereo for 2).
+    /// `buffer_duration_in_seconds` is how much audio gets decoded ahead of what you have read.
+    AudioDecoder(Input const& input, AVSampleFormat sample_format, int sample_rate, int channels_count, double buffer_duration_in_seconds = 1.);
+    /// Decodes the audio stream of a Demuxer that you share with other decoders (typically a VideoDecoder), so that the file is only read once (see Demuxer.hpp).
+    /// Throws a `std::runtime_error` if the demuxer doesn't have an audio stream.
+    AudioDecoder(std::shared_ptr<Demuxer> demuxer, AVSampleFormat sample_format, int sample_rate, int channels_count, double buffer_duration_in_seconds = 1.);
+    ~AudioDecoder();
+    AudioDecoder(AudioDecoder const&)                        = delete; ///
+    auto operator=(AudioDecoder const&) -> AudioDecoder&     = delete; /// Not allowed to copy nor move the class (because we spawn a thread with a reference to this object)
+    AudioDecoder(AudioDecoder&&) noexcept                    = delete; /// If you need to move it then heap-allocate it, typically in a std::unique_ptr
+    auto operator=(AudioDecoder&&) noexcept -> AudioDecoder& = delete; ///
+
+    /// Fills `output` with the interleaved samples of the time range that starts at `time_in_seconds` (and lasts for as many sample frames as fit in `output`).
+    /// Never blocks nor allocates, so you can call it from your real-time audio callback.
+    /// The samples that haven't been decoded yet (typically right after jumping to another time) are filled with silence, and the decoding thread moves to the requested time in the meantime.
+    /// `output.size()` must be a multiple of bytes_per_sample_frame(). Returns the number of sample frames that were actually available (the following ones are silent).
+    /// NB: must not be called from several threads at the same time.
+    auto read_samples(double time_in_seconds, std::span<uint8_t> output) -> size_t;
+
+    [[nodiscard]] auto sample_rate() const -> int { return _sample_rate; }
+    [[nodiscard]] auto channels_count() const -> int { return _channels_count; }
+    /// Size of one sample for each channel, in bytes.
+    [[nodiscard]] auto bytes_per_sample_frame() const -> size_t { return _bytes_per_sample_frame; }
+
+    /// Total duration of the audio.
+    [[nodiscard]] auto duration_in_seconds() const -> double { return _demuxer->duration_in_seconds(); }
+
+    /// Thread-safe, you can poll it at any time (e.g. to display it in a debug UI).
+    [[nodiscard]] auto packets_queue_stats() -> PacketsQueueStats { return _packets_queue->stats(); }
+
+private:
+    static void decoding_thread_job(AudioDecoder& This);
+    void        decode_all();
+    /// Throws on error
+    /// Returns false once all the frames of the file have been read (this includes the ones that were still buffered inside the decoder), or if it has been interrupted by a seek or by the destruction of the decoder.
+    [[nodiscard]] auto decode_next_frame(AVFrame* frame) -> bool;
+    /// Blocks until the Demuxer gives us a packet, and moves it into `packet`.
+    /// Returns the error that the demuxer encountered instead of reading that packet (AVERROR_EOF at the end of the file), or AVERROR_EXIT if we got interrupted by a seek or by the destruction of the decoder.
+    [[nodiscard]] auto read_packet(AVPacket* packet) -> int;
+    void               seek_to(int64_t position);
+    /// Called when the Demuxer has seeked: restarts decoding from the new packets, and places their samples according to their timestamps.
+    void               follow_demuxer_seek();
+    [[nodiscard]] auto is_interrupted() const -> bool;
+    /// Writes the resampled samples of the frame to the ring buffer, dropping the ones that are before the position we seeked to.
+    /// Returns false if it has been interrupted by a seek or by the destruction of the decoder.
+    [[nodiscard]] auto write_frame(AVFrame const* frame) -> bool;
+    [[nodiscard]] auto write_to_ring_buffer(uint8_t const* samples, int64_t sample_frames_count) -> bool;
+    /// Waits until read_samples() or the destructor wake us up
+    void               wait_for_reader(uint32_t wake_up_count);
+
+    /// Called by read_samples() when the requested time is not in the ring buffer
+    void request_seek(int64_t position);
+    void wake_up_decoding_thread();
+
+    [[nodiscard]] auto audio_stream() const -> AVStream const&;
+
+private:
+    // Contexts
+    std::shared_ptr<Demuxer> _demuxer;
+    TakenPacketsQueue        _packets_queue{};  // Owned by the _demuxer. Closed when we are destroyed, because the Demuxer might outlive us (if it is shared with other decoders), and it must not wait for us to consume packets anymore
+    uint64_t                 _packets_serial{}; // Serial of the packets queue the last time we flushed the decoder. If the queue has another serial, another decoder made the Demuxer seek
+    AVCodecContext*          _decoder_ctx{};
+    SwrContext*              _swr_ctx{};
+    AVPacket*                _packet{};
+    int                      _audio_stream_idx{};
+    bool                     _is_draining_decoder{false};
+
+    // Output format
+    AVSampleFormat _sample_format;
+    int            _sample_rate;
+    int            _channels_count;
+    size_t         _bytes_per_sample_frame{};
+    int64_t        _end_position{}; // In sample frames. Cached because read_samples() must not touch the contexts, they are used by the decoding thread.
+
+    // Ring buffer, written by the decoding thread and read by read_samples() without any lock.
+    // Positions are absolute indices of sample frames, counted from the beginning of the file. The buffer contains the sample frames in [_read_position, _write_position).
+    std::vector<uint8_t>  _ring_buffer{};
+    int64_t               _capacity{}; // In sample frames
+    std::atomic<int64_t>  _read_position{0};
+    std::atomic<int64_t>  _write_position{0};
+    std::atomic<int64_t>  _seek_target{-1};  // -1 when there is no seek request
+    std::atomic<uint32_t> _wake_up_count{0}; // The decoding thread waits on it when the ring buffer is full, or when it has reached the end of the file
+
+    // Only used by the decoding thread
+    std::vector<uint8_t>   _resampled_samples{};
+    std::optional<int64_t> _next_sample_position{}; // Position of the next sample that the resampler will output. Unknown right after seeking, until we get the first frame.
+    int64_t                _discard_until_position{0};
+
+    // Thread
+    std::thread       _decoding_thread{};
+    std::atomic<bool> _wants_to_stop_decoding_thread{false};
+};
+
+} // namespace ffmpeg
@@ -0,0 +1,312 @@
+#include "Demuxer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <exception>
+#include <limits>
+#include "Trace.hpp"
+#include "utils.hpp"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+}
+
+namespace ffmpeg {
+
+Demuxer::Demuxer(Input const& input, std::vector<AVMediaType> const& media_types, StreamsSelection streams_selection)
+    : _input{input}
+{
+    _format_ctx = open_format_context(input);
+
+    for (AVMediaType const type : media_types)
+    {
+        if (streams_selection == StreamsSelection::BestOfEachType)
+        {
+            int const index = av_find_best_stream(_format_ctx, type, -1, -1, nullptr, 0);
+            if (index >= 0) // Otherwise the file doesn't have that type of stream
+                add_stream(index);
+        }
+        else
+        {
+            for (int index = 0; index < static_cast<int>(_format_ctx->nb_streams); ++index)
+            {
+                if (media_type(index) == type)
+                    add_stream(index);
+            }
+        }
+    }
+    if (_streams.empty())
+        throw_error("Could not find any of the requested streams in the file");
+    start();
+}
+
+Demuxer::Demuxer(Input const& input, std::vector<int> const& stream_indices)
+    : _input{input}
+{
+    _format_ctx = open_format_context(input);
+
+    for (int const index : stream_indices)
+    {
+        if (index < 0 || index >= static_cast<int>(_format_ctx->nb_streams))
+            throw_error("Stream " + std::to_string(index) + " doesn't exist, the file only has " + std::to_string(_format_ctx->nb_streams) + " streams");
+        add_stream(index);
+    }
+    if (_streams.empty())
+        throw_error("You must ask for at least one stream");
+    start();
+}
+
+void Demuxer::add_stream(int stream_index)
+{
+    if (find_stream(stream_index)) // It has been requested twice
+        return;
+    _streams.push_back({.index = stream_index, .packets = std::make_unique<PacketsQueue>()});
+}
+
+void Demuxer::start()
+{
+    _seek_stream_idx = stream_index(AVMEDIA_TYPE_VIDEO).value_or(_streams.front().index); // Seeking to a video keyframe is the only way to be able to decode the video right after the seek. Other streams don't care, they can start from any packet
+
+    _packet = av_packet_alloc();
+    if (!_packet)
+        throw_error("Not enough memory to open the file");
+
+    _detailed_info = retrieve_detailed_info();
+
+    // Once the context is created, we can spawn the thread that will use it and start reading packets
+    _demuxing_thread = std::thread{&Demuxer::demuxing_thread_job, std::ref(*this)};
+}
+
+Demuxer::~Demuxer()
+{
+    // Must first stop the thread, because it might be reading from the context, etc.
+    _wants_to_stop_demuxing_thread.store(true);
+    {
+        std::unique_lock lock{_demuxing_context_mutex}; // Make sure the thread is not between the check of its predicate and the start of its wait, otherwise it would miss the notification
+    }
+    _waiting_for_seek.notify_all();
+    for (DemuxedStream const& stream : _streams)
+    {
+        {
+            std::unique_lock lock{stream.packets->mutex()}; // Same as above
+        }
+        stream.packets->waiting_for_queue_to_empty_out().notify_all();
+    }
+    _demuxing_thread.join();
+
+    close_format_context(_format_ctx);
+    av_packet_free(&_packet);
+}
+
+static auto tmp_string_for_detailed_info() -> std::string&
+{
+    thread_local auto instance = std::string{};
+    return instance;
+}
+
+auto Demuxer::retrieve_detailed_info() const -> std::string
+{
+    tmp_string_for_detailed_info() = "";
+    // We need to redirect ffmpeg's logging to our own string
+    av_log_set_callback([](void*, int, const char* fmt, va_list vl) {
+        va_list vl2; // NOLINT(*init-variables)
+        va_copy(vl2, vl);
+        auto const length = static_cast<size_t>(vsnprintf(nullptr, 0, fmt, vl));
+        va_end(vl);
+        std::vector<char> buffer(length + 1);
+        vsnprintf(buffer.data(), length + 1, fmt, vl2); // NOLINT(cert-err33-c)
+        va_end(vl2);
+        tmp_string_for_detailed_info() += std::string{buffer.data()};
+    });
+    av_dump_format(_format_ctx, _seek_stream_idx, "", false /*is_output*/);
+    av_log_set_callback(&av_log_default_callback);
+    return tmp_string_for_detailed_info();
+}
+
+auto Demuxer::find_stream(int stream_index) -> DemuxedStream*
+{
+    for (DemuxedStream& stream : _streams)
+    {
+        if (stream.index == stream_index)
+            return &stream;
+    }
+    return nullptr;
+}
+
+auto Demuxer::media_type(int stream_index) const -> AVMediaType
+{
+    return stream(stream_index).codecpar->codec_type;
+}
+
+auto Demuxer::stream_index(AVMediaType type) const -> std::optional<int>
+{
+    auto const indices = streams_indices(type);
+    if (indices.empty())
+        return std::nullopt;
+    int const best_index = av_find_best_stream(_format_ctx, type, -1, -1, nullptr, 0);
+    if (std::find(indices.begin(), indices.end(), best_index) != indices.end())
+        return best_index;
+    return indices.front();
+}
+
+auto Demuxer::streams_indices(AVMediaType type) const -> std::vector<int>
+{
+    auto indices = std::vector<int>{};
+    for (DemuxedStream const& stream : _streams)
+    {
+        if (media_type(stream.index) == type)
+            indices.push_back(stream.index);
+    }
+    std::sort(indices.begin(), indices.end());
+    return indices;
+}
+
+auto Demuxer::stream(int stream_index) const -> AVStream const&
+{
+    return *_format_ctx->streams[stream_index]; // NOLINT(*pointer-arithmetic)
+}
+
+auto Demuxer::take_packets(int stream_index) -> TakenPacketsQueue
+{
+    std::unique_lock lock{_streams_mutex};
+    DemuxedStream* const stream = find_stream(stream_index);
+    if (!stream)
+        throw_error("Stream " + std::to_string(stream_index) + " is not demuxed. Make sure you asked the Demuxer for it");
+    if (stream->is_taken)
+        throw_error("Stream " + std::to_string(stream_index) + " is already decoded by another decoder");
+    stream->is_taken = true;
+    return TakenPacketsQueue{*stream->packets};
+}
+
+auto Demuxer::duration_in_seconds() const -> double
+{
+    if (_format_ctx->duration == AV_NOPTS_VALUE)
+        return std::numeric_limits<double>::infinity();
+    return static_cast<double>(_format_ctx->duration) / static_cast<double>(AV_TIME_BASE);
+}
+
+auto Demuxer::seek_to(double time_in_seconds) -> bool
+{
+    TraceScope const trace{"seek", "Demuxer::seek_to"};
+    {
+        std::unique_lock lock{_demuxing_context_mutex}; // Wait for the demuxing thread to finish reading its current packet
+        auto const       timestamp = static_cast<int64_t>(earliest_video_keyframe_before(time_in_seconds) / av_q2d(stream(_seek_stream_idx).time_base));
+        int const        err       = avformat_seek_file(_format_ctx, _seek_stream_idx, INT64_MIN, timestamp, timestamp, 0);
+        if (err < 0) // Failing to seek is not a problem, we will just continue without seeking
+            return false;
+        for (DemuxedStream const& stream : _streams)
+            stream.packets->clear(); // Must be done while we still hold the lock, so that the packet that the demuxing thread will read next is not considered outdated
+        _has_reached_end_of_file = false;
+        _last_seek_time_in_seconds.store(time_in_seconds);
+    }
+    _seeks_count.fetch_add(1, std::memory_order_relaxed);
+    _waiting_for_seek.notify_one();
+    return true;
+}
+
+auto Demuxer::earliest_video_keyframe_before(double time_in_seconds) const -> double
+{
+    auto const video_streams = streams_indices(AVMEDIA_TYPE_VIDEO);
+    if (video_streams.size() < 2) // Seeking in the stream itself already gives us its keyframe
+        return time_in_seconds;
+
+    double earliest_time = time_in_seconds;
+    for (int const stream_index : video_streams)
+    {
+        AVStream* const stream    = _format_ctx->streams[stream_index]; // NOLINT(*pointer-arithmetic)
+        auto const      timestamp = static_cast<int64_t>(time_in_seconds / av_q2d(stream->time_base));
+        int const       index     = av_index_search_timestamp(stream, timestamp, AVSEEK_FLAG_BACKWARD);
+        if (index < 0) // The file has no index for that stream, we can't do better than seeking to the requested time
+            continue;
+        earliest_time = std::min(earliest_time, static_cast<double>(avformat_index_get_entry(stream, index)->timestamp) * av_q2d(stream->time_base));
+    }
+    return earliest_time;
+}
+
+auto Demuxer::stats() const -> DemuxerStats
+{
+    return {
+        .reading     = _reading_stats.get(),
+        .bytes_read  = _bytes_read.load(std::memory_order_relaxed),
+        .seeks_count = _seeks_count.load(std::memory_order_relaxed),
+    };
+}
+
+void Demuxer::demuxing_thread_job(Demuxer& This)
+{
+    while (!This._wants_to_stop_demuxing_thread.load())
+    {
+        try
+        {
+            This.demux_next_packet();
+        }
+        catch (std::exception const& e) // Can only happen if we run out of memory, we just skip that packet
+        {
+            report_frame_decoding_error(e.what());
+        }
+    }
+}
+
+void Demuxer::demux_next_packet()
+{
+    PacketRaii            packet_raii{_packet}; // Will unref the packet when exiting the scope, if we haven't given it to a queue
+    int                   err{};
+    PacketsQueue*         packets{};
+    std::vector<uint64_t> serials{}; // The serials must be read under the same lock as the packet, so that a seek can't happen in between
+    {
+        std::unique_lock lock{_demuxing_context_mutex};
+        _waiting_for_seek.wait(lock, [&]() { return !_has_reached_end_of_file || _wants_to_stop_demuxing_thread.load(); }); // After reaching the end of the file, wait until a seek moves us back
+        if (_wants_to_stop_demuxing_thread.load())
+            return;
+
+        {
+            TraceScope const trace{"demux", "av_read_frame"};
+            auto const       start = std::chrono::steady_clock::now();
+            err                    = av_read_frame(_format_ctx, _packet);
+            _reading_stats.add(std::chrono::steady_clock::now() - start, err >= 0 ? 1 : 0);
+        }
+        if (err >= 0)
+        {
+            DemuxedStream* const stream = find_stream(_packet->stream_index);
+            if (!stream) // Only keep the packets of the streams that we demux, the other ones would just take room in the queues
+                return;
+            _bytes_read.fetch_add(static_cast<uint64_t>(_packet->size), std::memory_order_relaxed);
+            packets = stream->packets.get();
+            serials.push_back(packets->serial());
+        }
+        else
+        {
+            _has_reached_end_of_file = err == AVERROR_EOF;
+            for (DemuxedStream const& stream : _streams)
+                serials.push_back(stream.packets->serial());
+        }
+    }
+
+    if (err >= 0)
+    {
+        AVPacket* const packet = packets->get_packet_to_fill();
+        av_packet_move_ref(packet, _packet);
+        push(*packets, packet, err, serials[0]);
+        return;
+    }
+    for (size_t i = 0; i < _streams.size(); ++i) // Errors are pushed to all the streams, so that each decoder reports them in order (and knows when it reaches the end of the file)
+        push(*_streams[i].packets, nullptr, err, serials[i]);
+}
+
+void Demuxer::push(PacketsQueue& packets, AVPacket* packet, int error, uint64_t serial)
+{
+    {
+        TraceScope const trace{"wait", "wait_for_room_in_packets_queue"}; // Declared before the lock, so that the event is sent to the sink after unlocking
+        std::unique_lock lock{packets.mutex()};
+        if (packets.is_full_no_lock())
+            packets.count_demuxer_wait_no_lock();
+        packets.waiting_for_queue_to_empty_out().wait(lock, [&]() { return !packets.is_full_no_lock() || packets.serial_no_lock() != serial || packets.is_closed_no_lock() || _wants_to_stop_demuxing_thread.load(); });
+    }
+    packets.push(packet, error, serial); // Drops the packet if it has become outdated while we were waiting
+}
+
+} // namespace ffmpeg
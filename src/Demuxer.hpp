@@ -0,0 +1,134 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Input.hpp"
+#include "PacketsQueue.hpp"
+#include "StageStats.hpp"
+
+extern "C"
+{
+#include <libavutil/avutil.h> // Must come after the standard headers, otherwise it complains that __STDC_CONSTANT_MACROS is not defined
+}
+
+struct AVFormatContext;
+struct AVPacket;
+struct AVStream;
+
+namespace ffmpeg {
+
+enum class StreamsSelection {
+    BestOfEachType, /// The stream that FFmpeg considers the best among the ones of each type (e.g. the main video and the main audio)
+    AllOfEachType,  /// All the streams of each type (e.g. all the angles of a multi-camera file, or both eyes of a stereoscopic video)
+};
+
+struct DemuxerStats {
+    StageStats reading{};     /// Counts packets. The busy time is the time spent in av_read_frame(), which includes the I/O
+    uint64_t   bytes_read{};  /// Size of all the packets read so far (of the streams that we demux)
+    uint64_t   seeks_count{}; /// Actual seeks in the file (the short seeks that the decoders replay from memory don't count)
+};
+
+/// Reads a file once, and dispatches the packets of several of its streams to their respective decoders.
+/// This is what you want to play a video with its sound: give the same Demuxer to a VideoDecoder and an AudioDecoder, and the file will be read only once, instead of once per decoder.
+/// Usage:
+///     auto demuxer = std::make_shared<ffmpeg::Demuxer>(path, std::vector{AVMEDIA_TYPE_VIDEO, AVMEDIA_TYPE_AUDIO});
+///     auto video   = ffmpeg::VideoDecoder{demuxer, AV_PIX_FMT_RGBA};
+///     auto audio   = ffmpeg::AudioDecoder{demuxer, AV_SAMPLE_FMT_FLT, 48000, 2};
+/// NB: each stream is only read ahead up to a limit, and the Demuxer stops reading once that limit is reached for any of the streams.
+/// So you must create a decoder for each of the streams that you ask for, and consume them at the same pace (which is naturally the case when you play the video and the sound in sync).
+/// To decode several video streams in lockstep (multi-camera files, stereoscopic video, etc.), demux them all and create one VideoDecoder per stream:
+///     auto demuxer  = std::make_shared<ffmpeg::Demuxer>(path, std::vector{AVMEDIA_TYPE_VIDEO}, ffmpeg::StreamsSelection::AllOfEachType);
+///     auto decoders = std::vector<std::unique_ptr<ffmpeg::VideoDecoder>>{};
+///     for (int const stream_index : demuxer->streams_indices(AVMEDIA_TYPE_VIDEO))
+///         decoders.push_back(std::make_unique<ffmpeg::VideoDecoder>(demuxer, AV_PIX_FMT_RGBA, stream_index));
+/// NB: seeking (which a decoder does when you ask it for a time that is far from where it is) moves all the streams at once. The other decoders follow automatically, but this is wasteful if they are not asked for the same times.
+class Demuxer {
+public:
+    /// Throws a `std::runtime_error` if the creation fails (file not found / invalid file / none of the requested streams exist, etc.)
+    /// `input` can be a path to a file, a buffer in memory, or your own DataSource.
+    /// Demuxes the streams of each of the `media_types` that the file has (only the best one of each type by default, see StreamsSelection).
+    /// Only the video by default: the Demuxer stops reading when the queue of any of its streams is full, so a stream that you don't decode would block the other ones (see the NB above).
+    explicit Demuxer(Input const& input, std::vector<AVMediaType> const& media_types = {AVMEDIA_TYPE_VIDEO}, StreamsSelection = StreamsSelection::BestOfEachType);
+    /// Demuxes exactly these streams. Throws if one of them doesn't exist.
+    Demuxer(Input const& input, std::vector<int> const& stream_indices);
+    ~Demuxer();
+    Demuxer(Demuxer const&)                        = delete; ///
+    auto operator=(Demuxer const&) -> Demuxer&     = delete; /// Not allowed to copy nor move the class (because we spawn a thread with a reference to this object)
+    Demuxer(Demuxer&&) noexcept                    = delete; /// If you need to move it then heap-allocate it, typically in a std::shared_ptr
+    auto operator=(Demuxer&&) noexcept -> Demuxer& = delete; ///
+
+    /// Index of the best stream of that type among the ones that we demux, or nullopt if there is none.
+    [[nodiscard]] auto stream_index(AVMediaType) const -> std::optional<int>;
+    /// Indices of all the streams of that type that we demux, in the order of the file.
+    [[nodiscard]] auto streams_indices(AVMediaType) const -> std::vector<int>;
+    [[nodiscard]] auto stream(int stream_index) const -> AVStream const&;
+    /// Packets of the stream, in decoding order. Throws if we don't demux that stream, or if it has already been taken (each stream can only be consumed by one decoder).
+    /// The queue gets closed when the returned handle is destroyed: from then on the packets of that stream are dropped, the Demuxer doesn't wait for them to be consumed anymore.
+    [[nodiscard]] auto take_packets(int stream_index) -> TakenPacketsQueue;
+
+    /// Moves all the streams to the keyframe just before `time_in_seconds` (in the video stream if we demux one, so that this is always a valid place to start decoding the video).
+    /// If we demux several video streams whose keyframes are not aligned, moves to the earliest of their keyframes before `time_in_seconds`, so that each of them has a keyframe to start decoding from.
+    /// Clears the queues of all the streams. Returns false if seeking failed, in which case we continue from where we were.
+    auto seek_to(double time_in_seconds) -> bool;
+    /// Time we seeked to last time (0 if we never seeked). The streams are somewhere after that time.
+    [[nodiscard]] auto last_seek_time_in_seconds() const -> double { return _last_seek_time_in_seconds.load(); }
+
+    [[nodiscard]] auto input() const -> Input const& { return _input; }
+    /// Total duration of the file. Infinity if unknown.
+    [[nodiscard]] auto duration_in_seconds() const -> double;
+    /// Detailed info about the file, its streams, their encoding, etc.
+    [[nodiscard]] auto detailed_info() const -> std::string const& { return _detailed_info; }
+
+    /// Thread-safe, you can poll it at any time (e.g. to display it in a debug UI).
+    [[nodiscard]] auto stats() const -> DemuxerStats;
+
+private:
+    struct DemuxedStream {
+        int                           index{};
+        std::unique_ptr<PacketsQueue> packets{};
+        bool                          is_taken{false};
+    };
+
+    /// Must be called by the constructors once _streams has been filled
+    void        start();
+    static void demuxing_thread_job(Demuxer& This);
+    void        demux_next_packet();
+    /// Waits until there is room in the queue, and then pushes the packet (or drops it if it has become outdated in the meantime)
+    void push(PacketsQueue&, AVPacket*, int error, uint64_t serial);
+
+    [[nodiscard]] auto find_stream(int stream_index) -> DemuxedStream*;
+    /// Time of the earliest keyframe before `time_in_seconds` among all the video streams that we demux, according to the index of the file (`time_in_seconds` if it doesn't have one).
+    [[nodiscard]] auto earliest_video_keyframe_before(double time_in_seconds) const -> double;
+    [[nodiscard]] auto media_type(int stream_index) const -> AVMediaType;
+    void               add_stream(int stream_index);
+    [[nodiscard]] auto retrieve_detailed_info() const -> std::string;
+
+private:
+    Input                      _input;
+    AVFormatContext*           _format_ctx{};
+    AVPacket*                  _packet{};
+    std::vector<DemuxedStream> _streams{};
+    std::mutex                 _streams_mutex{}; // Protects the is_taken flags, in case decoders are created from several threads
+    int                        _seek_stream_idx{}; // The stream whose keyframes we seek to
+    std::string                _detailed_info{};
+    std::atomic<double>        _last_seek_time_in_seconds{0.};
+
+    // Stats
+    StageStatsCounter     _reading_stats{};
+    std::atomic<uint64_t> _bytes_read{0};
+    std::atomic<uint64_t> _seeks_count{0};
+
+    // Thread
+    std::thread             _demuxing_thread{};
+    std::atomic<bool>       _wants_to_stop_demuxing_thread{false};
+    std::mutex              _demuxing_context_mutex{}; // Protects _format_ctx, which is used both by the demuxing thread to read packets, and by seek_to()
+    std::condition_variable _waiting_for_seek{};       // The demuxing thread waits on it once it has reached the end of the file
+    bool                    _has_reached_end_of_file{false};
+};
+
+} // namespace ffmpeg
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstdint>
+
+namespace ffmpeg {
+
+struct Frame {
+    uint8_t* data{};   /// Pointer to all the pixels, in the color space that you requested when constructing the VideoDecoder. If there is some alpha it will always be straight alpha, never premultiplied.
+    int      width{};  /// In pixels
+    int      height{}; /// In pixels
+    bool     is_different_from_previous_frame{};
+    bool     is_last_frame{};       /// If this is the last frame in the file, we will keep returning it, but you can might want to do something else (like displaying nothing, or seeking back to the beginning of the file).
+    double   time_in_seconds{};     /// Present time of the frame. It might be slightly before the time you requested, since a frame stays visible until the next one starts.
+    double   duration_in_seconds{}; /// How long the frame stays visible. Might be 0 if the file doesn't tell us (which is rare).
+};
+
+} // namespace ffmpeg
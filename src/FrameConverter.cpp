@@ -0,0 +1,54 @@
+#include "FrameConverter.hpp"
+#include <array>
+#include "utils.hpp"
+
+extern "C"
+{
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+
+namespace ffmpeg {
+
+FrameConverter::FrameConverter(AVPixelFormat pixel_format, int sws_flags)
+    : _pixel_format{pixel_format}
+    , _sws_flags{sws_flags}
+{}
+
+FrameConverter::~FrameConverter()
+{
+    sws_freeContext(_sws_ctx);
+}
+
+void FrameConverter::convert(AVFrame const& frame, std::vector<uint8_t>& output)
+{
+    convert(frame, frame.width, frame.height, output);
+}
+
+void FrameConverter::convert(AVFrame const& frame, int width, int height, std::vector<uint8_t>& output)
+{
+    // Only recreates the context if the size or format of the frames changed
+    _sws_ctx = sws_getCachedContext(
+        _sws_ctx,
+        frame.width, frame.height,
+        static_cast<AVPixelFormat>(frame.format),
+        width, height,
+        _pixel_format,
+        _sws_flags, nullptr, nullptr, nullptr
+    );
+    if (!_sws_ctx)
+        throw_error("Failed to create conversion context");
+
+    output.resize(static_cast<size_t>(av_image_get_buffer_size(_pixel_format, width, height, 1)));
+    auto data     = std::array<uint8_t*, 4>{};
+    auto linesize = std::array<int, 4>{};
+    {
+        int const err = av_image_fill_arrays(data.data(), linesize.data(), output.data(), _pixel_format, width, height, 1);
+        if (err < 0)
+            throw_error("Failed to setup image arrays", err);
+    }
+    sws_scale(_sws_ctx, frame.data, frame.linesize, 0, frame.height, data.data(), linesize.data());
+}
+
+} // namespace ffmpeg
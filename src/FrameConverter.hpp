@@ -0,0 +1,37 @@
+#pragma once
+extern "C"
+{
+#include <libavutil/pixfmt.h>
+}
+#include <cstdint>
+#include <vector>
+
+struct AVFrame;
+struct SwsContext;
+
+namespace ffmpeg {
+
+/// Converts decoded frames to the pixel format (and optionally the size) requested by the user.
+/// NB: this is not thread-safe, each thread needs its own FrameConverter.
+class FrameConverter {
+public:
+    /// `sws_flags` are only relevant when resizing, they select the scaling algorithm (e.g. `SWS_BILINEAR`).
+    explicit FrameConverter(AVPixelFormat pixel_format, int sws_flags = 0);
+    ~FrameConverter();
+    FrameConverter(FrameConverter const&)                        = delete;
+    auto operator=(FrameConverter const&) -> FrameConverter&     = delete;
+    FrameConverter(FrameConverter&&) noexcept                    = delete;
+    auto operator=(FrameConverter&&) noexcept -> FrameConverter& = delete;
+
+    /// Throws on error
+    /// `output` is resized to fit the converted image. Reusing the same vector for several frames avoids reallocating it every time.
+    void convert(AVFrame const& frame, std::vector<uint8_t>& output);
+    void convert(AVFrame const& frame, int width, int height, std::vector<uint8_t>& output);
+
+private:
+    SwsContext*   _sws_ctx{};
+    AVPixelFormat _pixel_format;
+    int           _sws_flags;
+};
+
+} // namespace ffmpeg
@@ -0,0 +1,126 @@
+#include "FrameStream.hpp"
+#include <algorithm>
+#include <ranges>
+#include "FrameConverter.hpp"
+#include "utils.hpp"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+namespace ffmpeg {
+
+static_assert(std::ranges::input_range<FrameStream>);
+
+FrameStream::FrameStream(Input const& input, AVPixelFormat pixel_format, size_t frames_decoded_ahead)
+    : _reader{input}
+    , _pixel_format{pixel_format}
+    , _frames_decoded_ahead{std::max(frames_decoded_ahead, size_t{1})}
+{
+    // Once the reader is created, we can spawn the thread that will use it and start decoding the frames
+    _decoding_thread = std::thread{&FrameStream::decoding_thread_job, std::ref(*this)};
+}
+
+FrameStream::~FrameStream()
+{
+    _wants_to_stop_decoding_thread.store(true);
+    {
+        std::unique_lock lock{_mutex}; // Make sure the thread is not between the check of its predicate and the start of its wait, otherwise it would miss the notification
+    }
+    _waiting_for_pop.notify_all();
+    _decoding_thread.join();
+}
+
+auto FrameStream::begin() -> Iterator
+{
+    move_to_next_frame();
+    return Iterator{this};
+}
+
+void FrameStream::decoding_thread_job(FrameStream& This)
+{
+    try
+    {
+        This.decode_all_frames();
+    }
+    catch (...)
+    {
+        std::unique_lock lock{This._mutex};
+        This._error = std::current_exception();
+    }
+    {
+        std::unique_lock lock{This._mutex};
+        This._decoding_is_done = true;
+    }
+    This._waiting_for_push.notify_one();
+}
+
+void FrameStream::decode_all_frames()
+{
+    auto            converter = FrameConverter{_pixel_format};
+    FrameRaii const frame{};
+    while (!_wants_to_stop_decoding_thread.load() && _reader.read_next_frame(frame.frame))
+    {
+        auto converted = ConvertedFrame{
+            .width               = frame.frame->width,
+            .height              = frame.frame->height,
+            .time_in_seconds     = _reader.present_time(*frame.frame),
+            .duration_in_seconds = frame_duration_in_seconds(*frame.frame, _reader.video_stream()),
+        };
+        {
+            std::unique_lock lock{_mutex};
+            if (!_free_buffers.empty())
+            {
+                converted.data = std::move(_free_buffers.back());
+                _free_buffers.pop_back();
+            }
+        }
+        converter.convert(*frame.frame, converted.data); // Done on this thread, so that the consumer receives frames that are ready to use
+
+        {
+            std::unique_lock lock{_mutex};
+            _waiting_for_pop.wait(lock, [&]() { return _queue.size() < _frames_decoded_ahead || _wants_to_stop_decoding_thread.load(); });
+            if (_wants_to_stop_decoding_thread.load())
+                return;
+            _queue.push_back(std::move(converted));
+        }
+        _waiting_for_push.notify_one();
+    }
+}
+
+void FrameStream::move_to_next_frame()
+{
+    if (_has_reached_the_end)
+        return;
+
+    {
+        std::unique_lock lock{_mutex};
+        if (!_current.data.empty())
+            _free_buffers.push_back(std::move(_current.data));
+
+        _waiting_for_push.wait(lock, [&]() { return !_queue.empty() || _decoding_is_done; });
+        if (_queue.empty())
+        {
+            _has_reached_the_end = true;
+            if (_error)
+                std::rethrow_exception(_error);
+            return;
+        }
+        _current = std::move(_queue.front());
+        _queue.pop_front();
+    }
+    _waiting_for_pop.notify_one();
+
+    _current_frame = Frame{
+        .data                             = _current.data.data(),
+        .width                            = _current.width,
+        .height                           = _current.height,
+        .is_different_from_previous_frame = true,
+        .is_last_frame                    = false,
+        .time_in_seconds                  = _current.time_in_seconds,
+        .duration_in_seconds              = _current.duration_in_seconds,
+    };
+}
+
+} // namespace ffmpeg
@@ -0,0 +1,110 @@
+#pragma once
+extern "C"
+{
+#include <libavutil/pixfmt.h>
+}
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Frame.hpp"
+#include "Input.hpp"
+#include "VideoReader.hpp"
+
+namespace ffmpeg {
+
+/// Yields every frame of a file, in order, exactly once. This is what you want for sequential processing, instead of calling VideoDecoder::get_frame_at() with guessed times.
+/// A thread decodes and converts the frames ahead of you, so that the next frame is usually already available when you ask for it.
+/// Usage:
+///     for (ffmpeg::Frame const& frame : ffmpeg::FrameStream{path, AV_PIX_FMT_RGBA})
+///         process(frame);
+/// The `data` of a frame is only valid until you move on to the next frame.
+/// `is_last_frame` is never set, the iteration simply ends after the last frame.
+/// Errors that occur while decoding are thrown (as `std::runtime_error`) when you try to move past the last frame that could be decoded.
+class FrameStream {
+public:
+    /// Throws a `std::runtime_error` if the creation fails (file not found / invalid video file / format not supported, etc.)
+    /// `input` can be a path to a file, a buffer in memory, or your own DataSource.
+    /// `frames_decoded_ahead` is the max number of frames that are decoded and converted before you consume them.
+    FrameStream(Input const& input, AVPixelFormat pixel_format, size_t frames_decoded_ahead = 4);
+    ~FrameStream();
+    FrameStream(FrameStream const&)                        = delete; ///
+    auto operator=(FrameStream const&) -> FrameStream&     = delete; /// Not allowed to copy nor move the class (because we spawn a thread with a reference to this object)
+    FrameStream(FrameStream&&) noexcept                    = delete; /// If you need to move it then heap-allocate it, typically in a std::unique_ptr
+    auto operator=(FrameStream&&) noexcept -> FrameStream& = delete; ///
+
+    class Iterator {
+    public:
+        using value_type      = Frame;
+        using difference_type = std::ptrdiff_t;
+
+        Iterator() = default;
+        explicit Iterator(FrameStream* stream)
+            : _stream{stream}
+        {}
+
+        auto operator*() const -> Frame const& { return _stream->_current_frame; }
+        auto operator->() const -> Frame const* { return &_stream->_current_frame; }
+        auto operator++() -> Iterator&
+        {
+            _stream->move_to_next_frame();
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+
+        friend auto operator==(Iterator const& it, std::default_sentinel_t) -> bool { return it.has_reached_the_end(); }
+
+    private:
+        [[nodiscard]] auto has_reached_the_end() const -> bool { return !_stream || _stream->_has_reached_the_end; }
+
+    private:
+        FrameStream* _stream{};
+    };
+
+    /// Can only be called once: the frames are consumed as you iterate.
+    [[nodiscard]] auto begin() -> Iterator;
+    [[nodiscard]] static auto end() -> std::default_sentinel_t { return std::default_sentinel; }
+
+private:
+    struct ConvertedFrame {
+        std::vector<uint8_t> data{};
+        int                  width{};
+        int                  height{};
+        double               time_in_seconds{};
+        double               duration_in_seconds{};
+    };
+
+    static void decoding_thread_job(FrameStream& This);
+    void        decode_all_frames();
+    void        move_to_next_frame();
+
+private:
+    VideoReader   _reader;
+    AVPixelFormat _pixel_format;
+    size_t        _frames_decoded_ahead;
+
+    // Consumer side
+    ConvertedFrame _current{};
+    Frame          _current_frame{};
+    bool           _has_reached_the_end{false};
+
+    // Shared with the decoding thread
+    std::deque<ConvertedFrame>        _queue{};
+    std::vector<std::vector<uint8_t>> _free_buffers{}; // Recycled once the consumer is done with a frame, so that we don't allocate on every frame
+    bool                              _decoding_is_done{false};
+    std::exception_ptr                _error{};
+    std::mutex                        _mutex{};
+    std::condition_variable           _waiting_for_push{};
+    std::condition_variable           _waiting_for_pop{};
+
+    // Thread
+    std::thread       _decoding_thread{};
+    std::atomic<bool> _wants_to_stop_decoding_thread{false};
+};
+
+} // namespace ffmpeg
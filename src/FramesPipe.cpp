@@ -0,0 +1,95 @@
+#include "FramesPipe.hpp"
+#include <algorithm>
+#include "utils.hpp"
+
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+
+namespace ffmpeg {
+
+FramesPipe::FramesPipe(size_t capacity)
+{
+    _all_frames.resize(std::max(capacity, size_t{1}));
+    for (AVFrame*& frame : _all_frames)
+    {
+        frame = av_frame_alloc();
+        if (!frame)
+            throw_error("Not enough memory to allocate the frames");
+    }
+    _dead_frames = _all_frames;
+}
+
+FramesPipe::~FramesPipe()
+{
+    for (AVFrame*& frame : _all_frames)
+        av_frame_free(&frame);
+}
+
+auto FramesPipe::get_frame_to_fill() -> AVFrame*
+{
+    std::unique_lock lock{_mutex};
+    _waiting_for_recycle.wait(lock, [&]() { return !_dead_frames.empty() || _is_aborted; });
+    if (_is_aborted)
+        return nullptr;
+    AVFrame* const frame = _dead_frames.back();
+    _dead_frames.pop_back();
+    return frame;
+}
+
+void FramesPipe::push(AVFrame* frame)
+{
+    {
+        std::unique_lock lock{_mutex};
+        _alive_frames.push_back(frame);
+    }
+    _waiting_for_push.notify_one();
+}
+
+auto FramesPipe::pop() -> AVFrame*
+{
+    std::unique_lock lock{_mutex};
+    _waiting_for_push.wait(lock, [&]() { return !_alive_frames.empty() || _is_closed || _is_aborted; });
+    if (_alive_frames.empty() || _is_aborted)
+        return nullptr;
+    AVFrame* const frame = _alive_frames.front();
+    _alive_frames.pop_front();
+    return frame;
+}
+
+void FramesPipe::recycle(AVFrame* frame)
+{
+    {
+        std::unique_lock lock{_mutex};
+        _dead_frames.push_back(frame);
+    }
+    _waiting_for_recycle.notify_one();
+}
+
+void FramesPipe::close()
+{
+    {
+        std::unique_lock lock{_mutex};
+        _is_closed = true;
+    }
+    _waiting_for_push.notify_all();
+}
+
+void FramesPipe::abort()
+{
+    {
+        std::unique_lock lock{_mutex};
+        _is_aborted = true;
+    }
+    _waiting_for_push.notify_all();
+    _waiting_for_recycle.notify_all();
+}
+
+auto FramesPipe::has_been_aborted() -> bool
+{
+    std::unique_lock lock{_mutex};
+    return _is_aborted;
+}
+
+} // namespace ffmpeg
@@ -0,0 +1,49 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+struct AVFrame;
+
+namespace ffmpeg {
+
+/// Bounded queue of frames between two threads, that owns a fixed set of frames and recycles them, so that no frame gets allocated in steady state.
+/// The producer takes a free frame with get_frame_to_fill(), fills it and push()es it. The consumer pop()s it, uses it, and gives it back with recycle().
+/// The frames keep their buffers when they are recycled: the producer can reuse them as they are, or unref them and attach new ones.
+class FramesPipe {
+public:
+    explicit FramesPipe(size_t capacity);
+    ~FramesPipe();
+    FramesPipe(FramesPipe const&)                        = delete;
+    auto operator=(FramesPipe const&) -> FramesPipe&     = delete;
+    FramesPipe(FramesPipe&&) noexcept                    = delete;
+    auto operator=(FramesPipe&&) noexcept -> FramesPipe& = delete;
+
+    /// Blocks until a frame is free (this is what slows the producer down when the consumer can't keep up). Returns nullptr if the pipe has been aborted.
+    [[nodiscard]] auto get_frame_to_fill() -> AVFrame*;
+    void               push(AVFrame*);
+    /// Blocks until a frame has been pushed. Returns nullptr once the pipe has been closed and all the frames have been popped, or as soon as it has been aborted.
+    [[nodiscard]] auto pop() -> AVFrame*;
+    void               recycle(AVFrame*);
+
+    /// Called by the producer once it has pushed its last frame.
+    void               close();
+    /// Called when a stage of the pipeline fails, so that neither the producer nor the consumer waits for the other one anymore.
+    void               abort();
+    [[nodiscard]] auto has_been_aborted() -> bool;
+
+private:
+    std::vector<AVFrame*> _all_frames{};
+    std::deque<AVFrame*>  _alive_frames{}; // Pushed, waiting to be popped
+    std::vector<AVFrame*> _dead_frames{};  // Free to be filled
+    bool                  _is_closed{false};
+    bool                  _is_aborted{false};
+    std::mutex            _mutex{};
+
+    std::condition_variable _waiting_for_push{};
+    std::condition_variable _waiting_for_recycle{};
+};
+
+} // namespace ffmpeg
@@ -0,0 +1,25 @@
+#include "Input.hpp"
+#include <algorithm>
+
+namespace ffmpeg {
+
+auto MemoryDataSource::read_at(int64_t position, std::span<uint8_t> buffer) -> size_t
+{
+    if (position < 0 || static_cast<size_t>(position) >= _data.size())
+        return 0;
+    auto const bytes_count = std::min(buffer.size(), _data.size() - static_cast<size_t>(position));
+    std::copy_n(_data.begin() + position, bytes_count, buffer.begin());
+    return bytes_count;
+}
+
+auto Input::data_source() const -> std::shared_ptr<DataSource> const*
+{
+    return std::get_if<std::shared_ptr<DataSource>>(&_source);
+}
+
+auto Input::path() const -> std::filesystem::path const*
+{
+    return std::get_if<std::filesystem::path>(&_source);
+}
+
+} // namespace ffmpeg
@@ -0,0 +1,92 @@
+#pragma once
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <ranges>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace ffmpeg {
+
+enum class AccessPattern {
+    Sequential, /// We are playing the video, reading the data from start to end
+    Random,     /// We are scrubbing / seeking around in the video
+};
+
+/// Random-access source of bytes, that you can implement to decode media that doesn't live in a regular file (packed archives, network caches, etc.)
+/// NB: it will be read from several threads at the same time (a VideoDecoder uses several demuxers on the same input), so your implementation must be thread-safe.
+/// This is why reads are positional: each demuxer keeps track of its own position.
+class DataSource {
+public:
+    DataSource()                                     = default;
+    virtual ~DataSource()                            = default;
+    DataSource(DataSource const&)                    = delete;
+    auto operator=(DataSource const&) -> DataSource& = delete;
+    DataSource(DataSource&&)                         = delete;
+    auto operator=(DataSource&&) -> DataSource&      = delete;
+
+    /// Total size of the data, in bytes.
+    [[nodiscard]] virtual auto size() const -> int64_t = 0;
+
+    /// Copies the bytes starting at `position` into `buffer`, and returns how many bytes were copied. Returning less than `buffer.size()` is allowed, and returning 0 means that we reached the end of the data.
+    /// You can throw an exception to report an error, it will be reported as a read error by the demuxer.
+    [[nodiscard]] virtual auto read_at(int64_t position, std::span<uint8_t> buffer) -> size_t = 0;
+
+    /// Tells you how the data is about to be read, so that you can tune your read-ahead / caching strategy. Called by the VideoDecoder when it switches between playback and scrubbing.
+    virtual void hint_access_pattern(AccessPattern) {}
+};
+
+/// Reads from a buffer in memory, without copying it.
+/// NB: you need to keep the memory alive for as long as it is used.
+class MemoryDataSource : public DataSource {
+public:
+    explicit MemoryDataSource(std::span<uint8_t const> data)
+        : _data{data}
+    {}
+
+    [[nodiscard]] auto size() const -> int64_t override { return static_cast<int64_t>(_data.size()); }
+    [[nodiscard]] auto read_at(int64_t position, std::span<uint8_t> buffer) -> size_t override;
+
+private:
+    std::span<uint8_t const> _data;
+};
+
+/// Where to read the media from: a file, a buffer in memory, or your own DataSource.
+/// It is implicitly constructible from all of those, so you can pass any of them wherever an Input is expected.
+class Input {
+public:
+    /// Accepts anything a path can be built from (std::filesystem::path, std::string, char const*, etc.)
+    /// NB: this is a template because otherwise going from a string to an Input would need two user-defined conversions, which C++ doesn't allow implicitly.
+    template<typename PathT>
+        requires std::constructible_from<std::filesystem::path, PathT>
+    Input(PathT&& path) // NOLINT(*explicit-constructor, *explicit-conversions, *forwarding-reference-overload)
+        : _source{std::filesystem::path{std::forward<PathT>(path)}}
+    {}
+    Input(std::span<uint8_t const> data) // NOLINT(*explicit-constructor, *explicit-conversions)
+        : _source{std::make_shared<MemoryDataSource>(data)}
+    {}
+    /// Accepts any contiguous container of bytes (std::vector<uint8_t>, std::array<uint8_t, N>, etc.). It doesn't copy them, you need to keep them alive for as long as they are used.
+    template<std::ranges::contiguous_range BytesT>
+        requires std::ranges::sized_range<BytesT> && std::same_as<std::remove_cv_t<std::ranges::range_value_t<BytesT>>, uint8_t>
+    Input(BytesT const& data) // NOLINT(*explicit-constructor, *explicit-conversions)
+        : Input{std::span<uint8_t const>{std::ranges::data(data), std::ranges::size(data)}}
+    {}
+    template<std::derived_from<DataSource> DataSourceT>
+    Input(std::shared_ptr<DataSourceT> data_source) // NOLINT(*explicit-constructor, *explicit-conversions)
+        : _source{std::shared_ptr<DataSource>{std::move(data_source)}}
+    {}
+
+    /// nullptr if the input is a path
+    [[nodiscard]] auto data_source() const -> std::shared_ptr<DataSource> const*;
+    /// nullptr if the input is a DataSource
+    [[nodiscard]] auto path() const -> std::filesystem::path const*;
+
+private:
+    std::variant<std::filesystem::path, std::shared_ptr<DataSource>> _source;
+};
+
+} // namespace ffmpeg
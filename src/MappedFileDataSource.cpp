@@ -0,0 +1,119 @@
+#include "MappedFileDataSource.hpp"
+#include <algorithm>
+#include "utils.hpp"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ffmpeg {
+
+#if defined(_WIN32)
+
+MappedFileDataSource::MappedFileDataSource(std::filesystem::path const& path)
+{
+    _file_handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (_file_handle == INVALID_HANDLE_VALUE)
+        throw_error("Could not open file \"" + path.string() + "\"");
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(_file_handle, &size))
+    {
+        CloseHandle(_file_handle);
+        throw_error("Could not get the size of file \"" + path.string() + "\"");
+    }
+    _size = static_cast<size_t>(size.QuadPart);
+    if (_size == 0) // Can't map an empty file, but we don't need to: all reads will return 0
+        return;
+
+    _mapping_handle = CreateFileMappingW(_file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (_mapping_handle)
+        _data = static_cast<uint8_t const*>(MapViewOfFile(_mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    if (!_data)
+    {
+        if (_mapping_handle)
+            CloseHandle(_mapping_handle);
+        CloseHandle(_file_handle);
+        throw_error("Could not memory-map file \"" + path.string() + "\"");
+    }
+}
+
+MappedFileDataSource::~MappedFileDataSource()
+{
+    if (_data)
+        UnmapViewOfFile(_data);
+    if (_mapping_handle)
+        CloseHandle(_mapping_handle);
+    CloseHandle(_file_handle);
+}
+
+void MappedFileDataSource::hint_access_pattern(AccessPattern)
+{
+    // Windows has no equivalent of madvise() for whole mappings, its read-ahead already adapts to the access pattern
+}
+
+#else
+
+MappedFileDataSource::MappedFileDataSource(std::filesystem::path const& path)
+{
+    int const file = open(path.c_str(), O_RDONLY | O_CLOEXEC); // NOLINT(*vararg)
+    if (file < 0)
+        throw_error("Could not open file \"" + path.string() + "\"");
+
+    struct stat file_info{};
+    if (fstat(file, &file_info) != 0)
+    {
+        close(file);
+        throw_error("Could not get the size of file \"" + path.string() + "\"");
+    }
+    _size = static_cast<size_t>(file_info.st_size);
+    if (_size == 0) // Can't map an empty file, but we don't need to: all reads will return 0
+    {
+        close(file);
+        return;
+    }
+
+    void* const data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file); // The mapping keeps its own reference to the file
+    if (data == MAP_FAILED) // NOLINT(*cstyle-cast, *int-to-ptr)
+        throw_error("Could not memory-map file \"" + path.string() + "\"");
+    _data = static_cast<uint8_t const*>(data);
+}
+
+MappedFileDataSource::~MappedFileDataSource()
+{
+    if (_data)
+        munmap(const_cast<uint8_t*>(_data), _size); // NOLINT(*const-cast)
+}
+
+void MappedFileDataSource::hint_access_pattern(AccessPattern pattern)
+{
+    if (!_data)
+        return;
+    // Sequential makes the kernel read ahead aggressively (and drop the pages behind us), Random disables read-ahead so that each seek only faults in the pages it needs
+    madvise(const_cast<uint8_t*>(_data), _size, pattern == AccessPattern::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM); // NOLINT(*const-cast)
+}
+
+#endif
+
+auto MappedFileDataSource::read_at(int64_t position, std::span<uint8_t> buffer) -> size_t
+{
+    if (position < 0 || static_cast<size_t>(position) >= _size)
+        return 0;
+    auto const bytes_count = std::min(buffer.size(), _size - static_cast<size_t>(position));
+    std::copy_n(_data + position, bytes_count, buffer.begin()); // NOLINT(*pointer-arithmetic)
+    return bytes_count;
+}
+
+} // namespace ffmpeg
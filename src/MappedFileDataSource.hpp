@@ -0,0 +1,34 @@
+#pragma once
+#include <filesystem>
+#include "Input.hpp"
+
+namespace ffmpeg {
+
+/// Reads a file through a memory mapping instead of read() calls. This avoids a syscall for every read and every seek, which speeds up seek-heavy scrubbing. (The bytes are still copied once, into the read buffer of FFmpeg.)
+/// Switches the read-ahead of the OS between sequential (during playback) and random (during scrubbing) based on the hints given by the VideoDecoder.
+/// Usage:
+///     auto decoder = ffmpeg::VideoDecoder{std::make_shared<ffmpeg::MappedFileDataSource>(path), AV_PIX_FMT_RGBA};
+class MappedFileDataSource : public DataSource {
+public:
+    /// Throws a `std::runtime_error` if the file cannot be opened or mapped.
+    explicit MappedFileDataSource(std::filesystem::path const& path);
+    ~MappedFileDataSource() override;
+    MappedFileDataSource(MappedFileDataSource const&)                        = delete;
+    auto operator=(MappedFileDataSource const&) -> MappedFileDataSource&     = delete;
+    MappedFileDataSource(MappedFileDataSource&&) noexcept                    = delete;
+    auto operator=(MappedFileDataSource&&) noexcept -> MappedFileDataSource& = delete;
+
+    [[nodiscard]] auto size() const -> int64_t override { return static_cast<int64_t>(_size); }
+    [[nodiscard]] auto read_at(int64_t position, std::span<uint8_t> buffer) -> size_t override;
+    void               hint_access_pattern(AccessPattern) override;
+
+private:
+    uint8_t const* _data{};
+    size_t         _size{};
+#if defined(_WIN32)
+    void* _file_handle{};
+    void* _mapping_handle{};
+#endif
+};
+
+} // namespace ffmpeg
@@ -0,0 +1,141 @@
+#include "PacketsQueue.hpp"
+#include <algorithm>
+#include <cassert>
+#include "utils.hpp"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+namespace ffmpeg {
+
+PacketsQueue::~PacketsQueue()
+{
+    for (DemuxedPacket& demuxed : _packets)
+        av_packet_free(&demuxed.packet);
+    for (AVPacket*& packet : _free_packets)
+        av_packet_free(&packet);
+}
+
+auto PacketsQueue::is_full_no_lock() const -> bool
+{
+    return _packets.size() >= max_packets_count || _size_in_bytes >= max_size_in_bytes;
+}
+
+auto PacketsQueue::serial() -> uint64_t
+{
+    std::unique_lock lock{_mutex};
+    return _serial;
+}
+
+auto PacketsQueue::stats() -> PacketsQueueStats
+{
+    std::unique_lock lock{_mutex};
+    auto             stats = _stats;
+    stats.packets_count    = _packets.size();
+    stats.size_in_bytes    = _size_in_bytes;
+    return stats;
+}
+
+auto PacketsQueue::get_packet_to_fill() -> AVPacket*
+{
+    {
+        std::unique_lock lock{_mutex};
+        if (!_free_packets.empty())
+        {
+            AVPacket* const packet = _free_packets.back();
+            _free_packets.pop_back();
+            return packet;
+        }
+    }
+    AVPacket* const packet = av_packet_alloc();
+    if (!packet)
+        throw_error("Not enough memory to read the file");
+    return packet;
+}
+
+void PacketsQueue::push(AVPacket* packet, int error, uint64_t serial)
+{
+    {
+        std::unique_lock lock{_mutex};
+        if (serial != _serial || _is_closed) // We have seeked since this packet was read, it is not the one that comes next anymore (or nobody is going to consume it)
+        {
+            if (packet)
+                recycle_no_lock(packet);
+            if (error >= 0) // Errors (and the end of the file) are not packets that have been read for nothing
+                _stats.outdated_packets_dropped++;
+            return;
+        }
+        if (error < 0)
+        {
+            if (packet)
+                recycle_no_lock(packet);
+            packet = nullptr;
+        }
+        else
+        {
+            _size_in_bytes += static_cast<size_t>(packet->size);
+        }
+        _packets.push_back({.packet = packet, .error = error});
+        _stats.peak_packets_count = std::max(_stats.peak_packets_count, _packets.size());
+        _stats.peak_size_in_bytes = std::max(_stats.peak_size_in_bytes, _size_in_bytes);
+    }
+    _waiting_for_push.notify_one();
+}
+
+auto PacketsQueue::pop_no_lock(AVPacket* destination) -> int
+{
+    assert(!_packets.empty());
+    auto const demuxed = _packets.front();
+    _packets.pop_front();
+    if (demuxed.packet)
+    {
+        _size_in_bytes -= static_cast<size_t>(demuxed.packet->size);
+        av_packet_move_ref(destination, demuxed.packet);
+        _free_packets.push_back(demuxed.packet);
+    }
+    return demuxed.error;
+}
+
+void PacketsQueue::recycle(AVPacket* packet)
+{
+    std::unique_lock lock{_mutex};
+    recycle_no_lock(packet);
+}
+
+void PacketsQueue::recycle_no_lock(AVPacket* packet)
+{
+    av_packet_unref(packet);
+    _free_packets.push_back(packet);
+}
+
+void PacketsQueue::clear()
+{
+    {
+        std::unique_lock lock{_mutex};
+        for (DemuxedPacket const& demuxed : _packets)
+        {
+            if (!demuxed.packet) // Errors (and the end of the file) are not packets that have been read for nothing
+                continue;
+            recycle_no_lock(demuxed.packet);
+            _stats.outdated_packets_dropped++;
+        }
+        _packets.clear();
+        _size_in_bytes = 0;
+        _serial++;
+    }
+    _waiting_for_pop.notify_one();
+}
+
+void PacketsQueue::close()
+{
+    clear();
+    {
+        std::unique_lock lock{_mutex};
+        _is_closed = true;
+    }
+    _waiting_for_pop.notify_one();
+}
+
+} // namespace ffmpeg
@@ -0,0 +1,129 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+struct AVPacket;
+
+namespace ffmpeg {
+
+/// Occupancy of the queue of packets that the demuxing thread reads ahead of the decoding thread.
+/// If the decoder often has to wait for packets, decoding is limited by I/O. If the demuxer often has to wait for room in the queue, it is limited by the decoding.
+struct PacketsQueueStats {
+    size_t   packets_count{};            /// Currently in the queue
+    size_t   size_in_bytes{};            /// Currently in the queue
+    size_t   peak_packets_count{};       /// Highest number of packets that have been in the queue at the same time
+    size_t   peak_size_in_bytes{};       /// Highest size that the queue has reached
+    uint64_t times_decoder_waited{};     /// Number of times the decoder found the queue empty and had to wait for the demuxer
+    uint64_t times_demuxer_waited{};     /// Number of times the demuxer found the queue full and had to wait for the decoder
+    uint64_t outdated_packets_dropped{}; /// Packets that had been read ahead but were thrown away because we seeked
+};
+
+/// Packets of one stream that the Demuxer has read ahead of the decoder of that stream, so that slow I/O doesn't stall the decoding.
+/// Bounded both in number of packets and in bytes.
+class PacketsQueue {
+public:
+    PacketsQueue() = default;
+    ~PacketsQueue();
+    PacketsQueue(PacketsQueue const&)                        = delete;
+    auto operator=(PacketsQueue const&) -> PacketsQueue&     = delete;
+    PacketsQueue(PacketsQueue&&) noexcept                    = delete;
+    auto operator=(PacketsQueue&&) noexcept -> PacketsQueue& = delete;
+
+    [[nodiscard]] auto is_full_no_lock() const -> bool;
+    [[nodiscard]] auto is_empty_no_lock() const -> bool { return _packets.empty(); }
+    /// True once the decoder of this stream has been destroyed. The packets pushed after that are dropped.
+    [[nodiscard]] auto is_closed_no_lock() const -> bool { return _is_closed; }
+    /// Changes every time the queue is cleared (i.e. every time the Demuxer seeks). Packets that have been read before a clear() are outdated, and will be dropped when pushed.
+    /// Decoders also use it to detect that the Demuxer has been moved by another decoder.
+    [[nodiscard]] auto serial() -> uint64_t;
+    [[nodiscard]] auto serial_no_lock() const -> uint64_t { return _serial; }
+    [[nodiscard]] auto stats() -> PacketsQueueStats;
+    void               count_decoder_wait_no_lock() { _stats.times_decoder_waited++; }
+    void               count_demuxer_wait_no_lock() { _stats.times_demuxer_waited++; }
+
+    /// Returns a packet that can be filled and then given back with push() or recycle()
+    [[nodiscard]] auto get_packet_to_fill() -> AVPacket*;
+    /// Takes ownership of the packet. `error` is what av_read_frame() returned while filling it (in which case the packet can be nullptr).
+    void push(AVPacket*, int error, uint64_t serial);
+    /// Moves the first packet into `destination`, and returns the error that came with it. The queue must not be empty.
+    [[nodiscard]] auto pop_no_lock(AVPacket* destination) -> int;
+    void               recycle(AVPacket*);
+    void               clear();
+    /// Called by the decoder of the stream when it gets destroyed, so that the Demuxer doesn't wait for it to consume packets
+    void               close();
+
+    auto waiting_for_queue_to_fill_up() -> std::condition_variable& { return _waiting_for_push; }
+    auto waiting_for_queue_to_empty_out() -> std::condition_variable& { return _waiting_for_pop; }
+
+    auto mutex() -> std::mutex& { return _mutex; }
+
+private:
+    void recycle_no_lock(AVPacket*);
+
+private:
+    struct DemuxedPacket {
+        AVPacket* packet{};
+        int       error{}; // Result of av_read_frame(). When < 0, the packet is empty.
+    };
+
+    std::deque<DemuxedPacket> _packets{};
+    std::vector<AVPacket*>    _free_packets{}; // Recycled so that we don't allocate on every packet
+    size_t                    _size_in_bytes{0};
+    uint64_t                  _serial{0};
+    bool                      _is_closed{false};
+    PacketsQueueStats         _stats{}; // Its packets_count and size_in_bytes are only filled when calling stats()
+    std::mutex                _mutex{};
+
+    std::condition_variable _waiting_for_push{};
+    std::condition_variable _waiting_for_pop{};
+
+    static constexpr size_t max_packets_count{256};
+    static constexpr size_t max_size_in_bytes{16 * 1024 * 1024};
+};
+
+/// The queue of a stream that a decoder has taken from the Demuxer (see Demuxer::take_packets()).
+/// Closes the queue when destroyed, so that the Demuxer never waits for a decoder that doesn't exist anymore, even when the constructor of that decoder throws after taking the queue.
+/// NB: the Demuxer owns the queue, so it must outlive this handle.
+class TakenPacketsQueue {
+public:
+    TakenPacketsQueue() = default;
+    explicit TakenPacketsQueue(PacketsQueue& queue)
+        : _queue{&queue}
+    {}
+    ~TakenPacketsQueue() { reset(); }
+    TakenPacketsQueue(TakenPacketsQueue const&)                    = delete;
+    auto operator=(TakenPacketsQueue const&) -> TakenPacketsQueue& = delete;
+    TakenPacketsQueue(TakenPacketsQueue&& other) noexcept
+        : _queue{std::exchange(other._queue, nullptr)}
+    {}
+    auto operator=(TakenPacketsQueue&& other) noexcept -> TakenPacketsQueue&
+    {
+        if (this != &other)
+        {
+            reset();
+            _queue = std::exchange(other._queue, nullptr);
+        }
+        return *this;
+    }
+
+    /// Closes the queue (if we have one), and forgets it
+    void reset()
+    {
+        if (_queue)
+            _queue->close();
+        _queue = nullptr;
+    }
+
+    auto operator->() const -> PacketsQueue* { return _queue; }
+    auto operator*() const -> PacketsQueue& { return *_queue; }
+
+private:
+    PacketsQueue* _queue{};
+};
+
+} // namespace ffmpeg
@@ -0,0 +1,148 @@
+#include "ProxyVideoDecoder.hpp"
+#include <exception>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include "utils.hpp"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+namespace ffmpeg {
+
+static constexpr char const* source_fingerprint_key{"easy_ffmpeg_source"}; // Tag of the proxy that stores the fingerprint of its original
+
+/// Identifies the original video, so that we don't reuse a proxy that has been generated from another video (e.g. another buffer in memory, or a file that has been replaced by another one)
+static auto source_fingerprint(Input const& input, Demuxer const& demuxer) -> std::string
+{
+    auto       error = std::error_code{};
+    auto const size  = input.path()
+                           ? static_cast<int64_t>(std::filesystem::file_size(*input.path(), error))
+                           : (*input.data_source())->size();
+    return "size=" + std::to_string(size) + " duration=" + std::to_string(demuxer.duration_in_seconds());
+}
+
+/// nullopt if the container of the proxy didn't keep the tag. Throws if the proxy can't be opened.
+static auto proxy_source_fingerprint(std::filesystem::path const& proxy_path) -> std::optional<std::string>
+{
+    AVFormatContext* format_ctx = open_format_context(proxy_path);
+    auto const*      entry      = av_dict_get(format_ctx->metadata, source_fingerprint_key, nullptr, 0);
+    auto             result     = entry ? std::optional{std::string{entry->value}} : std::nullopt;
+    close_format_context(format_ctx);
+    return result;
+}
+
+/// The proxy can only be reused if it has been generated from the same original (same fingerprint), and after the last modification of the original file.
+/// When the container of the proxy doesn't keep the fingerprint, we can only rely on the modification time, so we never reuse the proxy of a DataSource in that case.
+static auto proxy_is_up_to_date(Input const& input, std::filesystem::path const& proxy_path, std::string const& fingerprint) -> bool
+{
+    auto error = std::error_code{};
+    if (!std::filesystem::exists(proxy_path, error))
+        return false;
+    auto proxy_fingerprint = std::optional<std::string>{};
+    try
+    {
+        proxy_fingerprint = proxy_source_fingerprint(proxy_path);
+    }
+    catch (std::exception const&) // E.g. a proxy that has been truncated: generate it again
+    {
+        return false;
+    }
+    if (proxy_fingerprint.has_value() && *proxy_fingerprint != fingerprint)
+        return false;
+    auto const* original_path = input.path();
+    if (!original_path)
+        return proxy_fingerprint.has_value();
+    auto const original_time = std::filesystem::last_write_time(*original_path, error);
+    auto const proxy_time    = std::filesystem::last_write_time(proxy_path, error);
+    return !error && proxy_time >= original_time;
+}
+
+ProxyVideoDecoder::ProxyVideoDecoder(Input const& input, AVPixelFormat pixel_format, ProxyOptions options)
+    : _demuxer{std::make_shared<Demuxer>(input, std::vector{AVMEDIA_TYPE_VIDEO})}
+    , _original{_demuxer, pixel_format}
+    , _pixel_format{pixel_format}
+    , _proxy_path{std::move(options.path)}
+{
+    AVStream const& stream      = _demuxer->stream(_demuxer->stream_index(AVMEDIA_TYPE_VIDEO).value());
+    auto const      fingerprint = source_fingerprint(input, *_demuxer);
+    if (proxy_is_up_to_date(input, _proxy_path, fingerprint))
+    {
+        try
+        {
+            open_proxy();
+            return;
+        }
+        catch (std::exception const& e) // The proxy looked fine but can't be decoded, generate it again
+        {
+            report_frame_decoding_error(std::string{"Failed to open the proxy, we will generate it again: "} + e.what());
+            _proxy.reset();
+        }
+    }
+    options.encoder.metadata[source_fingerprint_key] = fingerprint;
+    _transcoder                                      = std::make_unique<Transcoder>(
+        input, partial_proxy_path(),
+        TranscoderOptions{
+            .height  = options.height > 0 ? options.height : stream.codecpar->height / 4,
+            .encoder = options.encoder,
+        }
+    );
+}
+
+auto ProxyVideoDecoder::get_frame_at(double time_in_seconds, SeekMode seek_mode, int desired_width) -> std::optional<Frame>
+{
+    if (VideoDecoder* const proxy = proxy_if_ready())
+    {
+        bool const proxy_is_good_enough = seek_mode == SeekMode::Fast || (desired_width > 0 && desired_width <= _proxy_width);
+        if (proxy_is_good_enough)
+        {
+            auto frame = proxy->get_frame_at(time_in_seconds, SeekMode::Exact); // Every frame of the proxy is a keyframe, so exact frames are cheap. And the proxy has the same timestamps as the original (see Transcoder)
+            if (frame.has_value())
+                return frame;
+        }
+    }
+    return _original.get_frame_at(time_in_seconds, seek_mode);
+}
+
+auto ProxyVideoDecoder::proxy_if_ready() -> VideoDecoder*
+{
+    if (_proxy || !_transcoder || !_transcoder->has_decoded_all_frames())
+        return _proxy.get();
+
+    try
+    {
+        _transcoder->wait(); // Only the last few frames still need to be encoded
+        _transcoder.reset();
+        std::filesystem::rename(partial_proxy_path(), _proxy_path); // Only now that it is complete, so that we never reuse a proxy that was interrupted halfway
+        open_proxy();
+    }
+    catch (std::exception const& e)
+    {
+        report_frame_decoding_error(std::string{"Failed to generate the proxy, we will keep using the original video: "} + e.what());
+        _transcoder.reset();
+        _proxy.reset();
+        auto error = std::error_code{};
+        std::filesystem::remove(partial_proxy_path(), error);
+    }
+    return _proxy.get();
+}
+
+void ProxyVideoDecoder::open_proxy()
+{
+    auto demuxer = std::make_shared<Demuxer>(_proxy_path, std::vector{AVMEDIA_TYPE_VIDEO});
+    _proxy_width = demuxer->stream(demuxer->stream_index(AVMEDIA_TYPE_VIDEO).value()).codecpar->width;
+    _proxy       = std::make_unique<VideoDecoder>(std::move(demuxer), _pixel_format);
+}
+
+auto ProxyVideoDecoder::partial_proxy_path() const -> std::filesystem::path
+{
+    auto path = _proxy_path;
+    path.replace_filename(_proxy_path.stem().string() + ".part" + _proxy_path.extension().string()); // Keep the extension, since it tells FFmpeg which container to use
+    return path;
+}
+
+} // namespace ffmpeg
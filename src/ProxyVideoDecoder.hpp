@@ -0,0 +1,73 @@
+#pragma once
+extern "C"
+{
+#include <libavutil/pixfmt.h>
+}
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include "Frame.hpp"
+#include "Input.hpp"
+#include "Transcoder.hpp"
+#include "VideoDecoder.hpp"
+#include "VideoEncoder.hpp"
+
+namespace ffmpeg {
+
+struct ProxyOptions {
+    std::filesystem::path path{};          /// Where the proxy is stored. If it already exists (and has been generated from the same original, after its last modification) it is reused, otherwise it is generated in the background. The container is deduced from the extension (".mkv" can store any codec, and keeps the fingerprint of the original that we use to check that the proxy matches it).
+    int                   height{0};       /// Height of the proxy. 0 means a quarter of the height of the original. The width is deduced from the aspect ratio.
+    VideoEncoderOptions   encoder{         /// MJPEG is intra-only, so every frame of the proxy can be decoded on its own and seeking is instantaneous. For an all-intra H.264 proxy, use {.codec = "libx264", .keyframes_interval = 1}
+          .codec                = "mjpeg",
+          .bit_rate             = 20'000'000,
+          .encoded_pixel_format = AV_PIX_FMT_YUVJ420P,
+    };
+};
+
+/// A VideoDecoder that generates a low-resolution, intra-only copy of the video in the background (the proxy), and then uses it whenever a low-resolution frame is good enough.
+/// This makes scrubbing through huge videos (e.g. 8K footage) fluid, while still giving you the original frames when you need them.
+/// While the proxy is being generated, all the frames come from the original video.
+class ProxyVideoDecoder {
+public:
+    /// Throws a `std::runtime_error` if the creation fails (file not found / invalid video file / format not supported, etc.)
+    /// `input` can be a path to a file, a buffer in memory, or your own DataSource.
+    /// `pixel_format` is the format of the frames you will receive, both from the original and from the proxy.
+    ProxyVideoDecoder(Input const& input, AVPixelFormat pixel_format, ProxyOptions options);
+    ~ProxyVideoDecoder()                                               = default;
+    ProxyVideoDecoder(ProxyVideoDecoder const&)                        = delete; ///
+    auto operator=(ProxyVideoDecoder const&) -> ProxyVideoDecoder&     = delete; /// Not allowed to copy nor move the class (because the VideoDecoder spawns a thread with a reference to itself)
+    ProxyVideoDecoder(ProxyVideoDecoder&&) noexcept                    = delete; /// If you need to move it then heap-allocate it, typically in a std::unique_ptr
+    auto operator=(ProxyVideoDecoder&&) noexcept -> ProxyVideoDecoder& = delete; ///
+
+    /// Once the proxy is ready, the frame comes from the proxy when `seek_mode` is SeekMode::Fast (we are scrubbing), or when the frame will be displayed at a size that the proxy can fill (`desired_width` > 0 and smaller than the width of the proxy).
+    /// Otherwise it comes from the original video. Check the size of the returned frame to know which one you got.
+    /// The proxy is intra-only, so the frames it gives are always the exact requested ones, even with SeekMode::Fast.
+    /// The returned frame will be valid until the next call to get_frame_at() (or until the ProxyVideoDecoder is destroyed)
+    auto get_frame_at(double time_in_seconds, SeekMode seek_mode, int desired_width = 0) -> std::optional<Frame>;
+
+    /// True once the proxy has been generated, and will be used by get_frame_at().
+    [[nodiscard]] auto is_proxy_ready() -> bool { return proxy_if_ready() != nullptr; }
+
+    /// Total duration of the video.
+    [[nodiscard]] auto duration_in_seconds() const -> double { return _original.duration_in_seconds(); }
+
+    /// The decoder of the original video, if you need something that only it provides.
+    [[nodiscard]] auto original() -> VideoDecoder& { return _original; }
+
+private:
+    /// Returns nullptr while the proxy is not ready. Opens it the first time it is called once the proxy has been generated.
+    [[nodiscard]] auto proxy_if_ready() -> VideoDecoder*;
+    void               open_proxy();
+    [[nodiscard]] auto partial_proxy_path() const -> std::filesystem::path;
+
+private:
+    std::shared_ptr<Demuxer>      _demuxer;
+    VideoDecoder                  _original;
+    AVPixelFormat                 _pixel_format;
+    std::filesystem::path         _proxy_path;
+    std::unique_ptr<Transcoder>   _transcoder{}; // Generates the proxy. nullptr once it is done
+    std::unique_ptr<VideoDecoder> _proxy{};
+    int                           _proxy_width{};
+};
+
+} // namespace ffmpeg
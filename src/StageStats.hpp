@@ -0,0 +1,97 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace ffmpeg {
+
+/// Throughput of one stage of a multi-threaded pipeline (decoding, conversion, encoding, etc.)
+struct StageStats {
+    uint64_t frames_count{};         /// Frames that went through the stage so far (packets, for the muxing stage)
+    double   busy_time_in_seconds{}; /// Time spent working on them, not counting the time spent waiting for the other stages
+
+    /// Frames per second that the stage could sustain if it never had to wait for the other ones. The stage with the lowest throughput is the bottleneck of the pipeline.
+    [[nodiscard]] auto throughput() const -> double { return busy_time_in_seconds > 0. ? static_cast<double>(frames_count) / busy_time_in_seconds : 0.; }
+};
+
+/// Accumulates the StageStats of one stage. Written by the thread of that stage, and can be read from any thread.
+class StageStatsCounter {
+public:
+    void add(std::chrono::steady_clock::duration busy_time, uint64_t frames_count = 1)
+    {
+        _busy_time.fetch_add(busy_time.count(), std::memory_order_relaxed);
+        _frames_count.fetch_add(frames_count, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] auto get() const -> StageStats
+    {
+        return {
+            .frames_count         = _frames_count.load(std::memory_order_relaxed),
+            .busy_time_in_seconds = std::chrono::duration<double>{std::chrono::steady_clock::duration{_busy_time.load(std::memory_order_relaxed)}}.count(),
+        };
+    }
+
+private:
+    std::atomic<uint64_t>                       _frames_count{0};
+    std::atomic<std::chrono::steady_clock::rep> _busy_time{0}; // In ticks of the steady_clock
+};
+
+/// Distribution of durations (e.g. the time to decode each frame), to see the outliers that an average hides.
+/// Bucket `i` counts the durations between 2^(i-1) and 2^i microseconds (bucket 0 counts the ones under 1 microsecond, and the last bucket also counts all the longer ones).
+struct DurationHistogram {
+    static constexpr size_t buckets_count{24}; // The last bucket starts at ~4 seconds
+
+    std::array<uint64_t, buckets_count> counts{};
+
+    [[nodiscard]] static auto bucket_upper_bound_in_seconds(size_t bucket) -> double { return static_cast<double>(uint64_t{1} << bucket) / 1'000'000.; }
+
+    [[nodiscard]] auto total_count() const -> uint64_t
+    {
+        uint64_t total{0};
+        for (uint64_t const count : counts)
+            total += count;
+        return total;
+    }
+
+    /// Upper bound of the bucket that contains the given percentile (between 0 and 1), e.g. 0.99 for the duration that 99% of the measures don't exceed.
+    [[nodiscard]] auto percentile_in_seconds(double percentile) const -> double
+    {
+        auto const threshold = static_cast<uint64_t>(percentile * static_cast<double>(total_count()));
+        uint64_t   cumulated{0};
+        for (size_t bucket = 0; bucket < buckets_count; ++bucket)
+        {
+            cumulated += counts[bucket];
+            if (cumulated > threshold)
+                return bucket_upper_bound_in_seconds(bucket);
+        }
+        return 0.;
+    }
+};
+
+/// Accumulates a DurationHistogram. Written by one or several threads, and can be read from any thread.
+class DurationHistogramCounter {
+public:
+    void add(std::chrono::steady_clock::duration duration)
+    {
+        auto const microseconds = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+        auto const bucket       = microseconds > 0 ? std::min<size_t>(static_cast<size_t>(std::bit_width(static_cast<uint64_t>(microseconds))), DurationHistogram::buckets_count - 1) : size_t{0};
+        _counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] auto get() const -> DurationHistogram
+    {
+        auto histogram = DurationHistogram{};
+        for (size_t bucket = 0; bucket < DurationHistogram::buckets_count; ++bucket)
+            histogram.counts[bucket] = _counts[bucket].load(std::memory_order_relaxed);
+        return histogram;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, DurationHistogram::buckets_count> _counts{};
+};
+
+} // namespace ffmpeg
@@ -0,0 +1,98 @@
+#include "Trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <ios>
+#include <utility>
+#include "utils.hpp"
+
+namespace ffmpeg {
+
+static auto trace_sink() -> std::shared_ptr<TraceSink>&
+{
+    static std::shared_ptr<TraceSink> instance{};
+    return instance;
+}
+static auto trace_sink_mutex() -> std::mutex& // Need to lock since the decoders send events from many threads
+{
+    static std::mutex instance{};
+    return instance;
+}
+static auto is_tracing() -> std::atomic<bool>& // So that we don't need to lock the mutex when tracing is off
+{
+    static std::atomic<bool> instance{false};
+    return instance;
+}
+
+void set_trace_sink(std::shared_ptr<TraceSink> sink)
+{
+    std::unique_lock lock{trace_sink_mutex()};
+    is_tracing().store(sink != nullptr);
+    trace_sink() = std::move(sink);
+}
+
+TraceScope::TraceScope(char const* category, char const* name)
+    : _category{category}
+    , _name{name}
+{
+    if (is_tracing().load(std::memory_order_relaxed))
+        _start = std::chrono::steady_clock::now();
+}
+
+TraceScope::~TraceScope()
+{
+    if (!_start.has_value())
+        return;
+    auto const end  = std::chrono::steady_clock::now();
+    auto const sink = [&]() { // IIFE
+        std::unique_lock lock{trace_sink_mutex()};
+        return trace_sink(); // Copy the shared_ptr, so that the sink stays alive even if it is replaced while we use it
+    }();
+    if (!sink)
+        return;
+    sink->on_event({
+        .category  = _category,
+        .name      = _name,
+        .start     = *_start,
+        .duration  = end - *_start,
+        .thread_id = std::this_thread::get_id(),
+    });
+}
+
+ChromeTraceWriter::ChromeTraceWriter(std::filesystem::path const& path)
+    : _file{path}
+{
+    if (!_file.is_open())
+        throw_error("Failed to create trace file \"" + path.string() + "\"");
+    _file << std::fixed;
+    _file.precision(3); // Timestamps are in microseconds, this gives us nanoseconds
+    _file << "{\"traceEvents\":[";
+}
+
+ChromeTraceWriter::~ChromeTraceWriter()
+{
+    _file << "\n]}\n";
+}
+
+void ChromeTraceWriter::on_event(TraceEvent const& event)
+{
+    using microseconds = std::chrono::duration<double, std::micro>;
+
+    // Events that started before we were created (e.g. a wait that was already in progress) would have a negative timestamp, only keep the part after our creation
+    auto const end   = event.start + event.duration;
+    auto const start = std::max(event.start, _origin);
+    if (end < start)
+        return;
+
+    std::unique_lock lock{_mutex};
+    auto const       thread_id = _threads_ids.try_emplace(event.thread_id, static_cast<int>(_threads_ids.size() + 1)).first->second;
+    _file << (_has_written_an_event ? ",\n" : "\n")
+          << R"({"name":")" << event.name
+          << R"(","cat":")" << event.category
+          << R"(","ph":"X","ts":)" << microseconds{start - _origin}.count()
+          << R"(,"dur":)" << microseconds{end - start}.count()
+          << R"(,"pid":1,"tid":)" << thread_id
+          << "}";
+    _has_written_an_event = true;
+}
+
+} // namespace ffmpeg
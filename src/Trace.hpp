@@ -0,0 +1,84 @@
+#pragma once
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+
+namespace ffmpeg {
+
+/// A span of time during which one of the threads of a decoder was doing something (reading a packet, decoding, converting a frame, waiting for another thread, etc.)
+struct TraceEvent {
+    char const*                           category{}; /// Always a string literal, so you can keep the pointer
+    char const*                           name{};     /// Always a string literal, so you can keep the pointer
+    std::chrono::steady_clock::time_point start{};
+    std::chrono::steady_clock::duration   duration{};
+    std::thread::id                       thread_id{};
+};
+
+/// Receives the trace events, that you can use to draw a timeline of what the decoders are doing (typically to diagnose stutter).
+/// NB: it is called from all the threads of all the decoders, so your implementation must be thread-safe. And it should be fast, since it slows down the work that is being traced.
+class TraceSink {
+public:
+    TraceSink()                                    = default;
+    virtual ~TraceSink()                           = default;
+    TraceSink(TraceSink const&)                    = delete;
+    auto operator=(TraceSink const&) -> TraceSink& = delete;
+    TraceSink(TraceSink&&)                         = delete;
+    auto operator=(TraceSink&&) -> TraceSink&      = delete;
+
+    /// Called once the traced work is done, on the thread that did it.
+    virtual void on_event(TraceEvent const&) = 0;
+};
+
+/// Starts sending the trace events of all the decoders to `sink`. Pass nullptr to stop tracing.
+/// Tracing is off by default, and then it only costs the check of an atomic flag for each traced operation.
+void set_trace_sink(std::shared_ptr<TraceSink>);
+
+/// Measures the time spent in the scope it lives in, and sends it to the trace sink (if there is one).
+class TraceScope {
+public:
+    /// `category` and `name` must be string literals
+    TraceScope(char const* category, char const* name);
+    ~TraceScope();
+    TraceScope(TraceScope const&)                    = delete;
+    auto operator=(TraceScope const&) -> TraceScope& = delete;
+    TraceScope(TraceScope&&)                         = delete;
+    auto operator=(TraceScope&&) -> TraceScope&      = delete;
+
+private:
+    char const*                                          _category;
+    char const*                                          _name;
+    std::optional<std::chrono::steady_clock::time_point> _start{}; // nullopt when tracing is off
+};
+
+/// Writes the events in the Chrome trace format (JSON), that you can open with https://ui.perfetto.dev or chrome://tracing, offline.
+/// Usage:
+///     auto trace = std::make_shared<ffmpeg::ChromeTraceWriter>("trace.json");
+///     ffmpeg::set_trace_sink(trace);
+///     // Play / scrub the video
+///     ffmpeg::set_trace_sink(nullptr); // The file is complete once the writer is destroyed
+class ChromeTraceWriter : public TraceSink {
+public:
+    /// Throws a `std::runtime_error` if the file cannot be created.
+    explicit ChromeTraceWriter(std::filesystem::path const& path);
+    ~ChromeTraceWriter() override;
+    ChromeTraceWriter(ChromeTraceWriter const&)                        = delete;
+    auto operator=(ChromeTraceWriter const&) -> ChromeTraceWriter&     = delete;
+    ChromeTraceWriter(ChromeTraceWriter&&) noexcept                    = delete;
+    auto operator=(ChromeTraceWriter&&) noexcept -> ChromeTraceWriter& = delete;
+
+    void on_event(TraceEvent const&) override;
+
+private:
+    std::mutex                               _mutex{};
+    std::ofstream                            _file{};
+    std::chrono::steady_clock::time_point    _origin{std::chrono::steady_clock::now()}; // The timestamps of the trace are relative to it
+    std::unordered_map<std::thread::id, int> _threads_ids{};                            // The format needs integers
+    bool                                     _has_written_an_event{false};
+};
+
+} // namespace ffmpeg
@@ -0,0 +1,194 @@
+#include "Transcoder.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include "Demuxer.hpp"
+#include "PacketsQueue.hpp"
+#include "utils.hpp"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+namespace ffmpeg {
+
+static auto output_size(AVCodecParameters const& params, TranscoderOptions const& options) -> std::pair<int, int>
+{
+    auto const even = [](double size) { // Most encoders need an even size, because of the chroma subsampling of YUV 4:2:0
+        return std::max(2, 2 * static_cast<int>(std::lround(size / 2.)));
+    };
+    auto const aspect_ratio = static_cast<double>(params.width) / static_cast<double>(params.height);
+
+    if (options.width <= 0 && options.height <= 0)
+        return {params.width, params.height};
+    if (options.width <= 0)
+        return {even(static_cast<double>(options.height) * aspect_ratio), options.height};
+    if (options.height <= 0)
+        return {options.width, even(static_cast<double>(options.width) / aspect_ratio)};
+    return {options.width, options.height};
+}
+
+static auto frames_per_second(AVStream const& stream) -> double
+{
+    for (AVRational const rate : {stream.avg_frame_rate, stream.r_frame_rate})
+    {
+        if (rate.num > 0 && rate.den > 0)
+            return av_q2d(rate);
+    }
+    return 25.; // The file doesn't tell us, use a common frame rate
+}
+
+Transcoder::Transcoder(Input const& input, std::filesystem::path const& output_path, TranscoderOptions const& options)
+    : _demuxer{std::make_unique<Demuxer>(input, std::vector{AVMEDIA_TYPE_VIDEO})} // Throws if there is no video stream
+{
+    _stream_index          = _demuxer->stream_index(AVMEDIA_TYPE_VIDEO).value();
+    AVStream const& stream = _demuxer->stream(_stream_index);
+    auto const&     params = *stream.codecpar;
+    _packets_queue         = _demuxer->take_packets(_stream_index);
+    _decoder_ctx           = open_decoder(params);
+
+    _packet = av_packet_alloc();
+    _frame  = av_frame_alloc();
+    if (!_packet || !_frame)
+        throw_error("Not enough memory to open the video file");
+
+    auto const [width, height] = output_size(params, options);
+    auto const pixel_format    = params.format >= 0 ? static_cast<AVPixelFormat>(params.format) : options.encoder.encoded_pixel_format; // We only push AVFrames, which carry their own format, so this doesn't really matter
+    _encoder                   = std::make_unique<VideoEncoder>(output_path, width, height, frames_per_second(stream), pixel_format, options.encoder);
+
+    // Once the contexts are created, we can spawn the thread that will use them and start decoding the frames
+    _decoding_thread = std::thread{&Transcoder::decoding_thread_job, std::ref(*this)};
+}
+
+Transcoder::~Transcoder()
+{
+    // Must first stop the thread, because it is using the decoder, etc.
+    _wants_to_stop_decoding_thread.store(true);
+    {
+        std::unique_lock lock{_packets_queue->mutex()}; // Make sure the thread is not between the check of its predicate and the start of its wait, otherwise it would miss the notification
+    }
+    _packets_queue->waiting_for_queue_to_fill_up().notify_all();
+    if (_decoding_thread.joinable())
+        _decoding_thread.join();
+
+    _encoder.reset(); // Encodes the frames that are already in the pipeline, and finalizes the file
+    _packets_queue.reset(); // Must be closed before destroying the Demuxer that owns it
+    _demuxer.reset();
+    avcodec_free_context(&_decoder_ctx);
+    av_packet_free(&_packet);
+    av_frame_free(&_frame);
+}
+
+void Transcoder::wait()
+{
+    if (_decoding_thread.joinable())
+        _decoding_thread.join();
+    if (_error)
+        std::rethrow_exception(_error);
+    _encoder->finish();
+}
+
+auto Transcoder::stats() const -> TranscoderStats
+{
+    auto const encoder_stats = _encoder->stats();
+    return {
+        .decoding   = _decoding_stats.get(),
+        .conversion = encoder_stats.conversion,
+        .encoding   = encoder_stats.encoding,
+        .muxing     = encoder_stats.muxing,
+    };
+}
+
+void Transcoder::decoding_thread_job(Transcoder& This)
+{
+    try
+    {
+        This.decode_all_frames();
+    }
+    catch (...)
+    {
+        This._error = std::current_exception();
+    }
+    This._has_decoded_all_frames.store(true);
+}
+
+void Transcoder::decode_all_frames()
+{
+    while (true)
+    {
+        PacketRaii packet_raii{_packet}; // Will unref the packet when exiting the scope
+
+        {
+            int const err = read_packet();
+            if (err == AVERROR_EXIT) // We are getting destroyed
+                return;
+            if (err == AVERROR_EOF)
+                break;
+            if (err < 0)
+            {
+                report_frame_decoding_error(format_error("Failed to read video packet", err));
+                continue;
+            }
+        }
+
+        { // Send the packet to the decoder
+            auto const start = std::chrono::steady_clock::now();
+            int const  err   = avcodec_send_packet(_decoder_ctx, _packet);
+            _decoding_stats.add(std::chrono::steady_clock::now() - start, 0);
+            if (err < 0)
+            {
+                report_frame_decoding_error(format_error("Error submitting a video packet for decoding", err));
+                continue;
+            }
+        }
+        receive_frames();
+    }
+
+    // Get the frames that the decoder was still holding
+    avcodec_send_packet(_decoder_ctx, nullptr);
+    receive_frames();
+}
+
+auto Transcoder::read_packet() -> int
+{
+    int err{};
+    {
+        std::unique_lock lock{_packets_queue->mutex()};
+        if (_packets_queue->is_empty_no_lock())
+            _packets_queue->count_decoder_wait_no_lock();
+        _packets_queue->waiting_for_queue_to_fill_up().wait(lock, [&]() { return !_packets_queue->is_empty_no_lock() || _wants_to_stop_decoding_thread.load(); });
+        if (_wants_to_stop_decoding_thread.load())
+            return AVERROR_EXIT;
+        err = _packets_queue->pop_no_lock(_packet);
+    }
+    _packets_queue->waiting_for_queue_to_empty_out().notify_one();
+    return err;
+}
+
+void Transcoder::receive_frames()
+{
+    while (!_wants_to_stop_decoding_thread.load())
+    {
+        auto const start = std::chrono::steady_clock::now();
+        int const  err   = avcodec_receive_frame(_decoder_ctx, _frame);
+        _decoding_stats.add(std::chrono::steady_clock::now() - start, err >= 0 ? 1 : 0);
+        if (err == AVERROR(EAGAIN) || err == AVERROR_EOF) // The decoder needs more packets, or has been fully flushed
+            return;
+        if (err < 0)
+        {
+            report_frame_decoding_error(format_error("Error while decoding the video", err));
+            return;
+        }
+
+        _frame->time_base = _demuxer->stream(_stream_index).time_base; // So that the encoder keeps the timestamps of the frame
+        _encoder->push_frame(*_frame);                                  // Blocks while the pipeline is full, which is what slows us down to the speed of the slowest stage
+        av_frame_unref(_frame);
+    }
+}
+
+} // namespace ffmpeg
@@ -0,0 +1,89 @@
+#pragma once
+#include <atomic>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <thread>
+#include "Input.hpp"
+#include "PacketsQueue.hpp"
+#include "StageStats.hpp"
+#include "VideoEncoder.hpp"
+
+struct AVCodecContext;
+struct AVFrame;
+struct AVPacket;
+
+namespace ffmpeg {
+
+class Demuxer;
+
+struct TranscoderOptions {
+    int                 width{0};  /// Size of the output video. 0 for both keeps the size of the input, 0 for only one of them computes it from the other one so that the aspect ratio is preserved.
+    int                 height{0}; ///
+    VideoEncoderOptions encoder{}; /// Codec, quality, pixel format, etc. of the output video. `max_frames_in_queue` bounds each queue of the pipeline.
+};
+
+struct TranscoderStats {
+    StageStats decoding{};
+    StageStats conversion{}; /// Scaling and pixel format conversion
+    StageStats encoding{};
+    StageStats muxing{}; /// Counts packets, not frames
+};
+
+/// Decodes the video stream of a file and re-encodes it into a new file, optionally resized (typically to generate a low-resolution proxy of a video).
+/// Each step runs on its own thread, connected to the next one by a bounded queue:
+///     demuxing -> decoding -> scaling / conversion -> encoding -> muxing
+/// so the whole pipeline goes as fast as its slowest stage, and memory usage stays bounded whatever the length of the video. The frames and buffers are recycled, so nothing gets allocated per frame once the pipeline is running.
+/// The frames keep their timestamps, rounded to the frame rate of the output (the average frame rate of the input), so the same time shows the same frame in the input and in the output.
+/// Usage:
+///     auto transcoder = ffmpeg::Transcoder{"input.mp4", "proxy.mp4", {.height = 540, .encoder = {.codec = "libx264", .preset = "ultrafast"}}};
+///     transcoder.wait(); // Throws if anything went wrong
+///     auto const stats = transcoder.stats(); // Tells you which stage is the bottleneck
+class Transcoder {
+public:
+    /// Starts transcoding right away, in the background.
+    /// Throws a `std::runtime_error` if the creation fails (file not found / no video stream / codec not available, etc.)
+    /// `input` can be a path to a file, a buffer in memory, or your own DataSource.
+    Transcoder(Input const& input, std::filesystem::path const& output_path, TranscoderOptions const& options = {});
+    /// Stops as soon as possible if the transcoding isn't done yet (the output file is then incomplete).
+    ~Transcoder();
+    Transcoder(Transcoder const&)                        = delete; ///
+    auto operator=(Transcoder const&) -> Transcoder&     = delete; /// Not allowed to copy nor move the class (because we spawn a thread with a reference to this object)
+    Transcoder(Transcoder&&) noexcept                    = delete; /// If you need to move it then heap-allocate it, typically in a std::unique_ptr
+    auto operator=(Transcoder&&) noexcept -> Transcoder& = delete; ///
+
+    /// Blocks until the whole video has been transcoded and the output file has been finalized.
+    /// Throws if an error occurred on one of the threads.
+    void wait();
+    /// True once all the frames have been decoded and given to the encoder (or if transcoding failed). wait() will then only have to wait for the last few frames to be encoded.
+    [[nodiscard]] auto has_decoded_all_frames() const -> bool { return _has_decoded_all_frames.load(); }
+
+    /// How fast each stage of the pipeline is going. Can be called from any thread, while the video is being transcoded.
+    [[nodiscard]] auto stats() const -> TranscoderStats;
+
+private:
+    static void decoding_thread_job(Transcoder& This);
+    void        decode_all_frames();
+    /// Pops the next packet into _packet, and returns the error that came with it. Returns AVERROR_EXIT if we are getting destroyed.
+    [[nodiscard]] auto read_packet() -> int;
+    /// Gives all the frames that the decoder has ready to the encoder
+    void               receive_frames();
+
+private:
+    std::unique_ptr<Demuxer>      _demuxer;
+    TakenPacketsQueue             _packets_queue{}; // Owned by the demuxer
+    AVCodecContext*               _decoder_ctx{};
+    AVPacket*                     _packet{};
+    AVFrame*                      _frame{}; // The decoder gives us a reference to one of its buffers, the encoder takes its own reference to it, and we release ours right away
+    int                           _stream_index{};
+    std::unique_ptr<VideoEncoder> _encoder{};
+    StageStatsCounter             _decoding_stats{};
+
+    // Thread
+    std::thread        _decoding_thread{};
+    std::atomic<bool>  _wants_to_stop_decoding_thread{false};
+    std::atomic<bool>  _has_decoded_all_frames{false};
+    std::exception_ptr _error{}; // Set by the decoding thread, read once it has been joined
+};
+
+} // namespace ffmpeg
@@ -1,13 +1,18 @@
 #include "VideoDecoder.hpp"
 #include <algorithm>
-#include <array>
 #include <cassert>
+#include <chrono>
+#include <cmath>
 #include <cstddef>
 #include <exception>
+#include <limits>
 #include <mutex>
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include "../include/easy_ffmpeg/callbacks.hpp"
+#include "Trace.hpp"
+#include "utils.hpp"
 
 extern "C"
 {
@@ -55,33 +60,17 @@ void set_frame_decoding_error_callback(std::function<void(std::string const&)> c
     frame_decoding_error_callback() = std::move(callback);
 }
 
-static auto format_error(std::string message, int err) -> std::string
+void report_frame_decoding_error(std::string const& error_message)
 {
-    assert(err < 0);
-    auto err_str_buffer = std::array<char, AV_ERROR_MAX_STRING_SIZE>{};
-    av_strerror(err, err_str_buffer.data(), err_str_buffer.size());
-    message += ":\n";
-    message += err_str_buffer.data();
-    return message;
-}
-
-static void throw_error(std::string const& message)
-{
-    throw std::runtime_error(message);
-}
-
-static void throw_error(std::string const& message, int err)
-{
-    throw_error(format_error(message, err));
+    std::unique_lock lock{frame_decoding_error_callback_mutex()};
+    frame_decoding_error_callback()(error_message);
 }
 
 void VideoDecoder::log_frame_decoding_error(std::string const& error_message)
 {
-    {
-        std::unique_lock lock{frame_decoding_error_callback_mutex()};
-        frame_decoding_error_callback()(error_message);
-    }
+    report_frame_decoding_error(error_message);
     _error_count.fetch_add(1);
+    _total_errors_count.fetch_add(1, std::memory_order_relaxed);
 }
 
 void VideoDecoder::log_frame_decoding_error(std::string const& error_message, int err)
@@ -89,90 +78,35 @@ void VideoDecoder::log_frame_decoding_error(std::string const& error_message, in
     log_frame_decoding_error(format_error(error_message, err));
 }
 
-static auto tmp_string_for_detailed_info() -> std::string&
+static auto make_demuxer(Input const& input, std::optional<int> stream_index) -> std::shared_ptr<Demuxer>
 {
-    thread_local auto instance = std::string{};
-    return instance;
+    if (stream_index.has_value())
+        return std::make_shared<Demuxer>(input, std::vector{*stream_index});
+    return std::make_shared<Demuxer>(input, std::vector{AVMEDIA_TYPE_VIDEO});
 }
 
-auto VideoDecoder::retrieve_detailed_info() const -> std::string
-{
-    tmp_string_for_detailed_info() = "";
-    // We need to redirect ffmpeg's logging to our own string
-    av_log_set_callback([](void*, int, const char* fmt, va_list vl) {
-        va_list vl2; // NOLINT(*init-variables)
-        va_copy(vl2, vl);
-        auto const length = static_cast<size_t>(vsnprintf(nullptr, 0, fmt, vl));
-        va_end(vl);
-        std::vector<char> buffer(length + 1);
-        vsnprintf(buffer.data(), length + 1, fmt, vl2); // NOLINT(cert-err33-c)
-        va_end(vl2);
-        tmp_string_for_detailed_info() += std::string{buffer.data()};
-    });
-    av_dump_format(_format_ctx, _video_stream_idx, "", false /*is_output*/);
-    av_log_set_callback(&av_log_default_callback);
-    return tmp_string_for_detailed_info();
-}
+VideoDecoder::VideoDecoder(Input const& input, AVPixelFormat pixel_format, std::optional<int> stream_index)
+    : VideoDecoder{make_demuxer(input, stream_index), pixel_format, stream_index}
+{}
 
-VideoDecoder::VideoDecoder(std::filesystem::path const& path, AVPixelFormat pixel_format)
+VideoDecoder::VideoDecoder(std::shared_ptr<Demuxer> demuxer, AVPixelFormat pixel_format, std::optional<int> stream_index)
+    : _demuxer{std::move(demuxer)}
 {
-    {
-        int const err = avformat_open_input(&_format_ctx, path.string().c_str(), nullptr, nullptr);
-        if (err < 0)
-            throw_error("Could not open file. Make sure the path is valid and is an actual video file", err);
-    }
-    {
-        int const err = avformat_open_input(&_format_ctx_to_test_seeking, path.string().c_str(), nullptr, nullptr);
-        if (err < 0)
-            throw_error("Could not open file. Make sure the path is valid and is an actual video file", err);
-    }
-
-    {
-        int const err = avformat_find_stream_info(_format_ctx, nullptr);
-        if (err < 0)
-            throw_error("Could not find stream information. Your file is most likely corrupted or not a valid video file", err);
-    }
-    {
-        int const err = avformat_find_stream_info(_format_ctx_to_test_seeking, nullptr);
-        if (err < 0)
-            throw_error("Could not find stream information. Your file is most likely corrupted or not a valid video file", err);
-    }
-
-    {
-        int const err = av_find_best_stream(_format_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
-        if (err < 0)
-            throw_error("Could not find video stream. Make sure your file is a video file and not an audio file", err);
-
-        _video_stream_idx = err;
-    }
+    if (!stream_index.has_value())
+        stream_index = _demuxer->stream_index(AVMEDIA_TYPE_VIDEO);
+    if (!stream_index.has_value())
+        throw_error("Could not find video stream. Make sure your file is a video file and not an audio file");
+    if (_demuxer->stream(*stream_index).codecpar->codec_type != AVMEDIA_TYPE_VIDEO)
+        throw_error("Stream " + std::to_string(*stream_index) + " is not a video stream");
+    _video_stream_idx           = *stream_index;
+    _packets_queue              = _demuxer->take_packets(_video_stream_idx);
+    _packets_serial             = _packets_queue->serial();
+    _format_ctx_to_test_seeking = open_format_context(_demuxer->input());
+    if (auto const* data_source = _demuxer->input().data_source())
+        _data_source = *data_source;
 
     auto const& params = *video_stream().codecpar;
-
-    AVCodec const* decoder = avcodec_find_decoder(params.codec_id);
-    if (!decoder)
-    {
-        auto const* desc = avcodec_descriptor_get(params.codec_id);
-        throw_error("Codec \"" + std::string{desc ? desc->name : "Unknown"} + "\" is not supported (" + std::string{desc ? desc->long_name : "Unknown"} + ")");
-    }
-
-    _decoder_ctx = avcodec_alloc_context3(decoder);
-    if (!_decoder_ctx)
-        throw_error("Not enough memory to open the video file");
-
-    {
-        int const err = avcodec_parameters_to_context(_decoder_ctx, &params);
-        if (err < 0)
-            throw_error("Failed to copy codec parameters to decoder context", err);
-    }
-
-    {
-        int const err = avcodec_open2(_decoder_ctx, decoder, nullptr);
-        if (err < 0)
-        {
-            auto const* desc = avcodec_descriptor_get(params.codec_id);
-            throw_error("Failed to open codec \"" + std::string{desc ? desc->name : "Unknown"} + "\" (" + std::string{desc ? desc->long_name : "Unknown"} + ")", err);
-        }
-    }
+    _decoder_ctx       = open_decoder(params);
 
     _desired_color_space_frame = av_frame_alloc();
     _packet                    = av_packet_alloc();
@@ -200,9 +134,7 @@ VideoDecoder::VideoDecoder(std::filesystem::path const& path, AVPixelFormat pixe
             throw_error("Failed to setup image arrays", err);
     }
 
-    _detailed_info = retrieve_detailed_info();
-
-    // Once the context is created, we can spawn the thread that will use this context and start decoding the frames
+    // Once the contexts are created, we can spawn the thread that will use them and start decoding the frames
     _video_decoding_thread = std::thread{&VideoDecoder::video_decoding_thread_job, std::ref(*this)};
 }
 
@@ -219,17 +151,23 @@ VideoDecoder::FramesQueue::FramesQueue()
 
 VideoDecoder::~VideoDecoder()
 {
-    // Must first stop the decoding thread, because it might be reading from the context, etc.
+    // Must first stop the thread, because it might be reading from the contexts, etc.
     _wants_to_stop_video_decoding_thread.store(true);
+    {
+        std::unique_lock lock{_frames_queue.mutex()}; // Make sure the thread is not between the check of its predicate and the start of its wait, otherwise it would miss the notification
+    }
     _frames_queue.waiting_for_queue_to_empty_out().notify_all();
     _frames_queue.waiting_for_queue_to_fill_up().notify_all();
+    {
+        std::unique_lock lock{_packets_queue->mutex()}; // Make sure the thread is not between the check of its predicate and the start of its wait, otherwise it would miss the notification
+    }
+    _packets_queue->waiting_for_queue_to_fill_up().notify_all();
     _video_decoding_thread.join();
 
     if (_decoder_ctx)
         avcodec_send_packet(_decoder_ctx, nullptr); // Flush the decoder
     avcodec_free_context(&_decoder_ctx);
-    avformat_close_input(&_format_ctx);
-    avformat_close_input(&_format_ctx_to_test_seeking);
+    close_format_context(_format_ctx_to_test_seeking);
     av_packet_free(&_packet);
     av_packet_free(&_packet_to_test_seeking);
 
@@ -267,6 +205,11 @@ auto VideoDecoder::FramesQueue::size_no_lock() -> size_t
 auto VideoDecoder::FramesQueue::is_full() -> bool
 {
     std::unique_lock lock{_mutex};
+    return is_full_no_lock();
+}
+
+auto VideoDecoder::FramesQueue::is_full_no_lock() -> bool
+{
     return _dead_frames.empty();
 }
 
@@ -332,23 +275,191 @@ void VideoDecoder::FramesQueue::clear()
     _waiting_for_pop.notify_one();
 }
 
+VideoDecoder::RecentPackets::~RecentPackets()
+{
+    clear();
+}
+
+/// Exponential moving average, so that the estimations follow the changes in the content of the video (and in the load of the machine). 0 means that we don't have any measure yet.
+static auto moving_average(double average, double value) -> double
+{
+    return average == 0. ? value : average + 0.1 * (value - average);
+}
+
+static auto packet_timestamp(AVPacket const& packet) -> int64_t
+{
+    return packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts;
+}
+
+static auto is_keyframe(AVPacket const& packet) -> bool
+{
+    return (packet.flags & AV_PKT_FLAG_KEY) != 0; // NOLINT(*signed-bitwise)
+}
+
+void VideoDecoder::RecentPackets::add(AVPacket const& packet)
+{
+    if (_packets.empty() && !is_keyframe(packet)) // We can only replay from a keyframe
+        return;
+    if (is_keyframe(packet) && _keyframes_count == max_gops_count)
+        drop_oldest_gop();
+
+    AVPacket* const reference = av_packet_clone(&packet);
+    if (!reference) // Not a big deal, we just won't be able to seek without I/O
+    {
+        clear();
+        return;
+    }
+    _packets.push_back(reference);
+    _size_in_bytes += static_cast<size_t>(reference->size);
+    if (is_keyframe(*reference))
+        _keyframes_count++;
+
+    while (_size_in_bytes > max_size_in_bytes && _keyframes_count > 1)
+        drop_oldest_gop();
+    if (_size_in_bytes > max_size_in_bytes) // A single GOP is too big to be kept in memory
+        clear();
+}
+
+void VideoDecoder::RecentPackets::drop_oldest_gop()
+{
+    do // NOLINT(*avoid-do-while)
+    {
+        _size_in_bytes -= static_cast<size_t>(_packets.front()->size);
+        av_packet_free(&_packets.front());
+        _packets.pop_front();
+    } while (!_packets.empty() && !is_keyframe(*_packets.front()));
+    _keyframes_count--;
+}
+
+void VideoDecoder::RecentPackets::clear()
+{
+    for (AVPacket*& packet : _packets)
+        av_packet_free(&packet);
+    _packets.clear();
+    _size_in_bytes           = 0;
+    _keyframes_count         = 0;
+    _has_reached_end_of_file = false;
+    _replay_position.reset();
+}
+
+auto VideoDecoder::RecentPackets::start_replay_at(int64_t timestamp) -> bool
+{
+    auto keyframe_position = std::optional<size_t>{};
+    auto last_timestamp    = std::numeric_limits<int64_t>::min(); // Not necessarily the one of the last packet, because packets are in decoding order, not presentation order
+    for (size_t i = 0; i < _packets.size(); ++i)
+    {
+        AVPacket const& packet = *_packets[i];
+        last_timestamp         = std::max(last_timestamp, packet_timestamp(packet));
+        if (is_keyframe(packet) && packet_timestamp(packet) != AV_NOPTS_VALUE && packet_timestamp(packet) <= timestamp)
+            keyframe_position = i;
+    }
+    if (!keyframe_position.has_value())
+        return false;
+    if (timestamp > last_timestamp && !_has_reached_end_of_file) // There might be a keyframe closer to the target that we haven't read yet
+        return false;
+
+    _replay_position = keyframe_position;
+    return true;
+}
+
+auto VideoDecoder::RecentPackets::replay_next(AVPacket* destination) -> std::optional<int>
+{
+    if (!_replay_position.has_value())
+        return std::nullopt;
+    if (*_replay_position < _packets.size())
+        return av_packet_ref(destination, _packets[(*_replay_position)++]);
+
+    _replay_position.reset(); // We are back to where we were before seeking, the next packets will come from the file
+    if (_has_reached_end_of_file)
+        return AVERROR_EOF;
+    return std::nullopt;
+}
+
+auto VideoDecoder::read_packet(AVPacket* packet) -> int
+{
+    if (auto const err = _recent_packets.replay_next(packet))
+        return *err;
+
+    int err{};
+    while (true)
+    {
+        bool has_been_moved_by_another_decoder{};
+        {
+            TraceScope const trace{"wait", "wait_for_packet"}; // Declared before the lock, so that the event is sent to the sink after unlocking
+            std::unique_lock lock{_packets_queue->mutex()};
+            if (_packets_queue->is_empty_no_lock())
+                _packets_queue->count_decoder_wait_no_lock();
+            auto const wait_start = std::chrono::steady_clock::now();
+            _packets_queue->waiting_for_queue_to_fill_up().wait(lock, [&]() { return !_packets_queue->is_empty_no_lock() || _wants_to_pause_decoding_thread_asap.load() || _wants_to_stop_video_decoding_thread.load() || _has_seek_request.load(); });
+            _waiting_for_packets_time.fetch_add((std::chrono::steady_clock::now() - wait_start).count(), std::memory_order_relaxed);
+            if (_packets_queue->is_empty_no_lock())
+                return AVERROR_EXIT;
+            has_been_moved_by_another_decoder = _packets_queue->serial_no_lock() != _packets_serial;
+            _packets_serial                   = _packets_queue->serial_no_lock();
+            err                               = _packets_queue->pop_no_lock(packet);
+        }
+        _packets_queue->waiting_for_queue_to_empty_out().notify_one();
+
+        if (has_been_moved_by_another_decoder) // The packet comes from the keyframe that the Demuxer seeked to, what we have in the decoder doesn't precede it anymore
+        {
+            avcodec_flush_buffers(_decoder_ctx);
+            _recent_packets.clear();
+            _is_waiting_for_keyframe = demuxer_has_other_video_streams();
+        }
+        if (err < 0 || !_is_waiting_for_keyframe)
+            break;
+        if (is_keyframe(*packet))
+        {
+            _is_waiting_for_keyframe = false;
+            break;
+        }
+        av_packet_unref(packet); // It can't be decoded without the packets that precede it
+    }
+
+    if (err >= 0)
+    {
+        _recent_packets.add(*packet);
+        record_keyframe(*packet);
+    }
+    else if (err == AVERROR_EOF)
+        _recent_packets.mark_end_of_file();
+    return err;
+}
+
 void VideoDecoder::video_decoding_thread_job(VideoDecoder& This)
 {
     // TODO if thread has filled up the queue, it can start converting frames to RGBA in the meantime, instead of doing nothing
     while (!This._wants_to_stop_video_decoding_thread.load())
     {
-        if (This._frames_queue.is_full() && This._seek_target.has_value() && This.present_time(This._frames_queue.second()) < *This._seek_target) // We are fast-seeking, don't wait for frames to be consumed, process new frames asap
-            This._frames_queue.pop();
+        This.process_seek_request();
 
-        // Pop from dead list
-        std::unique_lock lock{This._decoding_context_mutex};
-        This._frames_queue.waiting_for_queue_to_empty_out().wait(lock, [&] { return (!This._frames_queue.is_full() && !This._has_reached_end_of_file.load()) || This._wants_to_stop_video_decoding_thread.load() || This._wants_to_pause_decoding_thread_asap.load(); });
+        if (std::unique_lock seek_lock{This._seek_mutex, std::try_to_lock}; seek_lock.owns_lock()) // If we can't get it, someone is reading the queue, let them pop the frames
+        {
+            auto const seek_target = This.seek_target();
+            if (This._frames_queue.is_full() && seek_target.has_value() && This.present_time(This._frames_queue.second()) < *seek_target) // We are fast-seeking, don't wait for frames to be consumed, process new frames asap
+            {
+                This._frames_queue.pop();
+                This._frames_discarded.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        { // Wait for room in the queue. Done without holding _decoding_context_mutex, so that seek_to() doesn't need to wake us up
+            TraceScope const trace{"wait", "wait_for_room_in_frames_queue"}; // Declared before the lock, so that the event is sent to the sink after unlocking
+            std::unique_lock lock{This._frames_queue.mutex()};
+            This._frames_queue.waiting_for_queue_to_empty_out().wait(lock, [&] { return (!This._frames_queue.is_full_no_lock() && !This._has_reached_end_of_file.load()) || This._wants_to_stop_video_decoding_thread.load() || This._wants_to_pause_decoding_thread_asap.load() || This._has_seek_request.load(); });
+        }
         if (This._wants_to_stop_video_decoding_thread.load()) // Thread has been woken up because it is getting destroyed, exit asap
             break;
-        if (This._wants_to_pause_decoding_thread_asap.load())
+        if (This._wants_to_pause_decoding_thread_asap.load() || This._has_seek_request.load())
+            continue;
+
+        // Pop from dead list
+        std::unique_lock lock{This._decoding_context_mutex};
+        if (This._wants_to_pause_decoding_thread_asap.load() || This._frames_queue.is_full() || This._has_reached_end_of_file.load()) // seek_to() might have been called between the wait and the lock, and changed the queue
             continue;
 
-        AVFrame* const frame = This._frames_queue.get_frame_to_fill();
+        AVFrame* const frame       = This._frames_queue.get_frame_to_fill();
+        auto const     seek_target = This.seek_target(); // Taken while holding _decoding_context_mutex, so that seek_to() can't change it under our feet. try_get_frame_from_queue() might still reset it, but the frames we decode after that are not before the target anyways
 
         if (This._wants_to_stop_video_decoding_thread.load())
             break;
@@ -359,13 +470,16 @@ void VideoDecoder::video_decoding_thread_job(VideoDecoder& This)
         bool const frame_is_valid = [&]() { // IIFE
             try
             {
-                return This.decode_next_frame_into(frame);
+                return This.decode_next_frame_into(frame, seek_target);
             }
             catch (std::exception const& e)
             {
                 This.log_frame_decoding_error(e.what());
                 if (This.too_many_errors())
+                {
                     This._frames_queue.waiting_for_queue_to_fill_up().notify_one();
+                    This.notify_frame_waiters();
+                }
                 return false;
             }
         }();
@@ -375,9 +489,17 @@ void VideoDecoder::video_decoding_thread_job(VideoDecoder& This)
         if (!frame_is_valid || This._wants_to_pause_decoding_thread_asap.load())
             continue;
 
+        if (frame->pts != AV_NOPTS_VALUE && This.is_far_before(This.present_time(*frame), seek_target) && !This._frames_queue.is_empty()) // The frame would be popped before anyone looks at it, don't bother pushing it and waking up the waiters. (When the queue is empty we still push it, so that SeekMode::Fast has something to show while we catch up)
+        {
+            av_frame_unref(frame);
+            This._frames_discarded.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
         // Push to alive list
         This._frames_queue.push(frame);
-        if (This._seek_target.has_value())
+        This.notify_frame_waiters();
+        if (This._is_fast_seeking.load())
         {
             std::unique_lock lock2{fast_seeking_callback_mutex()};
             fast_seeking_callback()();
@@ -387,7 +509,149 @@ void VideoDecoder::video_decoding_thread_job(VideoDecoder& This)
 
 auto VideoDecoder::get_frame_at(double time_in_seconds, SeekMode seek_mode) -> std::optional<Frame>
 {
-    AVFrame const* frame_in_wrong_colorspace = get_frame_at_impl(time_in_seconds, seek_mode);
+    auto const start = std::chrono::steady_clock::now();
+    auto       frame = get_frame_at_impl(time_in_seconds, seek_mode);
+    _get_frame_time_histogram.add(std::chrono::steady_clock::now() - start);
+    return frame;
+}
+
+auto VideoDecoder::stats() -> VideoDecoderStats
+{
+    auto const seconds = [](std::atomic<std::chrono::steady_clock::rep> const& ticks) {
+        return std::chrono::duration<double>{std::chrono::steady_clock::duration{ticks.load(std::memory_order_relaxed)}}.count();
+    };
+    return {
+        .decoding                       = _decoding_stats.get(),
+        .conversion                     = _conversion_stats.get(),
+        .demuxer                        = _demuxer->stats(),
+        .decoding_time_histogram        = _decoding_time_histogram.get(),
+        .get_frame_time_histogram       = _get_frame_time_histogram.get(),
+        .waiting_for_packets_in_seconds = seconds(_waiting_for_packets_time),
+        .waiting_for_frames_in_seconds  = seconds(_waiting_for_frames_time),
+        .frames_returned                = _frames_returned.load(std::memory_order_relaxed),
+        .frames_discarded               = _frames_discarded.load(std::memory_order_relaxed),
+        .backward_seeks                 = _backward_seeks.load(std::memory_order_relaxed),
+        .forward_seeks                  = _forward_seeks.load(std::memory_order_relaxed),
+        .seeks_replayed_from_memory     = _seeks_replayed_from_memory.load(std::memory_order_relaxed),
+        .errors_count                   = _total_errors_count.load(std::memory_order_relaxed),
+        .frames_in_queue                = _frames_queue.size(),
+        .packets_queue                  = _packets_queue->stats(),
+    };
+}
+
+auto VideoDecoder::async_get_frame_at(double time_in_seconds, SeekMode seek_mode, Executor executor) -> GetFrameAwaitable
+{
+    _error_count.store(0); // Reset error count. We stop if 5 errors occur while we wait for frames.
+    return GetFrameAwaitable{*this, std::clamp(time_in_seconds, 0., duration_in_seconds()), seek_mode, std::move(executor)};
+}
+
+auto VideoDecoder::GetFrameAwaitable::try_get_frame() -> bool
+{
+    VideoDecoder&    This = *_decoder;
+    std::unique_lock lock{This._seek_mutex, std::try_to_lock};
+    if (!lock.owns_lock()) // The decoding thread is seeking, it will notify us once it is done
+        return false;
+    if (!_has_made_seek_decision)
+    {
+        if (This._frames_queue.is_empty() && !This._has_reached_end_of_file.load() && !This.too_many_errors())
+            return false; // We need at least one frame to know where the decoding thread is, before deciding whether to seek or not
+        if (This._frames_queue.is_empty()) // Can happen if there are errors while decoding frames, or if we reach the end of an empty file.
+        {
+            _frame.reset();
+            return true;
+        }
+        _has_made_seek_decision = true;
+        if (!This.post_seek_request_if_needed(_time_in_seconds, _seek_mode)) // Even in SeekMode::Exact, we let the decoding thread seek and catch up, instead of blocking this thread
+            return false;
+    }
+    else if (This._has_seek_request.load()) // The decoding thread hasn't handled our request yet, it will notify us once it is done
+    {
+        return false;
+    }
+
+    auto const frame = This.try_get_frame_from_queue(_time_in_seconds, _seek_mode);
+    if (frame.has_value())
+    {
+        _frame = This.make_frame(*frame); // Converted right away, while we hold _seek_mutex: once we release it, the decoding thread might recycle the frame
+        return true;
+    }
+    if (This._frames_queue.is_empty() && (This._has_reached_end_of_file.load() || This.too_many_errors()))
+    {
+        _frame.reset();
+        return true;
+    }
+    return false;
+}
+
+auto VideoDecoder::GetFrameAwaitable::wait_for_frame(std::coroutine_handle<> handle) -> bool
+{
+    while (true)
+    {
+        auto const generation = _decoder->_frames_generation.load();
+        if (try_get_frame())
+            return false;
+
+        std::unique_lock lock{_decoder->_frame_waiters_mutex};
+        if (generation != _decoder->_frames_generation.load()) // The decoding thread gave us a new frame while we were checking, so check again
+            continue;
+        _decoder->_frame_waiters.emplace_back([this, handle]() {
+            _executor([this, handle]() {
+                if (!wait_for_frame(handle))
+                    handle.resume();
+            });
+        });
+        return true;
+    }
+}
+
+auto VideoDecoder::GetFrameAwaitable::await_resume() -> std::optional<Frame>
+{
+    return std::move(_frame);
+}
+
+void VideoDecoder::notify_frame_waiters()
+{
+    _frames_generation.fetch_add(1);
+    auto waiters = std::vector<std::function<void()>>{};
+    {
+        std::unique_lock lock{_frame_waiters_mutex};
+        std::swap(waiters, _frame_waiters);
+    }
+    for (auto const& waiter : waiters)
+        waiter();
+}
+
+auto VideoDecoder::try_get_frame_at(double time_in_seconds) -> std::optional<ClosestFrame>
+{
+    _error_count.store(0); // Reset error count. We stop if 5 errors occur while we wait for frames.
+    time_in_seconds = std::clamp(time_in_seconds, 0., duration_in_seconds());
+
+    std::unique_lock lock{_seek_mutex, std::try_to_lock};
+    if (lock.owns_lock()) // Otherwise the decoding thread is seeking, and is about to throw away the frames in the queue
+    {
+        bool const is_on_the_way = post_seek_request_if_needed(time_in_seconds, SeekMode::Exact); // False iff the decoding thread has to decide whether to seek first, in which case the frames in the queue might not lead to the requested time
+        if (is_on_the_way)
+        {
+            auto const exact_frame = try_get_frame_from_queue(time_in_seconds, SeekMode::Exact);
+            if (exact_frame.has_value())
+                return ClosestFrame{.frame = *make_frame(*exact_frame), .is_exact = true};
+        }
+        if (!_frames_queue.is_empty() && (is_on_the_way || !_last_returned_frame.has_value())) // The closest frame that we have decoded so far
+            return ClosestFrame{.frame = *make_frame(&_frames_queue.first()), .is_exact = false};
+    }
+
+    if (_last_returned_frame.has_value())
+    {
+        auto frame                             = *_last_returned_frame;
+        frame.is_different_from_previous_frame = false;
+        return ClosestFrame{.frame = frame, .is_exact = false};
+    }
+
+    return std::nullopt;
+}
+
+auto VideoDecoder::make_frame(AVFrame const* frame_in_wrong_colorspace) -> std::optional<Frame>
+{
     if (!frame_in_wrong_colorspace)
         return std::nullopt;
     assert(frame_in_wrong_colorspace->width != 0 && frame_in_wrong_colorspace->height != 0);
@@ -395,14 +659,23 @@ auto VideoDecoder::get_frame_at(double time_in_seconds, SeekMode seek_mode) -> s
     bool const is_different_from_previous_frame = frame_in_wrong_colorspace->pts != _previous_pts;
     _previous_pts                               = frame_in_wrong_colorspace->pts;
     if (is_different_from_previous_frame)
+    {
         convert_frame_to_desired_color_space(*frame_in_wrong_colorspace);
-    return Frame{
+        _frames_returned.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (!_has_seeked_since_last_frame) // We reached this frame by decoding forward, so we are most likely playing the video
+        hint_access_pattern(AccessPattern::Sequential);
+    _has_seeked_since_last_frame = false;
+    _last_returned_frame         = Frame{
         .data                             = _desired_color_space_frame->data[0],
         .width                            = frame_in_wrong_colorspace->width,
         .height                           = frame_in_wrong_colorspace->height,
         .is_different_from_previous_frame = is_different_from_previous_frame,
         .is_last_frame                    = _has_reached_end_of_file.load() && _frames_queue.size() == 1,
+        .time_in_seconds                  = present_time(*frame_in_wrong_colorspace),
+        .duration_in_seconds              = frame_duration_in_seconds(*frame_in_wrong_colorspace, video_stream()),
     };
+    return _last_returned_frame;
 }
 
 auto VideoDecoder::present_time(AVFrame const& frame) const -> double
@@ -414,54 +687,32 @@ auto VideoDecoder::present_time(AVPacket const& packet) const -> double
     return static_cast<double>(packet.pts) * av_q2d(video_stream().time_base);
 }
 
-namespace {
-struct PacketRaii { // NOLINT(*special-member-functions)
-    AVPacket* packet;
-
-    ~PacketRaii()
-    {
-        av_packet_unref(packet);
-    }
-};
-} // namespace
-
-auto VideoDecoder::seeking_would_move_us_forward(double time_in_seconds) -> bool
+auto VideoDecoder::seek_target() const -> std::optional<double>
 {
-    {
-        auto const timestamp = static_cast<int64_t>(time_in_seconds / av_q2d(video_stream().time_base));
-
-        int const err = avformat_seek_file(_format_ctx_to_test_seeking, _video_stream_idx, INT64_MIN, timestamp, timestamp, 0);
-        if (err < 0)
-            return false;
-    }
-
-    while (true)
-    {
-        PacketRaii packet_raii{_packet_to_test_seeking}; // Will unref the packet when exiting the scope
+    double const target = _seek_target.load();
+    if (std::isnan(target))
+        return std::nullopt;
+    return target;
+}
 
-        { // Read data from the file and put it in the packet
-            int const err = av_read_frame(_format_ctx_to_test_seeking, _packet_to_test_seeking);
-            if (err == AVERROR_EOF)
-                return false; // Shouldn't happen anyways (the first packet after seeking should never be after the end of the file). But if it does, this is probably not a keyframe we want to seek to.
-            if (err < 0)
-                return false;
-        }
+auto VideoDecoder::is_far_before(double time_in_seconds, std::optional<double> seek_target) const -> bool
+{
+    if (!seek_target.has_value())
+        return false;
+    return time_in_seconds < *seek_target - 2. * average_frame_duration_in_seconds(); // Frames are not always evenly spaced, keep some margin so that we never skip the requested frame itself
+}
 
-        // Check if the packet belongs to the video stream, otherwise skip it
-        if (_packet_to_test_seeking->stream_index != _video_stream_idx)
-            continue;
+void VideoDecoder::configure_decoder_for_packet(std::optional<double> seek_target)
+{
+    bool const has_time             = _packet->pts != AV_NOPTS_VALUE;
+    bool const is_far_before_target = has_time && is_far_before(present_time(*_packet), seek_target);
+    _decoder_ctx->skip_frame        = is_far_before_target ? AVDISCARD_NONREF : AVDISCARD_DEFAULT; // Read by the decoder for each packet. Non-reference frames can be skipped without damaging the following ones
 
-        {
-            std::unique_lock lock{_frames_queue.mutex()};
-            _frames_queue.waiting_for_queue_to_fill_up().wait(lock, [&]() { return _frames_queue.size_no_lock() >= 1 || _has_reached_end_of_file.load() || too_many_errors(); });
-        }
-        if (_frames_queue.is_empty()) // Can happen if there are errors while decoding frames, or if we reach the end of an empty file.
-            return false;
-        return present_time(*_packet_to_test_seeking) > present_time(_frames_queue.first());
-    }
+    bool const is_before_target = has_time && seek_target.has_value() && present_time(*_packet) < *seek_target - average_frame_duration_in_seconds(); // Never true for the requested frame itself
+    apply_decoding_quality(_decoding_quality.load(), _is_fast_seeking.load() && is_before_target);
 }
 
-auto VideoDecoder::get_frame_at_impl(double time_in_seconds, SeekMode seek_mode) -> AVFrame const* // NOLINT(*cognitive-complexity)
+auto VideoDecoder::get_frame_at_impl(double time_in_seconds, SeekMode seek_mode) -> std::optional<Frame> // NOLINT(*cognitive-complexity)
 {
     _error_count.store(0); // Reset error count. We stop if 5 errors occur while we wait for frames.
 
@@ -469,83 +720,285 @@ auto VideoDecoder::get_frame_at_impl(double time_in_seconds, SeekMode seek_mode)
     bool const fast_mode{seek_mode == SeekMode::Fast};
 
     // We will return the first frame in the stream that has a present_time greater than time_in_seconds
-    for (int attempt_count = 0;; ++attempt_count)
+    while (true)
     {
         {
+            TraceScope const trace{"wait", "wait_for_frame"}; // Declared before the lock, so that the event is sent to the sink after unlocking
             std::unique_lock lock{_frames_queue.mutex()};
+            auto const       wait_start = std::chrono::steady_clock::now();
             _frames_queue.waiting_for_queue_to_fill_up().wait(lock, [&]() { return _frames_queue.size_no_lock() >= 2 || _has_reached_end_of_file.load() || too_many_errors(); });
+            _waiting_for_frames_time.fetch_add((std::chrono::steady_clock::now() - wait_start).count(), std::memory_order_relaxed);
         }
         if (_frames_queue.is_empty()) // Can happen if there are errors while decoding frames, or if we reach the end of an empty file.
-            return nullptr;
+            return std::nullopt;
 
-        bool const should_seek = [&]() // IIFE
-        {
-            auto const current_time = _seek_target.value_or(present_time(_frames_queue.first()));
+        std::unique_lock seek_lock{_seek_mutex}; // Might wait for the decoding thread to finish handling a request of try_get_frame_at() / async_get_frame_at()
+        _seek_request.reset();                    // We are the ones deciding now
+        _has_seek_request.store(false);
+        if (should_seek_to(time_in_seconds)) // Checked again each time we get a new frame, because the estimations get more accurate
+            seek_to(time_in_seconds, seek_mode, !fast_mode /*decode_until_target_on_this_thread*/);
 
-            // Seek backward
-            if (time_in_seconds < current_time)
-                return true;
+        auto const frame = try_get_frame_from_queue(time_in_seconds, seek_mode);
+        if (frame.has_value())
+            return make_frame(*frame); // Still holding _seek_mutex: in SeekMode::Fast the decoding thread might otherwise pop and reuse the frame while we convert it
+    }
+}
 
-            // No need to seek forward if we have reached end of file
-            if (_has_reached_end_of_file.load())
-                return false;
+auto VideoDecoder::decoding_time_in_seconds(double duration_in_seconds) const -> double
+{
+    return std::max(duration_in_seconds, 0.) / average_frame_duration_in_seconds() * _average_decoding_time_in_seconds.load();
+}
 
-            // Seek forward more than 1 second
-            if (attempt_count == 0 && current_time < time_in_seconds - 1.f && seeking_would_move_us_forward(time_in_seconds))
-                return true;
+auto VideoDecoder::is_obviously_faster_to_decode_forward(double time_in_seconds) -> bool
+{
+    // On average, the keyframe before the target is half a GOP before it. No need to look for the actual keyframe if even the best case can't beat decoding forward.
+    double const best_seeking_time = _average_seek_time_in_seconds + decoding_time_in_seconds(_average_gop_duration_in_seconds.load() / 2.);
+    return decoding_time_in_seconds(time_in_seconds - present_time(_frames_queue.first())) <= best_seeking_time;
+}
 
-            // If we have read quite a few frames and still not found the target time, we might be better off seeking
-            if (attempt_count == 15 && seeking_would_move_us_forward(time_in_seconds)) // TODO do we keep it ? Do we change the number
-                return true;
+auto VideoDecoder::can_reach_without_seeking(double time_in_seconds) -> bool
+{
+    if (time_in_seconds < seek_target().value_or(present_time(_frames_queue.first())))
+        return false;
+    if (_has_reached_end_of_file.load() || is_obviously_faster_to_decode_forward(time_in_seconds))
+        return true;
+    if (_last_keyframe_lookup.has_value() && _last_keyframe_lookup->time_in_seconds == time_in_seconds) // We can use the result of the previous lookup, without reading the file
+        return !_last_keyframe_lookup->keyframe_time_in_seconds.has_value() || *_last_keyframe_lookup->keyframe_time_in_seconds <= present_time(_frames_queue.first());
+    return false;
+}
 
-            return false;
-        }();
+auto VideoDecoder::should_seek_to(double time_in_seconds) -> bool
+{
+    auto const current_time = seek_target().value_or(present_time(_frames_queue.first()));
 
-        if (should_seek)
-        {
-            _wants_to_pause_decoding_thread_asap.store(true);
-            _frames_queue.waiting_for_queue_to_empty_out().notify_one();
-            std::unique_lock lock{_decoding_context_mutex}; // Lock the decoding thread at the beginning of its loop
-            _wants_to_pause_decoding_thread_asap.store(false);
-
-            auto const timestamp = static_cast<int64_t>(time_in_seconds / av_q2d(video_stream().time_base));
-            int const  err       = avformat_seek_file(_format_ctx, _video_stream_idx, INT64_MIN, timestamp, timestamp, 0);
-            if (err >= 0) // Failing to seek is not a problem, we will just continue without seeking
+    // Seek backward
+    if (time_in_seconds < current_time)
+    {
+        _backward_seeks.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // No need to seek forward if we have reached end of file
+    if (_has_reached_end_of_file.load())
+        return false;
+
+    // Seek forward iff we will reach the target sooner by seeking to the keyframe before it, than by decoding all the frames until it
+    double const decoding_position = present_time(_frames_queue.first());
+    _last_seek_decision            = SeekDecision{.decoding_forward_time_in_seconds = decoding_time_in_seconds(time_in_seconds - decoding_position)};
+    if (is_obviously_faster_to_decode_forward(time_in_seconds)) // Cheap estimation first
+        return false;
+
+    auto const keyframe_time = keyframe_time_before(time_in_seconds);
+    if (!keyframe_time.has_value() || *keyframe_time <= decoding_position) // The target is in the GOP that we are already decoding, seeking would only bring us backward
+        return false;
+    _last_seek_decision.seeking_time_in_seconds = _average_seek_time_in_seconds + decoding_time_in_seconds(time_in_seconds - *keyframe_time);
+    _last_seek_decision.has_seeked              = _last_seek_decision.seeking_time_in_seconds < _last_seek_decision.decoding_forward_time_in_seconds;
+    if (_last_seek_decision.has_seeked)
+        _forward_seeks.fetch_add(1, std::memory_order_relaxed);
+    return _last_seek_decision.has_seeked;
+}
+
+auto VideoDecoder::post_seek_request_if_needed(double time_in_seconds, SeekMode seek_mode) -> bool
+{
+    if (_frames_queue.is_empty() || can_reach_without_seeking(time_in_seconds)) // We need at least one frame to know where the decoding thread is, before deciding whether to seek or not
+    {
+        _seek_request.reset(); // Any previous request is outdated
+        _has_seek_request.store(false);
+        return true;
+    }
+
+    _seek_request = SeekRequest{.time_in_seconds = time_in_seconds, .seek_mode = seek_mode};
+    _has_seek_request.store(true);
+    // Wake up the decoding thread, wherever it is waiting. The mutexes are only held for a few instructions, so this doesn't wait for the decoding thread.
+    {
+        std::unique_lock lock{_frames_queue.mutex()}; // Make sure the thread is not between the check of its predicate and the start of its wait, otherwise it would miss the notification
+    }
+    _frames_queue.waiting_for_queue_to_empty_out().notify_one();
+    {
+        std::unique_lock lock{_packets_queue->mutex()}; // Same
+    }
+    _packets_queue->waiting_for_queue_to_fill_up().notify_one();
+    return false;
+}
+
+void VideoDecoder::process_seek_request()
+{
+    if (!_has_seek_request.load())
+        return;
+    {
+        std::unique_lock lock{_seek_mutex};
+        auto const       request = std::exchange(_seek_request, std::nullopt);
+        _has_seek_request.store(false);
+        if (request.has_value() && !_frames_queue.is_empty() && should_seek_to(request->time_in_seconds))
+            seek_to(request->time_in_seconds, request->seek_mode, false /*decode_until_target_on_this_thread*/);
+    }
+    notify_frame_waiters(); // The coroutines that are waiting for our decision can look at the queue again
+}
+
+auto VideoDecoder::last_seek_decision() const -> SeekDecision
+{
+    std::unique_lock lock{_seek_mutex};
+    return _last_seek_decision;
+}
+
+auto VideoDecoder::keyframe_time_before(double time_in_seconds) -> std::optional<double>
+{
+    if (_last_keyframe_lookup.has_value() && _last_keyframe_lookup->time_in_seconds == time_in_seconds)
+        return _last_keyframe_lookup->keyframe_time_in_seconds;
+
+    TraceScope const trace{"seek", "keyframe_time_before"};
+    auto const       keyframe_time = [&]() -> std::optional<double> { // IIFE
+        AVStream* const stream    = _format_ctx_to_test_seeking->streams[_video_stream_idx]; // NOLINT(*pointer-arithmetic)
+        auto const      timestamp = static_cast<int64_t>(time_in_seconds / av_q2d(stream->time_base));
+
+        { // Look in the index first, it doesn't need any I/O. Some formats have a full index (e.g. MP4), others only fill it as they read the file, so we only trust it if it knows a keyframe after the target too (otherwise there might be a closer one that it doesn't know about yet)
+            int const index = av_index_search_timestamp(stream, timestamp, AVSEEK_FLAG_BACKWARD);
+            if (index >= 0 && index + 1 < avformat_index_get_entries_count(stream))
             {
-                avcodec_flush_buffers(_decoder_ctx);
-                _frames_queue.clear();
-                _has_reached_end_of_file.store(false);
-                if (fast_mode)
-                    _seek_target = time_in_seconds;
-                else
-                    process_packets_until(time_in_seconds);
+                AVIndexEntry const* const entry = avformat_index_get_entry(stream, index);
+                AVIndexEntry const* const next  = avformat_index_get_entry(stream, index + 1);
+                if (entry && next && next->timestamp > timestamp)
+                    return static_cast<double>(entry->timestamp) * av_q2d(stream->time_base);
             }
         }
 
-        if ((_has_reached_end_of_file.load() || too_many_errors()) && _frames_queue.size() == 1) //  Must be done after seeking, and after discarding all the frames that are past. Because if we are requested a time that is in the past, we need to seek, and can't just return early because we have reached the end of the file.
+        // Otherwise, seek and see which packet we land on
+        if (avformat_seek_file(_format_ctx_to_test_seeking, _video_stream_idx, INT64_MIN, timestamp, timestamp, 0) < 0)
+            return std::nullopt;
+        while (true)
         {
-            return &_frames_queue.first(); // Return the last frame that we decoded before reaching end of file, aka the last frame of the file
+            PacketRaii packet_raii{_packet_to_test_seeking}; // Will unref the packet when exiting the scope
+            if (av_read_frame(_format_ctx_to_test_seeking, _packet_to_test_seeking) < 0)
+                return std::nullopt; // Shouldn't happen (the first packet after seeking should never be after the end of the file). But if it does, this is probably not a keyframe we want to seek to.
+            if (_packet_to_test_seeking->stream_index == _video_stream_idx) // Skip the packets of the other streams
+                return present_time(*_packet_to_test_seeking);
         }
+    }();
 
-        while (_frames_queue.size() >= 2)
-        {
-            if (present_time(_frames_queue.second()) > time_in_seconds) // We found the exact requested frame
-            {
-                _seek_target.reset();
-                return &_frames_queue.first();
-            }
-            _frames_queue.pop(); // We want to see something that is past that frame, we can discard it now
-        }
+    _last_keyframe_lookup = KeyframeLookup{.time_in_seconds = time_in_seconds, .keyframe_time_in_seconds = keyframe_time};
+    return keyframe_time;
+}
+
+auto VideoDecoder::average_frame_duration_in_seconds() const -> double
+{
+    AVRational const frame_rate = video_stream().avg_frame_rate;
+    return frame_rate.num > 0 && frame_rate.den > 0 ? av_q2d(av_inv_q(frame_rate)) : 0.1;
+}
+
+void VideoDecoder::record_decoding_time(std::chrono::steady_clock::duration duration)
+{
+    _decoding_stats.add(duration);
+    _decoding_time_histogram.add(duration);
+    _average_decoding_time_in_seconds.store(moving_average(_average_decoding_time_in_seconds.load(), std::chrono::duration<double>{duration}.count()));
+}
+
+void VideoDecoder::record_keyframe(AVPacket const& packet)
+{
+    if (!is_keyframe(packet) || packet_timestamp(packet) == AV_NOPTS_VALUE)
+        return;
+    if (_last_keyframe_timestamp.has_value() && packet_timestamp(packet) > *_last_keyframe_timestamp)
+        _average_gop_duration_in_seconds.store(moving_average(_average_gop_duration_in_seconds.load(), static_cast<double>(packet_timestamp(packet) - *_last_keyframe_timestamp) * av_q2d(video_stream().time_base)));
+    _last_keyframe_timestamp = packet_timestamp(packet);
+}
+
+void VideoDecoder::seek_to(double time_in_seconds, SeekMode seek_mode, bool decode_until_target_on_this_thread)
+{
+    TraceScope const trace{"seek", "VideoDecoder::seek_to"};
+    auto const       start = std::chrono::steady_clock::now();
+    _has_seeked_since_last_frame = true;
+    _wants_to_pause_decoding_thread_asap.store(true);
+    _frames_queue.waiting_for_queue_to_empty_out().notify_one();
+    {
+        std::unique_lock packets_lock{_packets_queue->mutex()}; // Make sure the decoding thread is not between the check of its predicate and the start of its wait, otherwise it would miss the notification
+    }
+    _packets_queue->waiting_for_queue_to_fill_up().notify_one(); // The decoding thread might be waiting for a packet
+    std::unique_lock lock{_decoding_context_mutex};             // Lock the decoding thread at the beginning of its loop
+    _wants_to_pause_decoding_thread_asap.store(false);
 
-        // assert(_frames_queue.size() <= 1); // Wrong, decoding thread might have given us another frame in the meantime, after ending the while loop above. We should still use the first frame in the queue and not the last, since we don't know if the frames after the first one or above or below the time we seek
-        if (fast_mode && !_frames_queue.is_empty())
+    auto const timestamp = static_cast<int64_t>(time_in_seconds / av_q2d(video_stream().time_base));
+    if (demuxer_has_been_moved_just_before(time_in_seconds))
+    {
+        _packets_serial = _packets_queue->serial(); // We flush the decoder below
+        _recent_packets.clear();
+        _is_waiting_for_keyframe = demuxer_has_other_video_streams();
+    }
+    else if (_recent_packets.start_replay_at(timestamp)) // Short seeks can re-decode the packets we still have in memory, without seeking in the file
+    {
+        _seeks_replayed_from_memory.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        hint_access_pattern(AccessPattern::Random); // Done before the seek itself, so that the reads it triggers don't fault in pages we won't need
+
+        if (!_demuxer->seek_to(time_in_seconds)) // Failing to seek is not a problem, we will just continue without seeking
+            return;
+        _packets_serial = _packets_queue->serial(); // We are the ones who moved the Demuxer, we flush the decoder below
+        _recent_packets.clear();
+        _is_waiting_for_keyframe = demuxer_has_other_video_streams();
+    }
+    _last_keyframe_timestamp.reset(); // The next keyframe doesn't follow the previous one, we can't measure the duration of the GOP between them
+
+    avcodec_flush_buffers(_decoder_ctx);
+    _frames_queue.clear();
+    _has_reached_end_of_file.store(false);
+    _average_seek_time_in_seconds = moving_average(_average_seek_time_in_seconds, std::chrono::duration<double>{std::chrono::steady_clock::now() - start}.count()); // The time spent decoding from the keyframe is not included, it is estimated separately
+    _is_fast_seeking.store(!decode_until_target_on_this_thread && seek_mode == SeekMode::Fast);
+    if (decode_until_target_on_this_thread)
+        process_packets_until(time_in_seconds);
+    else
+        _seek_target.store(time_in_seconds);
+}
+
+auto VideoDecoder::demuxer_has_other_video_streams() const -> bool
+{
+    return _demuxer->streams_indices(AVMEDIA_TYPE_VIDEO).size() > 1;
+}
+
+auto VideoDecoder::demuxer_has_been_moved_just_before(double time_in_seconds) -> bool
+{
+    if (_packets_queue->serial() == _packets_serial) // We are the last ones who moved it, or we have already started reading from where it has been moved
+        return false;
+    auto const seek_time = _demuxer->last_seek_time_in_seconds();
+    return seek_time <= time_in_seconds && time_in_seconds - seek_time < 1.; // The packets start at the keyframe before seek_time, so they are all we need to reach time_in_seconds
+}
+
+void VideoDecoder::hint_access_pattern(AccessPattern pattern)
+{
+    if (!_data_source || _access_pattern == pattern) // Hints can be costly (e.g. a syscall), so we only send them when the pattern changes
+        return;
+    _access_pattern = pattern;
+    _data_source->hint_access_pattern(pattern);
+}
+
+auto VideoDecoder::try_get_frame_from_queue(double time_in_seconds, SeekMode seek_mode) -> std::optional<AVFrame const*>
+{
+    if ((_has_reached_end_of_file.load() || too_many_errors()) && _frames_queue.size() == 1) //  Must be done after seeking, and after discarding all the frames that are past. Because if we are requested a time that is in the past, we need to seek, and can't just return early because we have reached the end of the file.
+    {
+        return &_frames_queue.first(); // Return the last frame that we decoded before reaching end of file, aka the last frame of the file
+    }
+
+    while (_frames_queue.size() >= 2)
+    {
+        if (present_time(_frames_queue.second()) > time_in_seconds) // We found the exact requested frame
+        {
+            _seek_target.store(std::numeric_limits<double>::quiet_NaN());
+            _is_fast_seeking.store(false);
             return &_frames_queue.first();
+        }
+        _frames_queue.pop(); // We want to see something that is past that frame, we can discard it now
     }
+
+    // assert(_frames_queue.size() <= 1); // Wrong, decoding thread might have given us another frame in the meantime, after ending the while loop above. We should still use the first frame in the queue and not the last, since we don't know if the frames after the first one or above or below the time we seek
+    if (seek_mode == SeekMode::Fast && !_frames_queue.is_empty())
+        return &_frames_queue.first();
+
+    return std::nullopt;
 }
 
 void VideoDecoder::process_packets_until(double time_in_seconds) // NOLINT(*cognitive-complexity)
 {
     assert(_frames_queue.is_empty());
+    auto decoding_time = std::chrono::steady_clock::duration{}; // Since the last frame we got out of the decoder
     while (true)
     {
         if (too_many_errors())
@@ -553,13 +1006,15 @@ void VideoDecoder::process_packets_until(double time_in_seconds) // NOLINT(*cogn
 
         PacketRaii packet_raii{_packet}; // Will unref the packet when exiting the scope
 
-        { // Read data from the file and put it in the packet
-            int const err = av_read_frame(_format_ctx, _packet);
+        { // Get the next packet of the video stream, read by the Demuxer
+            int const err = read_packet(_packet);
             if (err == AVERROR_EOF)
             {
                 _has_reached_end_of_file.store(true);
                 return;
             }
+            if (err == AVERROR_EXIT) // We are getting destroyed
+                return;
             if (err < 0)
             {
                 log_frame_decoding_error("Failed to read video packet", err);
@@ -567,11 +1022,10 @@ void VideoDecoder::process_packets_until(double time_in_seconds) // NOLINT(*cogn
             }
         }
 
-        // Check if the packet belongs to the video stream, otherwise skip it
-        if (_packet->stream_index != _video_stream_idx)
-            continue;
-
+        auto const decoding_start = std::chrono::steady_clock::now();
         { // Send the packet to the decoder
+            TraceScope const trace{"decode", "avcodec_send_packet"};
+            configure_decoder_for_packet(time_in_seconds);
             int const err = avcodec_send_packet(_decoder_ctx, _packet);
             assert(err != AVERROR_EOF);     // "the decoder has been flushed, and no new packets can be sent to it" Should never happen if we do our job properly
             assert(err != AVERROR(EINVAL)); // "codec not opened, it is an encoder, or requires flush" Should never happen if we do our job properly
@@ -584,7 +1038,9 @@ void VideoDecoder::process_packets_until(double time_in_seconds) // NOLINT(*cogn
 
         AVFrame* frame = _frames_queue.get_frame_to_fill();
         { // Read a frame from the packet that was sent to the decoder. For video streams a packet only contains one frame so there is no need to call avcodec_receive_frame() in a loop
-            int const err = avcodec_receive_frame(_decoder_ctx, frame);
+            TraceScope const trace{"decode", "avcodec_receive_frame"};
+            int const        err = avcodec_receive_frame(_decoder_ctx, frame);
+            decoding_time += std::chrono::steady_clock::now() - decoding_start;
             if (err == AVERROR(EAGAIN)) // EAGAIN is a special error that is not a real problem, we just need to resend a packet
                 continue;
             assert(err != AVERROR_EOF);     // "the codec has been fully flushed, and there will be no more output frames" Should never happen if we do our job properly
@@ -596,6 +1052,7 @@ void VideoDecoder::process_packets_until(double time_in_seconds) // NOLINT(*cogn
             }
         }
 
+        record_decoding_time(std::exchange(decoding_time, {}));
         _frames_queue.push(frame);
         if (_frames_queue.size() > 2)
             _frames_queue.pop();
@@ -607,25 +1064,33 @@ void VideoDecoder::process_packets_until(double time_in_seconds) // NOLINT(*cogn
     assert(_frames_queue.size() == 2 || too_many_errors());
 }
 
-void VideoDecoder::convert_frame_to_desired_color_space(AVFrame const& frame) const
+void VideoDecoder::convert_frame_to_desired_color_space(AVFrame const& frame)
 {
+    TraceScope const trace{"convert", "sws_scale"};
+    auto const       start = std::chrono::steady_clock::now();
     sws_scale(_sws_ctx, frame.data, frame.linesize, 0, frame.height, _desired_color_space_frame->data, _desired_color_space_frame->linesize);
+    _conversion_stats.add(std::chrono::steady_clock::now() - start);
 }
 
-auto VideoDecoder::decode_next_frame_into(AVFrame* frame) -> bool
+auto VideoDecoder::decode_next_frame_into(AVFrame* frame, std::optional<double> seek_target) -> bool
 {
+    auto decoding_time = std::chrono::steady_clock::duration{}; // Not counting the time spent waiting for packets
+
     while (true)
     {
         PacketRaii packet_raii{_packet}; // Will unref the packet when exiting the scope
 
-        { // Read data from the file and put it in the packet (most of the time this will be the actual video frame, but it can also be additional data, in which case avcodec_receive_frame() will return AVERROR(EAGAIN))
-            int const err = av_read_frame(_format_ctx, _packet);
+        { // Get the next packet of the video stream, read by the Demuxer (most of the time this will be the actual video frame, but it can also be additional data, in which case avcodec_receive_frame() will return AVERROR(EAGAIN))
+            int const err = read_packet(_packet);
             if (err == AVERROR_EOF)
             {
                 _has_reached_end_of_file.store(true);
                 _frames_queue.waiting_for_queue_to_fill_up().notify_one();
+                notify_frame_waiters();
                 return false;
             }
+            if (err == AVERROR_EXIT)
+                return false;
             if (err < 0)
                 throw_error("Failed to read video packet", err);
         }
@@ -633,11 +1098,10 @@ auto VideoDecoder::decode_next_frame_into(AVFrame* frame) -> bool
         if (_wants_to_pause_decoding_thread_asap.load() || _wants_to_stop_video_decoding_thread.load())
             return false;
 
-        // Check if the packet belongs to the video stream, otherwise skip it
-        if (_packet->stream_index != _video_stream_idx)
-            continue;
-
+        auto const decoding_start = std::chrono::steady_clock::now();
         { // Send the packet to the decoder
+            TraceScope const trace{"decode", "avcodec_send_packet"};
+            configure_decoder_for_packet(seek_target);
             int const err = avcodec_send_packet(_decoder_ctx, _packet);
             assert(err != AVERROR_EOF);     // "the decoder has been flushed, and no new packets can be sent to it" Should never happen if we do our job properly
             assert(err != AVERROR(EINVAL)); // "codec not opened, it is an encoder, or requires flush" Should never happen if we do our job properly
@@ -649,7 +1113,9 @@ auto VideoDecoder::decode_next_frame_into(AVFrame* frame) -> bool
             return false;
 
         { // Read a frame from the packet that was sent to the decoder. For video streams a packet only contains one frame so there is no need to call avcodec_receive_frame() in a loop
-            int const err = avcodec_receive_frame(_decoder_ctx, frame);
+            TraceScope const trace{"decode", "avcodec_receive_frame"};
+            int const        err = avcodec_receive_frame(_decoder_ctx, frame);
+            decoding_time += std::chrono::steady_clock::now() - decoding_start;
             if (err == AVERROR(EAGAIN)) // EAGAIN is a special error that is not a real problem, we just need to resend a packet
                 continue;
             assert(err != AVERROR_EOF);     // "the codec has been fully flushed, and there will be no more output frames" Should never happen if we do our job properly
@@ -661,17 +1127,34 @@ auto VideoDecoder::decode_next_frame_into(AVFrame* frame) -> bool
         break; // Frame has been successfully read, we can stop the loop
     }
 
+    record_decoding_time(decoding_time);
     return true;
 }
 
-auto VideoDecoder::video_stream() const -> AVStream const&
+void VideoDecoder::apply_decoding_quality(DecodingQuality quality, bool is_catching_up)
 {
-    return *_format_ctx->streams[_video_stream_idx]; // NOLINT(*pointer-arithmetic)
+    if (quality == _applied_decoding_quality && is_catching_up == _applied_catching_up)
+        return;
+    _applied_decoding_quality = quality;
+    _applied_catching_up      = is_catching_up;
+
+    // These are read by the decoder for each frame, so they can be changed at any time (unlike `lowres`, which changes the size of the frames and must be set before opening the decoder)
+    if (quality == DecodingQuality::Preview)
+    {
+        _decoder_ctx->skip_loop_filter = AVDISCARD_ALL;
+        _decoder_ctx->skip_idct        = AVDISCARD_NONREF;
+        _decoder_ctx->flags2 |= AV_CODEC_FLAG2_FAST; // NOLINT(*signed-bitwise)
+        return;
+    }
+    // While catching up, we only degrade the frames that no other frame depends on. Skipping the deblocking of a reference frame would leave artifacts in all the frames until the next keyframe, including the requested one.
+    _decoder_ctx->skip_loop_filter = is_catching_up ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    _decoder_ctx->skip_idct        = is_catching_up ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    _decoder_ctx->flags2 &= ~AV_CODEC_FLAG2_FAST; // NOLINT(*signed-bitwise)
 }
 
-[[nodiscard]] auto VideoDecoder::duration_in_seconds() const -> double
+auto VideoDecoder::video_stream() const -> AVStream const&
 {
-    return static_cast<double>(_format_ctx->duration) / static_cast<double>(AV_TIME_BASE);
+    return _demuxer->stream(_video_stream_idx);
 }
 
 } // namespace ffmpeg
@@ -3,12 +3,24 @@ extern "C"
 {
 #include <libavutil/pixfmt.h>
 }
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <coroutine>
+#include <deque>
 #include <filesystem>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <thread>
 #include <vector>
+#include "Demuxer.hpp"
+#include "Frame.hpp"
+#include "Input.hpp"
+#include "PacketsQueue.hpp"
+#include "StageStats.hpp"
 
 // TODO way to build Coollab without FFMPEG, and add it to COOLLAB_REQUIRE_ALL_FEATURES
 // TODO test that the linux and mac exe work even on a machine that has no ffmpeg installed
@@ -22,24 +34,63 @@ struct SwsContext;
 
 namespace ffmpeg {
 
-struct Frame {
-    uint8_t* data{};   /// Pointer to all the pixels, in the color space that you requested when constructing the VideoDecoder. If there is some alpha it will always be straight alpha, never premultiplied.
-    int      width{};  /// In pixels
-    int      height{}; /// In pixels
-    bool     is_different_from_previous_frame{};
-    bool     is_last_frame{}; /// If this is the last frame in the file, we will keep returning it, but you can might want to do something else (like displaying nothing, or seeking back to the beginning of the file).
-};
-
 enum class SeekMode {
     Exact, /// Returns the exact requested frame.
     Fast,  /// Returns the keyframe just before the requested frame, and then other calls to get_frame_at() will read a few frames quickly, so that we eventually reach the requested frame. Guarantees that get_frame_at() will never take too long to return.
 };
 
+enum class DecodingQuality {
+    Full,    /// Every frame is decoded exactly as the codec specifies.
+    Preview, /// Skips the deblocking filter, skips the IDCT of the frames that are not used as references, and allows non-spec-compliant speedups (AV_CODEC_FLAG2_FAST). Much cheaper on H.264 / HEVC / MPEG-family codecs, at the cost of some blocking artifacts that last until the next keyframe. Codecs that don't support these options (e.g. GIF) decode at full quality anyways.
+};
+
+struct ClosestFrame {
+    Frame frame{};
+    bool  is_exact{}; /// False iff the decoder hasn't reached the requested time yet, and `frame` is only the closest one that we have. It is still worth displaying it while waiting for the exact one.
+};
+
+/// Why the decoder chose to seek forward or to keep decoding until the requested frame, the last time it had to choose.
+/// The times are estimated from how long it took to decode the previous frames and to do the previous seeks, and from where the keyframes are.
+struct SeekDecision {
+    bool   has_seeked{};                       /// True iff seeking was estimated to reach the requested frame sooner
+    double decoding_forward_time_in_seconds{}; /// Estimated time to reach the requested frame by decoding all the frames until it
+    double seeking_time_in_seconds{};          /// Estimated time to reach the requested frame by seeking to the keyframe before it and decoding from there. 0 if we didn't even look for that keyframe, because decoding forward was obviously faster
+};
+
+/// What a VideoDecoder has been doing since it was created. Cheap enough to be collected all the time, even in production.
+struct VideoDecoderStats {
+    StageStats        decoding{};                       /// Frames that came out of the decoder, and the time spent in avcodec_send_packet() / avcodec_receive_frame()
+    StageStats        conversion{};                     /// Conversion of the returned frames to the requested pixel format (sws_scale)
+    DemuxerStats      demuxer{};                        /// NB: the Demuxer might be shared with other decoders, and this counts their packets too
+    DurationHistogram decoding_time_histogram{};        /// Time to decode each frame
+    DurationHistogram get_frame_time_histogram{};       /// Time that each call to get_frame_at() took, including the time spent waiting for the decoding thread
+    double            waiting_for_packets_in_seconds{}; /// Time the decoding thread spent waiting for the Demuxer to read packets
+    double            waiting_for_frames_in_seconds{};  /// Time get_frame_at() spent waiting for the decoding thread to decode frames
+    uint64_t          frames_returned{};                /// Distinct frames returned by get_frame_at() / async_get_frame_at() / try_get_frame_at()
+    uint64_t          frames_discarded{};               /// Frames decoded while catching up with a seek target, and thrown away without ever being returned
+    uint64_t          backward_seeks{};                 /// Needed every time we are asked for a frame before the one we are at
+    uint64_t          forward_seeks{};                  /// Only done when it was estimated to be faster than decoding forward, see SeekDecision
+    uint64_t          seeks_replayed_from_memory{};     /// Seeks that didn't need any I/O, because the packets were still in memory
+    uint64_t          errors_count{};                   /// Errors while reading or decoding the frames (which are also reported with the callback of set_frame_decoding_error_callback())
+    size_t            frames_in_queue{};                /// Decoded frames, waiting to be returned
+    PacketsQueueStats packets_queue{};                  /// Packets read ahead, waiting to be decoded
+};
+
+/// Something that runs a task on a thread of your choice, typically by pushing it to the queue of your thread pool / event loop.
+/// NB: it must not run the task immediately on the thread that calls it (this is the decoding thread of the VideoDecoder, and the task might need to pause that thread).
+using Executor = std::function<void(std::function<void()> task)>;
+
 class VideoDecoder {
 public:
     /// Throws a `std::runtime_error` if the creation fails (file not found / invalid video file / format not supported, etc.)
+    /// `input` can be a path to a file, a buffer in memory, or your own DataSource (see Input.hpp). Decoding from memory or from a DataSource doesn't need any temporary file.
     /// `pixel_format` is the format of the frames you will receive. For example you can set it to `AV_PIX_FMT_RGBA` to get an RGBA image with 8 bits per channel. If there is some alpha it will always be straight alpha, never premultiplied.
-    explicit VideoDecoder(std::filesystem::path const& path, AVPixelFormat pixel_format);
+    /// Decodes the best video stream of the file, or the one at `stream_index` if you specify it (e.g. to pick one of the angles of a multi-camera file).
+    explicit VideoDecoder(Input const& input, AVPixelFormat pixel_format, std::optional<int> stream_index = {});
+    /// Decodes a video stream of a Demuxer that you share with other decoders (typically an AudioDecoder, or the VideoDecoders of the other video streams), so that the file is only read once (see Demuxer.hpp).
+    /// Decodes the best video stream of the demuxer, or the one at `stream_index` if you specify it.
+    /// Throws a `std::runtime_error` if the demuxer doesn't have that stream, or if it is already decoded by another decoder.
+    VideoDecoder(std::shared_ptr<Demuxer> demuxer, AVPixelFormat pixel_format, std::optional<int> stream_index = {});
     ~VideoDecoder();
     VideoDecoder(VideoDecoder const&)                        = delete; ///
     auto operator=(VideoDecoder const&) -> VideoDecoder&     = delete; /// Not allowed to copy nor move the class (because we spawn a thread with a reference to this object)
@@ -50,32 +101,125 @@ public:
     /// Might return nullopt if we cannot read any frame from the file (which shouldn't happen, unless your video file is corrupted)
     auto get_frame_at(double time_in_seconds, SeekMode) -> std::optional<Frame>;
 
+    class GetFrameAwaitable {
+    public:
+        GetFrameAwaitable(VideoDecoder& decoder, double time_in_seconds, SeekMode seek_mode, Executor executor)
+            : _decoder{&decoder}
+            , _time_in_seconds{time_in_seconds}
+            , _seek_mode{seek_mode}
+            , _executor{std::move(executor)}
+        {}
+
+        [[nodiscard]] auto await_ready() -> bool { return try_get_frame(); }
+        [[nodiscard]] auto await_suspend(std::coroutine_handle<> handle) -> bool { return wait_for_frame(handle); }
+        [[nodiscard]] auto await_resume() -> std::optional<Frame>;
+
+    private:
+        [[nodiscard]] auto try_get_frame() -> bool;
+        /// Returns true iff the coroutine has been suspended, false if the frame was already available.
+        [[nodiscard]] auto wait_for_frame(std::coroutine_handle<> handle) -> bool;
+
+    private:
+        VideoDecoder*        _decoder;
+        double               _time_in_seconds;
+        SeekMode             _seek_mode;
+        Executor             _executor;
+        bool                 _has_made_seek_decision{false};
+        std::optional<Frame> _frame{}; // Set by try_get_frame() once it returns true. nullopt if there is no frame to return
+    };
+
+    /// Same as get_frame_at(), but instead of blocking while the decoding thread catches up, it suspends the calling coroutine, and resumes it on `executor` once the frame is available.
+    /// `co_await decoder.async_get_frame_at(time, seek_mode, executor)` gives you what get_frame_at(time, seek_mode) would have returned.
+    /// NB: just like with get_frame_at(), you must not have several requests in flight at the same time on the same VideoDecoder. And the VideoDecoder must outlive the request.
+    [[nodiscard]] auto async_get_frame_at(double time_in_seconds, SeekMode, Executor) -> GetFrameAwaitable;
+
+    /// Never waits for the decoding thread: returns immediately the frame at the requested time if it has already been decoded, otherwise the closest one that we have (e.g. the keyframe we just seeked to, or the last frame that was returned).
+    /// In the meantime, the decoding thread moves towards the requested time (it also decides whether to seek, and seeks, since both might need to read the file), so calling it again a bit later will eventually give you the exact frame. This is what you want in a real-time renderer, where waiting would ruin frame pacing.
+    /// The returned frame will be valid until the next call to get_frame_at() / try_get_frame_at() (or until the VideoDecoder is destroyed)
+    /// Returns nullopt if no frame has been decoded yet.
+    [[nodiscard]] auto try_get_frame_at(double time_in_seconds) -> std::optional<ClosestFrame>;
+
     /// Total duration of the video.
-    [[nodiscard]] auto duration_in_seconds() const -> double;
+    [[nodiscard]] auto duration_in_seconds() const -> double { return _demuxer->duration_in_seconds(); }
 
     /// Detailed info about the video, its encoding, etc.
-    [[nodiscard]] auto detailed_info() const -> std::string const& { return _detailed_info; }
+    [[nodiscard]] auto detailed_info() const -> std::string const& { return _demuxer->detailed_info(); }
+
+    /// Quality of the frames decoded from now on. Typically, switch to DecodingQuality::Preview when your app can't keep up with the frame rate of the video.
+    /// NB: while catching up after a SeekMode::Fast seek, the frames before the requested one that no other frame depends on are decoded with a lower quality (or not at all), since they are only shown briefly. This never affects the requested frame, nor the ones after it.
+    void set_decoding_quality(DecodingQuality quality) { _decoding_quality.store(quality); }
+
+    /// Thread-safe. Useful to understand how the decoder behaves on a given file (e.g. in a debug UI).
+    [[nodiscard]] auto last_seek_decision() const -> SeekDecision;
+
+    /// Thread-safe, you can poll it at any time (e.g. to display it in a debug UI, or to send it to your telemetry).
+    [[nodiscard]] auto stats() -> VideoDecoderStats;
 
 private:
-    void convert_frame_to_desired_color_space(AVFrame const&) const;
+    void convert_frame_to_desired_color_space(AVFrame const&);
 
     [[nodiscard]] auto video_stream() const -> AVStream const&;
 
     /// Throws on error
     /// Returns true iff decoding actually completed and filled up the `frame`.
-    [[nodiscard]] auto decode_next_frame_into(AVFrame* frame) -> bool;
+    /// `seek_target` is the snapshot of _seek_target that the decoding thread took for this frame.
+    [[nodiscard]] auto decode_next_frame_into(AVFrame* frame, std::optional<double> seek_target) -> bool;
+    /// Must be called while holding _decoding_context_mutex. Only touches the decoder when the settings actually change.
+    void               apply_decoding_quality(DecodingQuality, bool is_catching_up);
 
-    [[nodiscard]] auto get_frame_at_impl(double time_in_seconds, SeekMode) -> AVFrame const*;
+    [[nodiscard]] auto get_frame_at_impl(double time_in_seconds, SeekMode) -> std::optional<Frame>;
+    /// Converts the frame to the desired color space, and remembers it as the last returned frame.
+    /// Must be called while holding _seek_mutex, otherwise the decoding thread might recycle the frame while we convert it.
+    [[nodiscard]] auto make_frame(AVFrame const*) -> std::optional<Frame>;
+    /// Doesn't wait for the decoding thread. Returns nullopt if the requested frame is not in the queue yet.
+    [[nodiscard]] auto try_get_frame_from_queue(double time_in_seconds, SeekMode) -> std::optional<AVFrame const*>;
+    /// Backward seeks are always needed. Forward seeks are only done if they will reach the target sooner than decoding forward.
+    /// Must be called while holding _seek_mutex. Might need to read the file, to find the keyframe before `time_in_seconds`.
+    [[nodiscard]] auto should_seek_to(double time_in_seconds) -> bool;
+    /// Cheap part of should_seek_to(), that never reads the file: true iff we are sure that we don't need to seek. Must be called while holding _seek_mutex.
+    [[nodiscard]] auto can_reach_without_seeking(double time_in_seconds) -> bool;
+    /// For the requests that must not block (try_get_frame_at() / async_get_frame_at()): if we might need to seek, asks the decoding thread to decide and to seek.
+    /// Must be called while holding _seek_mutex. Returns false iff there is such a request pending, in which case the frames in the queue might not lead to `time_in_seconds`.
+    [[nodiscard]] auto post_seek_request_if_needed(double time_in_seconds, SeekMode) -> bool;
+    /// Called by the decoding thread, to handle the request of post_seek_request_if_needed() (if any)
+    void               process_seek_request();
+    /// Must be called while holding _seek_mutex, and not _decoding_context_mutex (it pauses the decoding thread by taking it)
+    void               seek_to(double time_in_seconds, SeekMode, bool decode_until_target_on_this_thread);
+    /// Called by the decoding thread whenever the queue changes, to wake up the coroutines that are waiting for a frame
+    void               notify_frame_waiters();
+    /// Forwards the hint to the DataSource (if any), only when the pattern actually changes. Must be called while holding _seek_mutex.
+    void               hint_access_pattern(AccessPattern);
 
     static void video_decoding_thread_job(VideoDecoder& This);
     void        process_packets_until(double time_in_seconds);
+    /// Blocks until the Demuxer gives us a packet, and moves it into `packet`.
+    /// Returns the error that the demuxer encountered instead of reading that packet (AVERROR_EOF at the end of the file), or AVERROR_EXIT if we got interrupted because the decoding thread needs to pause or stop.
+    [[nodiscard]] auto read_packet(AVPacket* packet) -> int;
 
     [[nodiscard]] auto present_time(AVFrame const&) const -> double;
     [[nodiscard]] auto present_time(AVPacket const&) const -> double;
 
-    [[nodiscard]] auto seeking_would_move_us_forward(double time_in_seconds) -> bool;
+    /// nullopt if we are not catching up with a seek target. Each caller must only read it once per decision, since another thread might change it in between.
+    [[nodiscard]] auto seek_target() const -> std::optional<double>;
+    /// True iff we are catching up with `seek_target`, and the frame at `time_in_seconds` is so far before it that it will never be returned.
+    [[nodiscard]] auto is_far_before(double time_in_seconds, std::optional<double> seek_target) const -> bool;
+    /// Must be called before sending _packet to the decoder. While catching up with `seek_target`, we don't decode the frames that will never be returned and that no other frame depends on (typically B-frames), and we lower the quality of the other ones that are before the target (see apply_decoding_quality()).
+    void               configure_decoder_for_packet(std::optional<double> seek_target);
 
-    [[nodiscard]] auto retrieve_detailed_info() const -> std::string;
+    /// Time of the keyframe that seeking to `time_in_seconds` would bring us to. Looks it up in the index of the file when there is one, otherwise actually seeks with _format_ctx_to_test_seeking.
+    [[nodiscard]] auto keyframe_time_before(double time_in_seconds) -> std::optional<double>;
+    [[nodiscard]] auto average_frame_duration_in_seconds() const -> double;
+    /// Estimated time to decode all the frames in `duration_in_seconds` of video
+    [[nodiscard]] auto decoding_time_in_seconds(double duration_in_seconds) const -> double;
+    /// True iff decoding forward until `time_in_seconds` is faster than seeking, even if the keyframe before it was as close as it usually is
+    [[nodiscard]] auto is_obviously_faster_to_decode_forward(double time_in_seconds) -> bool;
+    /// Updates the running averages that drive the seek decisions, and the stats
+    void               record_decoding_time(std::chrono::steady_clock::duration);
+    void               record_keyframe(AVPacket const&);
+    /// True iff we share the Demuxer with the decoders of other video streams (see _is_waiting_for_keyframe)
+    [[nodiscard]] auto demuxer_has_other_video_streams() const -> bool;
+    /// True iff another decoder has just moved the Demuxer a bit before `time_in_seconds`, and we haven't read any packet from there yet (typically because we decode several streams in lockstep). We can then start decoding from there instead of seeking again.
+    [[nodiscard]] auto demuxer_has_been_moved_just_before(double time_in_seconds) -> bool;
 
     void               log_frame_decoding_error(std::string const&);
     void               log_frame_decoding_error(std::string const&, int err);
@@ -95,6 +239,7 @@ private:
         [[nodiscard]] auto size() -> size_t;
         [[nodiscard]] auto size_no_lock() -> size_t;
         [[nodiscard]] auto is_full() -> bool;
+        [[nodiscard]] auto is_full_no_lock() -> bool;
         [[nodiscard]] auto is_empty() -> bool;
 
         [[nodiscard]] auto first() -> AVFrame const&;
@@ -119,21 +264,63 @@ private:
         std::condition_variable _waiting_for_pop{};
     };
 
+    /// Keeps the compressed packets of the current and previous GOPs that have been sent to the decoder, so that short seeks can re-decode them from memory, without seeking in the file nor doing any I/O.
+    /// Packets are reference-counted, so keeping them doesn't copy their data.
+    /// Only used while holding _decoding_context_mutex, so it doesn't need its own mutex.
+    class RecentPackets {
+    public:
+        RecentPackets() = default;
+        ~RecentPackets();
+        RecentPackets(RecentPackets const&)                        = delete;
+        auto operator=(RecentPackets const&) -> RecentPackets&     = delete;
+        RecentPackets(RecentPackets&&) noexcept                    = delete;
+        auto operator=(RecentPackets&&) noexcept -> RecentPackets& = delete;
+
+        /// Must be called with every packet that is sent to the decoder, in order (except the ones given by replay_next())
+        void add(AVPacket const&);
+        void mark_end_of_file() { _has_reached_end_of_file = true; }
+        void clear();
+
+        /// Returns false if the packets needed to decode the frame at `timestamp` are not all in memory, in which case you need to actually seek in the file.
+        /// Otherwise, the next calls to replay_next() will give you the packets starting at the keyframe just before `timestamp`.
+        [[nodiscard]] auto start_replay_at(int64_t timestamp) -> bool;
+        /// Returns nullopt once there is nothing more to replay, and you should read the next packets from the file.
+        /// Otherwise, returns the error that occurred while giving you the packet (AVERROR_EOF if the packets we had in memory went until the end of the file).
+        [[nodiscard]] auto replay_next(AVPacket* destination) -> std::optional<int>;
+
+    private:
+        void drop_oldest_gop();
+
+    private:
+        std::deque<AVPacket*> _packets{}; // Always starts with a keyframe
+        size_t                _size_in_bytes{0};
+        size_t                _keyframes_count{0};
+        bool                  _has_reached_end_of_file{false};
+        std::optional<size_t> _replay_position{};
+
+        static constexpr size_t max_gops_count{2};
+        static constexpr size_t max_size_in_bytes{64 * 1024 * 1024};
+    };
+
 private:
     // Contexts
-    AVFormatContext* _format_ctx{};
-    AVFormatContext* _format_ctx_to_test_seeking{}; // Dummy context that we use to seek and check that a seek would actually bring us closer to the frame we want to reach (which is not the case when the closest keyframe to the frame we seek is before the frame we are currently decoding)
-    AVCodecContext*  _decoder_ctx{};
-    SwsContext*      _sws_ctx{};
+    std::shared_ptr<Demuxer> _demuxer;
+    AVFormatContext*         _format_ctx_to_test_seeking{}; // Dummy context that we use to seek and check that a seek would actually bring us closer to the frame we want to reach (which is not the case when the closest keyframe to the frame we seek is before the frame we are currently decoding)
+    AVCodecContext*          _decoder_ctx{};
+    SwsContext*              _sws_ctx{};
 
     // Data
     AVFrame*    _desired_color_space_frame{};
     uint8_t*    _desired_color_space_buffer{};
     AVPacket*   _packet{};
     AVPacket*   _packet_to_test_seeking{}; // Dummy packet that we use to seek and check that a seek would actually bring us closer to the frame we want to reach (which is not the case when the closest keyframe to the frame we seek is before the frame we are currently decoding)
-    FramesQueue _frames_queue{};
+    FramesQueue       _frames_queue{};
+    TakenPacketsQueue _packets_queue{};           // Owned by the _demuxer. Closed when we are destroyed, because the Demuxer might outlive us (if it is shared with other decoders), and it must not wait for us to consume packets anymore
+    uint64_t          _packets_serial{};          // Serial of the packets queue the last time we flushed the decoder. If the queue has another serial, another decoder made the Demuxer seek, and what comes next doesn't follow what we have decoded so far
+    RecentPackets     _recent_packets{};
+    bool              _is_waiting_for_keyframe{}; // Set after the Demuxer seeked, if it demuxes other video streams: it moved to the earliest of their keyframes, so our first packets might precede our own keyframe, and can't be decoded
 
-    // Thread
+    // Threads
     std::thread       _video_decoding_thread{};
     std::atomic<bool> _wants_to_stop_video_decoding_thread{false};
     std::atomic<bool> _wants_to_pause_decoding_thread_asap{false};
@@ -141,11 +328,60 @@ private:
 
     // Info
     int                   _video_stream_idx{};
-    std::string           _detailed_info{};
     int64_t               _previous_pts{-99999};
     std::atomic<bool>     _has_reached_end_of_file{false};
     std::atomic<uint32_t> _error_count{0};
-    std::optional<double> _seek_target{};
+    std::atomic<double>   _seek_target{std::numeric_limits<double>::quiet_NaN()}; // NaN when there is no target. Atomic because the decoding thread reads it without holding _seek_mutex. Use seek_target() to read it
+    std::atomic<bool>     _is_fast_seeking{false};                                 // True while the decoding thread catches up with a _seek_target that was requested with SeekMode::Fast
+    std::optional<Frame>  _last_returned_frame{};                                  // Used as a fallback by try_get_frame_at(). Its data is still in _desired_color_space_frame.
+
+    // Seek decisions
+    struct KeyframeLookup {
+        double                time_in_seconds{};
+        std::optional<double> keyframe_time_in_seconds{};
+    };
+    struct SeekRequest {
+        double   time_in_seconds{};
+        SeekMode seek_mode{};
+    };
+    mutable std::mutex            _seek_mutex{};                         // Held by whichever thread decides whether to seek and seeks. Also held while reading the frames queue in try_get_frame_at() / async_get_frame_at(), since the decoding thread clears it when it seeks. Protects all the members of this section that are not atomic.
+    std::atomic<double>           _average_decoding_time_in_seconds{0.}; // Per frame. Written by whichever thread is decoding, read by the one deciding whether to seek
+    std::atomic<double>           _average_gop_duration_in_seconds{0.};
+    std::optional<int64_t>        _last_keyframe_timestamp{}; // Protected by _decoding_context_mutex
+    double                        _average_seek_time_in_seconds{0.};
+    SeekDecision                  _last_seek_decision{};
+    std::optional<KeyframeLookup> _last_keyframe_lookup{}; // So that we don't do the same lookup each time we check whether to seek while waiting for the same frame
+    std::optional<SeekRequest>    _seek_request{};         // Posted by try_get_frame_at() / async_get_frame_at(), handled by the decoding thread
+    std::atomic<bool>             _has_seek_request{false}; // So that the decoding thread can check for a request without locking _seek_mutex
+
+    // Stats
+    StageStatsCounter                           _decoding_stats{};
+    StageStatsCounter                           _conversion_stats{};
+    DurationHistogramCounter                    _decoding_time_histogram{};
+    DurationHistogramCounter                    _get_frame_time_histogram{};
+    std::atomic<std::chrono::steady_clock::rep> _waiting_for_packets_time{0}; // In ticks of the steady_clock
+    std::atomic<std::chrono::steady_clock::rep> _waiting_for_frames_time{0};  // In ticks of the steady_clock
+    std::atomic<uint64_t>                       _frames_returned{0};
+    std::atomic<uint64_t>                       _frames_discarded{0};
+    std::atomic<uint64_t>                       _backward_seeks{0};
+    std::atomic<uint64_t>                       _forward_seeks{0};
+    std::atomic<uint64_t>                       _seeks_replayed_from_memory{0};
+    std::atomic<uint64_t>                       _total_errors_count{0}; // Unlike _error_count, never reset
+
+    // Quality
+    std::atomic<DecodingQuality> _decoding_quality{DecodingQuality::Full};
+    DecodingQuality              _applied_decoding_quality{DecodingQuality::Full}; // The one currently set on the _decoder_ctx. Protected by _decoding_context_mutex
+    bool                         _applied_catching_up{false};                      // Protected by _decoding_context_mutex
+
+    // Access pattern
+    std::shared_ptr<DataSource>  _data_source{};                      // nullptr when decoding a file through FFmpeg's own file protocol
+    std::optional<AccessPattern> _access_pattern{};                   // Protected by _seek_mutex: written by make_frame() on the caller's thread, and by seek_to() on either thread
+    bool                         _has_seeked_since_last_frame{false}; // Protected by _seek_mutex
+
+    // Coroutines waiting for a frame
+    std::vector<std::function<void()>> _frame_waiters{};
+    std::mutex                         _frame_waiters_mutex{};
+    std::atomic<uint64_t>              _frames_generation{0}; // Incremented every time the decoding thread notifies the waiters, so that a coroutine can detect that it missed a notification while it was checking the queue
 };
 
 } // namespace ffmpeg
\ No newline at end of file
@@ -0,0 +1,446 @@
+#include "VideoEncoder.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <string>
+#include "utils.hpp"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/buffer.h>
+#include <libavutil/dict.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+
+namespace ffmpeg {
+
+static auto find_encoder(std::string const& name, AVFormatContext const& format_ctx) -> AVCodec const*
+{
+    if (name.empty())
+    {
+        AVCodec const* encoder = avcodec_find_encoder(format_ctx.oformat->video_codec);
+        if (!encoder)
+            throw_error("The container doesn't have a default video codec, you need to specify one");
+        return encoder;
+    }
+    AVCodec const* encoder = avcodec_find_encoder_by_name(name.c_str());
+    if (!encoder)
+        throw_error("Encoder \"" + name + "\" is not available. Check the list given by `ffmpeg -encoders`, some encoders (like libx264) are only available if FFmpeg has been built with them");
+    if (encoder->type != AVMEDIA_TYPE_VIDEO)
+        throw_error("Encoder \"" + name + "\" is not a video encoder");
+    return encoder;
+}
+
+/// Alignment of the rows of the frames that we allocate, for the SIMD code of swscale and of the encoders
+static constexpr int buffers_alignment{32};
+
+/// Creates a pool of buffers big enough for a frame. Padded like the buffers of av_frame_get_buffer(), because some encoders read a bit past the end of the image.
+static auto make_frames_buffers_pool(AVPixelFormat format, int width, int height) -> AVBufferPool*
+{
+    int const size = av_image_get_buffer_size(format, width, height, buffers_alignment);
+    if (size < 0)
+        throw_error("Invalid pixel format", size);
+    AVBufferPool* const pool = av_buffer_pool_init(static_cast<size_t>(size) + AV_INPUT_BUFFER_PADDING_SIZE, &av_buffer_alloc);
+    if (!pool)
+        throw_error("Not enough memory to create the video encoder");
+    return pool;
+}
+
+/// Gives the frame a buffer from the pool. It goes back to the pool once all the references to the frame have been released.
+[[nodiscard]] static auto attach_pooled_buffer(AVFrame& frame, AVBufferPool* pool, AVPixelFormat format, int width, int height) -> int
+{
+    frame.buf[0] = av_buffer_pool_get(pool);
+    if (!frame.buf[0])
+        return AVERROR(ENOMEM);
+    frame.format        = format;
+    frame.width         = width;
+    frame.height        = height;
+    frame.extended_data = frame.data;
+    int const err       = av_image_fill_arrays(frame.data, frame.linesize, frame.buf[0]->data, format, width, height, buffers_alignment);
+    return err < 0 ? err : 0;
+}
+
+VideoEncoder::VideoEncoder(std::filesystem::path const& path, int width, int height, double frames_per_second, AVPixelFormat pixel_format, VideoEncoderOptions const& options)
+    : _pixel_format{pixel_format}
+    , _encoded_pixel_format{options.encoded_pixel_format}
+    , _width{width}
+    , _height{height}
+    , _input_frames{options.max_frames_in_queue}
+    , _converted_frames{options.max_frames_in_queue}
+{
+    if (width <= 0 || height <= 0 || frames_per_second <= 0.)
+        throw_error("The size and the frame rate of the video must be positive");
+
+    _format_ctx            = open_output_format_context(path);
+    AVCodec const* encoder = find_encoder(options.codec, *_format_ctx);
+
+    _encoder_ctx = avcodec_alloc_context3(encoder);
+    if (!_encoder_ctx)
+        throw_error("Not enough memory to create the video encoder");
+    _encoder_ctx->width        = width;
+    _encoder_ctx->height       = height;
+    _encoder_ctx->pix_fmt      = options.encoded_pixel_format;
+    _encoder_ctx->framerate    = av_d2q(frames_per_second, 100'000);
+    _encoder_ctx->time_base    = av_inv_q(_encoder_ctx->framerate);
+    _encoder_ctx->thread_count = options.threads_count;
+    if (options.bit_rate.has_value() && !options.crf.has_value())
+        _encoder_ctx->bit_rate = *options.bit_rate;
+    if (options.keyframes_interval > 0)
+        _encoder_ctx->gop_size = options.keyframes_interval;
+    if (options.max_b_frames.has_value())
+        _encoder_ctx->max_b_frames = *options.max_b_frames;
+    if (_format_ctx->oformat->flags & AVFMT_GLOBALHEADER) // NOLINT(*signed-bitwise)
+        _encoder_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;    // NOLINT(*signed-bitwise)
+
+    {
+        AVDictionary* encoder_options{}; // Private options of the encoder. The ones it doesn't know are just ignored, since not all encoders have presets or a CRF
+        if (!options.preset.empty())
+            av_dict_set(&encoder_options, "preset", options.preset.c_str(), 0);
+        if (options.crf.has_value())
+            av_dict_set(&encoder_options, "crf", std::to_string(*options.crf).c_str(), 0);
+        int const err = avcodec_open2(_encoder_ctx, encoder, &encoder_options);
+        av_dict_free(&encoder_options);
+        if (err < 0)
+            throw_error("Failed to open the video encoder. Make sure it supports the encoded_pixel_format and the size of your video", err);
+    }
+
+    _stream = avformat_new_stream(_format_ctx, nullptr);
+    if (!_stream)
+        throw_error("Not enough memory to create the video stream");
+    _stream->time_base = _encoder_ctx->time_base; // Only a hint, the muxer might change it when writing the header
+    {
+        int const err = avcodec_parameters_from_context(_stream->codecpar, _encoder_ctx);
+        if (err < 0)
+            throw_error("Failed to copy the encoder parameters to the video stream", err);
+    }
+    for (auto const& [key, value] : options.metadata)
+    {
+        int const err = av_dict_set(&_format_ctx->metadata, key.c_str(), value.c_str(), 0);
+        if (err < 0)
+            throw_error("Failed to set the metadata of the video", err);
+    }
+    {
+        int const err = avformat_write_header(_format_ctx, nullptr);
+        if (err < 0)
+            throw_error("Failed to write the header of the video file", err);
+    }
+
+    _sws_ctx = sws_getContext(
+        width, height, pixel_format,
+        width, height, options.encoded_pixel_format,
+        0, nullptr, nullptr, nullptr
+    );
+    if (!_sws_ctx)
+        throw_error("Failed to create conversion context");
+
+    _packet = av_packet_alloc();
+    if (!_packet)
+        throw_error("Not enough memory to create the video encoder");
+
+    _input_buffers          = make_frames_buffers_pool(pixel_format, width, height);
+    _encoded_frames_buffers = make_frames_buffers_pool(options.encoded_pixel_format, width, height);
+
+    {
+        int const size = av_image_get_buffer_size(pixel_format, width, height, 1);
+        if (size < 0)
+            throw_error("Invalid pixel format", size);
+        _frame_size_in_bytes = static_cast<size_t>(size);
+    }
+
+    // Once the contexts are created, we can spawn the threads that will use them and start encoding the frames
+    _muxing_thread     = std::thread{&VideoEncoder::muxing_thread_job, std::ref(*this)};
+    _encoding_thread   = std::thread{&VideoEncoder::encoding_thread_job, std::ref(*this)};
+    _conversion_thread = std::thread{&VideoEncoder::conversion_thread_job, std::ref(*this)};
+}
+
+VideoEncoder::~VideoEncoder()
+{
+    try
+    {
+        finish();
+    }
+    catch (std::exception const& e)
+    {
+        report_frame_decoding_error(e.what());
+    }
+
+    avcodec_free_context(&_encoder_ctx);
+    close_output_format_context(_format_ctx);
+    sws_freeContext(_sws_ctx);
+    av_packet_free(&_packet);
+    av_buffer_pool_uninit(&_input_buffers); // The buffers still attached to some frames are freed when the frames are
+    av_buffer_pool_uninit(&_encoded_frames_buffers);
+}
+
+void VideoEncoder::push_frame(std::span<uint8_t const> pixels)
+{
+    if (pixels.size() != _frame_size_in_bytes)
+        throw_error("The frame has " + std::to_string(pixels.size()) + " bytes, but " + std::to_string(_frame_size_in_bytes) + " were expected. Make sure it has the size and the pixel format that you gave to the VideoEncoder, and that its rows are tightly packed");
+
+    AVFrame* const frame = input_frame_to_fill();
+    {
+        int const err = attach_pooled_buffer(*frame, _input_buffers, _pixel_format, _width, _height);
+        if (err < 0)
+        {
+            _input_frames.recycle(frame);
+            throw_error("Not enough memory to encode the video", err);
+        }
+    }
+
+    std::array<uint8_t*, 4> data{};
+    std::array<int, 4>      linesize{};
+    {
+        int const err = av_image_fill_arrays(data.data(), linesize.data(), pixels.data(), _pixel_format, _width, _height, 1);
+        if (err < 0)
+        {
+            av_frame_unref(frame);
+            _input_frames.recycle(frame);
+            throw_error("Failed to setup image arrays", err);
+        }
+    }
+    av_image_copy(frame->data, frame->linesize, data.data(), linesize.data(), _pixel_format, _width, _height);
+
+    _input_frames.push(frame);
+}
+
+void VideoEncoder::push_frame(AVFrame const& frame)
+{
+    AVFrame* const input_frame = input_frame_to_fill();
+    int const      err         = av_frame_ref(input_frame, &frame);
+    if (err < 0)
+    {
+        _input_frames.recycle(input_frame);
+        throw_error("Not enough memory to encode the video", err);
+    }
+    _input_frames.push(input_frame);
+}
+
+auto VideoEncoder::input_frame_to_fill() -> AVFrame*
+{
+    if (_has_finished)
+        throw_error("Cannot push frames after finish() has been called");
+
+    AVFrame* const frame = _input_frames.get_frame_to_fill(); // Blocks while the pipeline is full
+    if (!frame) // The pipeline has been aborted because one of its stages failed
+    {
+        rethrow_error_if_any();
+        throw_error("The video encoder has stopped");
+    }
+    return frame;
+}
+
+auto VideoEncoder::stats() const -> VideoEncoderStats
+{
+    return {
+        .conversion = _conversion_stats.get(),
+        .encoding   = _encoding_stats.get(),
+        .muxing     = _muxing_stats.get(),
+    };
+}
+
+void VideoEncoder::finish()
+{
+    if (_has_finished)
+        return;
+    _has_finished = true;
+
+    _input_frames.close(); // Each stage finishes once it has processed everything that the previous one gave it
+    _conversion_thread.join();
+    _encoding_thread.join();
+    _muxing_thread.join();
+    rethrow_error_if_any();
+}
+
+void VideoEncoder::conversion_thread_job(VideoEncoder& This)
+{
+    This.run_stage(&VideoEncoder::convert_all_frames);
+}
+
+void VideoEncoder::encoding_thread_job(VideoEncoder& This)
+{
+    This.run_stage(&VideoEncoder::encode_all_frames);
+}
+
+void VideoEncoder::muxing_thread_job(VideoEncoder& This)
+{
+    This.run_stage(&VideoEncoder::mux_all_packets);
+}
+
+void VideoEncoder::run_stage(void (VideoEncoder::*stage)())
+{
+    try
+    {
+        (this->*stage)();
+    }
+    catch (...)
+    {
+        {
+            std::unique_lock lock{_error_mutex};
+            if (!_error) // Only keep the first error, the other stages will most likely fail (or stop) because of it
+                _error = std::current_exception();
+        }
+        abort_pipeline();
+    }
+}
+
+void VideoEncoder::abort_pipeline()
+{
+    _input_frames.abort();
+    _converted_frames.abort();
+    _packets.close(); // Drops the packets that haven't been written yet, and wakes up the encoding thread if it is waiting for room in the queue
+    {
+        std::unique_lock lock{_packets.mutex()}; // Make sure the muxing thread is not between the check of its predicate and the start of its wait, otherwise it would miss the notification
+    }
+    _packets.waiting_for_queue_to_fill_up().notify_all();
+}
+
+void VideoEncoder::rethrow_error_if_any()
+{
+    std::unique_lock lock{_error_mutex};
+    if (_error)
+        std::rethrow_exception(_error);
+}
+
+void VideoEncoder::convert_all_frames()
+{
+    while (AVFrame* const input_frame = _input_frames.pop()) // nullptr once all the frames have been pushed, or if the pipeline has been aborted
+    {
+        AVFrame* const converted_frame = _converted_frames.get_frame_to_fill();
+        if (!converted_frame) // The pipeline has been aborted
+        {
+            av_frame_unref(input_frame);
+            _input_frames.recycle(input_frame);
+            break;
+        }
+
+        auto const start = std::chrono::steady_clock::now();
+        {
+            int const err = attach_pooled_buffer(*converted_frame, _encoded_frames_buffers, _encoded_pixel_format, _width, _height);
+            if (err < 0)
+                throw_error("Not enough memory to encode the video", err);
+        }
+        _sws_ctx = sws_getCachedContext( // Only recreates the context if the frame doesn't have the same size and format as the previous one
+            _sws_ctx,
+            input_frame->width, input_frame->height, static_cast<AVPixelFormat>(input_frame->format),
+            _width, _height, _encoded_pixel_format,
+            0, nullptr, nullptr, nullptr
+        );
+        if (!_sws_ctx)
+            throw_error("Failed to create conversion context");
+        sws_scale(_sws_ctx, input_frame->data, input_frame->linesize, 0, input_frame->height, converted_frame->data, converted_frame->linesize);
+        converted_frame->pts = encoder_timestamp(*input_frame);
+        _conversion_stats.add(std::chrono::steady_clock::now() - start);
+
+        av_frame_unref(input_frame); // Gives the buffer back to its pool (ours, or the one of the decoder that the frame comes from)
+        _input_frames.recycle(input_frame);
+        _converted_frames.push(converted_frame);
+    }
+    _converted_frames.close();
+}
+
+auto VideoEncoder::encoder_timestamp(AVFrame const& input_frame) -> int64_t
+{
+    auto const timestamp = input_frame.best_effort_timestamp != AV_NOPTS_VALUE ? input_frame.best_effort_timestamp : input_frame.pts;
+    auto const pts       = timestamp != AV_NOPTS_VALUE && input_frame.time_base.num > 0 && input_frame.time_base.den > 0
+                               ? av_rescale_q(timestamp, input_frame.time_base, _encoder_ctx->time_base)
+                               : _frames_count++;
+    _previous_pts = std::max(pts, _previous_pts + 1); // Two frames closer than 1 / frames_per_second would get the same timestamp once rounded, which the encoder doesn't accept
+    return _previous_pts;
+}
+
+void VideoEncoder::encode_all_frames()
+{
+    while (AVFrame* const frame = _converted_frames.pop())
+    {
+        encode(frame);
+        av_frame_unref(frame); // The encoder has taken its own reference if it still needs the pixels. The buffer goes back to the pool once it is done with them
+        _converted_frames.recycle(frame);
+    }
+    if (_converted_frames.has_been_aborted())
+        return;
+
+    encode(nullptr); // Get the frames that the encoder was still holding
+    push_packet(nullptr, AVERROR_EOF);
+}
+
+void VideoEncoder::encode(AVFrame const* frame)
+{
+    auto busy_time = std::chrono::steady_clock::duration{}; // Doesn't count the time spent waiting for room in _packets
+    {
+        auto const start = std::chrono::steady_clock::now();
+        int const  err   = avcodec_send_frame(_encoder_ctx, frame);
+        busy_time += std::chrono::steady_clock::now() - start;
+        if (err < 0)
+            throw_error("Error submitting a frame for encoding", err);
+    }
+
+    while (true)
+    {
+        AVPacket* const packet = _packets.get_packet_to_fill();
+        { // Get the packets that the encoder has ready. There can be none (it needs more frames before it can output something), or several
+            auto const start = std::chrono::steady_clock::now();
+            int const  err   = avcodec_receive_packet(_encoder_ctx, packet);
+            busy_time += std::chrono::steady_clock::now() - start;
+            if (err == AVERROR(EAGAIN) || err == AVERROR_EOF)
+            {
+                _packets.recycle(packet);
+                break;
+            }
+            if (err < 0)
+            {
+                _packets.recycle(packet);
+                throw_error("Error while encoding the video", err);
+            }
+        }
+        push_packet(packet, 0);
+    }
+    _encoding_stats.add(busy_time, frame ? 1 : 0);
+}
+
+void VideoEncoder::push_packet(AVPacket* packet, int error)
+{
+    {
+        std::unique_lock lock{_packets.mutex()};
+        _packets.waiting_for_queue_to_empty_out().wait(lock, [&]() { return !_packets.is_full_no_lock() || _packets.is_closed_no_lock(); });
+    }
+    _packets.push(packet, error, 0 /*serial*/); // The queue is never cleared, except when the pipeline gets aborted, in which case the packet is dropped
+}
+
+void VideoEncoder::mux_all_packets()
+{
+    while (true)
+    {
+        PacketRaii packet_raii{_packet}; // Will unref the packet when exiting the scope
+        int        error{};
+        {
+            std::unique_lock lock{_packets.mutex()};
+            _packets.waiting_for_queue_to_fill_up().wait(lock, [&]() { return !_packets.is_empty_no_lock() || _packets.is_closed_no_lock(); });
+            if (_packets.is_closed_no_lock()) // The pipeline has been aborted
+                return;
+            error = _packets.pop_no_lock(_packet);
+        }
+        _packets.waiting_for_queue_to_empty_out().notify_one();
+        if (error == AVERROR_EOF) // The encoder has been flushed, all the packets have been written
+            break;
+
+        auto const start = std::chrono::steady_clock::now();
+        av_packet_rescale_ts(_packet, _encoder_ctx->time_base, _stream->time_base);
+        _packet->stream_index = _stream->index;
+        { // Write the packet to the file
+            int const err = av_interleaved_write_frame(_format_ctx, _packet);
+            if (err < 0)
+                throw_error("Failed to write the video to the file", err);
+        }
+        _muxing_stats.add(std::chrono::steady_clock::now() - start);
+    }
+
+    int const err = av_write_trailer(_format_ctx);
+    if (err < 0)
+        throw_error("Failed to finalize the video file", err);
+}
+
+} // namespace ffmpeg
@@ -0,0 +1,150 @@
+#pragma once
+extern "C"
+{
+#include <libavutil/pixfmt.h>
+}
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include "FramesPipe.hpp"
+#include "PacketsQueue.hpp"
+#include "StageStats.hpp"
+
+struct AVFormatContext;
+struct AVCodecContext;
+struct AVFrame;
+struct AVStream;
+struct AVPacket;
+struct AVBufferPool;
+struct SwsContext;
+
+namespace ffmpeg {
+
+struct VideoEncoderOptions {
+    std::string                        codec{};                                  /// Name of the encoder, as listed by `ffmpeg -encoders` (e.g. "libx264", "libvpx-vp9", "prores_ks"). Empty means the default encoder of the container.
+    std::string                        preset{};                                 /// Speed / size trade-off, for the encoders that have presets (e.g. "ultrafast" to "veryslow" for libx264). Empty means the default of the encoder.
+    std::optional<int>                 crf{};                                    /// Constant Rate Factor: the quality to aim for, for the encoders that support it (lower is better, e.g. from 0 to 51 for libx264). Takes precedence over `bit_rate`.
+    std::optional<int64_t>             bit_rate{};                               /// In bits per second. Leave both `crf` and `bit_rate` empty to use the default of the encoder.
+    int                                keyframes_interval{0};                    /// Maximum number of frames between two keyframes. 1 makes every frame a keyframe (intra-only), which makes seeking instantaneous at the cost of a bigger file. 0 lets the encoder decide.
+    std::optional<int>                 max_b_frames{};                           /// Maximum number of consecutive B-frames (frames that depend on the next frames too). 0 disables them, which makes the frames come out of the encoder in order. Empty lets the encoder decide.
+    int                                threads_count{0};                         /// Number of threads used by the encoder. 0 lets it decide.
+    AVPixelFormat                      encoded_pixel_format{AV_PIX_FMT_YUV420P}; /// Format stored in the file. YUV420P is supported by most encoders and players, but you might want something else for lossless or alpha-aware codecs.
+    size_t                             max_frames_in_queue{8};                   /// How many frames can wait between each stage of the pipeline. push_frame() blocks once that many frames are waiting to be converted.
+    std::map<std::string, std::string> metadata{};                               /// Tags written in the header of the file (e.g. {"title", "My video"}). Most containers only keep the tags they know, ".mkv" keeps all of them.
+};
+
+struct VideoEncoderStats {
+    StageStats conversion{}; /// Conversion of the pushed frames to the size and pixel format of the video
+    StageStats encoding{};
+    StageStats muxing{}; /// Writing of the packets to the file. Counts packets, not frames
+};
+
+/// Encodes frames into a video file.
+/// The work is pipelined over several threads, connected by bounded queues, so that several frames are in flight at the same time:
+///     push_frame() copies the pixels -> a thread converts them to the encoded pixel format -> a thread encodes them (the encoder can also use its own threads) -> a thread writes the packets to the file
+/// push_frame() returns immediately, unless the pipeline is full, which slows the caller down to the speed of the slowest stage.
+/// All the frames and buffers are recycled, so nothing gets allocated per frame once the pipeline is running.
+/// Usage:
+///     auto encoder = ffmpeg::VideoEncoder{"output.mp4", width, height, 30. /*fps*/, AV_PIX_FMT_RGBA, {.codec = "libx264", .crf = 18}};
+///     for (...)
+///         encoder.push_frame(pixels);
+///     encoder.finish(); // Throws if anything went wrong
+class VideoEncoder {
+public:
+    /// Throws a `std::runtime_error` if the creation fails (unknown container / codec not available / options not supported by the codec, etc.)
+    /// The container is deduced from the extension of `path` (e.g. ".mp4", ".mov", ".mkv").
+    /// `pixel_format` is the format of the pixels you will push. For example `AV_PIX_FMT_RGBA` for an RGBA image with 8 bits per channel.
+    VideoEncoder(std::filesystem::path const& path, int width, int height, double frames_per_second, AVPixelFormat pixel_format, VideoEncoderOptions const& options = {});
+    /// Calls finish() if you haven't done it. Errors are then reported to the callback set by set_frame_decoding_error_callback(), since a destructor can't throw.
+    ~VideoEncoder();
+    VideoEncoder(VideoEncoder const&)                        = delete; ///
+    auto operator=(VideoEncoder const&) -> VideoEncoder&     = delete; /// Not allowed to copy nor move the class (because we spawn a thread with a reference to this object)
+    VideoEncoder(VideoEncoder&&) noexcept                    = delete; /// If you need to move it then heap-allocate it, typically in a std::unique_ptr
+    auto operator=(VideoEncoder&&) noexcept -> VideoEncoder& = delete; ///
+
+    /// Copies the pixels, that must be tightly packed (no padding between rows), in the `pixel_format` given to the constructor, and of size frame_size_in_bytes().
+    /// Each frame lasts 1 / frames_per_second.
+    /// Throws if an error occurred on one of the threads of the pipeline.
+    void push_frame(std::span<uint8_t const> pixels);
+    /// Takes a reference to the frame (the pixels are not copied, the frame can be reused as soon as this returns).
+    /// The frame can have any size and pixel format, it gets scaled and converted to the size of the video and to the encoded_pixel_format.
+    /// If you set `frame.time_base` (decoders don't, use the time base of the stream it comes from), the frame keeps its present time (`best_effort_timestamp`, or `pts`), rounded to 1 / frames_per_second. Otherwise each frame lasts 1 / frames_per_second.
+    /// This is what you want to re-encode the frames of a decoder, see Transcoder.
+    /// Throws if an error occurred on one of the threads of the pipeline.
+    void push_frame(AVFrame const& frame);
+
+    /// Waits for all the frames to be encoded, and finalizes the file. No frame can be pushed after that.
+    /// Throws if an error occurred while encoding.
+    void finish();
+
+    [[nodiscard]] auto frame_size_in_bytes() const -> size_t { return _frame_size_in_bytes; }
+    /// How fast each stage of the pipeline is going. Can be called from any thread, while frames are being encoded.
+    [[nodiscard]] auto stats() const -> VideoEncoderStats;
+
+private:
+    static void conversion_thread_job(VideoEncoder& This);
+    static void encoding_thread_job(VideoEncoder& This);
+    static void muxing_thread_job(VideoEncoder& This);
+    /// Runs the stage, and if it fails, remembers the error and aborts the whole pipeline
+    void        run_stage(void (VideoEncoder::*stage)());
+    void        abort_pipeline();
+    void        rethrow_error_if_any();
+    /// Blocks while the pipeline is full. Throws if it has been aborted.
+    [[nodiscard]] auto input_frame_to_fill() -> AVFrame*;
+
+    void convert_all_frames();
+    void encode_all_frames();
+    /// Timestamp of the frame in the time base of the encoder. Only used by the conversion thread.
+    [[nodiscard]] auto encoder_timestamp(AVFrame const& input_frame) -> int64_t;
+    void mux_all_packets();
+    /// Sends the frame to the encoder, and passes all the packets it gives us back to the muxing thread. nullptr flushes the encoder.
+    void encode(AVFrame const* frame);
+    /// Waits for room in _packets. `error` < 0 tells the muxing thread to stop (AVERROR_EOF once everything has been encoded).
+    void push_packet(AVPacket* packet, int error);
+
+private:
+    // Contexts
+    AVFormatContext* _format_ctx{};
+    AVCodecContext*  _encoder_ctx{};
+    SwsContext*      _sws_ctx{};
+    AVStream*        _stream{};
+    AVBufferPool*    _input_buffers{};          // Used by push_frame() to copy the pixels
+    AVBufferPool*    _encoded_frames_buffers{}; // Used by the conversion thread. The encoder keeps a reference to the buffers of the frames it hasn't finished encoding, and they go back to the pool once it releases them
+
+    // Data
+    AVPacket*     _packet{}; // Only used by the muxing thread
+    AVPixelFormat _pixel_format;
+    AVPixelFormat _encoded_pixel_format;
+    int           _width;
+    int           _height;
+    size_t        _frame_size_in_bytes{};
+    int64_t       _frames_count{0};  // Only used by the conversion thread, to timestamp the frames that don't have a timestamp (the ones pushed as pixels)
+    int64_t       _previous_pts{-1}; // Only used by the conversion thread
+    bool          _has_finished{false};
+
+    // Pipeline: push_frame() -> _input_frames -> conversion thread -> _converted_frames -> encoding thread -> _packets -> muxing thread
+    FramesPipe   _input_frames;
+    FramesPipe   _converted_frames;
+    PacketsQueue _packets{};
+
+    // Threads
+    std::thread        _conversion_thread{};
+    std::thread        _encoding_thread{};
+    std::thread        _muxing_thread{};
+    std::exception_ptr _error{}; // The first error that occurred on one of the threads
+    std::mutex         _error_mutex{};
+
+    // Stats
+    StageStatsCounter _conversion_stats{};
+    StageStatsCounter _encoding_stats{};
+    StageStatsCounter _muxing_stats{};
+};
+
+} // namespace ffmpeg
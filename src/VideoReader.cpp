@@ -0,0 +1,118 @@
+#include "VideoReader.hpp"
+#include <algorithm>
+#include <cerrno>
+#include "utils.hpp"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+}
+
+namespace ffmpeg {
+
+VideoReader::VideoReader(Input const& input)
+{
+    _format_ctx       = open_format_context(input);
+    _video_stream_idx = find_video_stream(*_format_ctx);
+    _decoder_ctx      = open_decoder(*video_stream().codecpar);
+
+    _packet = av_packet_alloc();
+    if (!_packet)
+        throw_error("Not enough memory to open the video file");
+}
+
+VideoReader::~VideoReader()
+{
+    avcodec_free_context(&_decoder_ctx);
+    close_format_context(_format_ctx);
+    av_packet_free(&_packet);
+}
+
+auto VideoReader::read_next_frame(AVFrame* frame) -> bool
+{
+    while (true)
+    {
+        { // Check if the decoder already has a frame ready for us (it can buffer a few of them, depending on the codec)
+            int const err = avcodec_receive_frame(_decoder_ctx, frame);
+            if (err >= 0)
+                return true;
+            if (err == AVERROR_EOF) // The decoder has been fully drained, there are no more frames in the file
+                return false;
+            if (err != AVERROR(EAGAIN))
+                throw_error("Error while decoding the video", err);
+        }
+
+        PacketRaii packet_raii{_packet}; // Will unref the packet when exiting the scope
+
+        { // Read data from the file and put it in the packet
+            int const err = av_read_frame(_format_ctx, _packet);
+            if (err == AVERROR_EOF)
+            {
+                if (_is_draining_decoder) // Should never happen, the decoder always ends up returning AVERROR_EOF once it has been drained
+                    return false;
+                _is_draining_decoder = true;
+                avcodec_send_packet(_decoder_ctx, nullptr); // Tells the decoder to output all the frames it still has buffered
+                continue;
+            }
+            if (err < 0)
+                throw_error("Failed to read video packet", err);
+        }
+
+        // Check if the packet belongs to the video stream, otherwise skip it
+        if (_packet->stream_index != _video_stream_idx)
+            continue;
+
+        { // Send the packet to the decoder
+            int const err = avcodec_send_packet(_decoder_ctx, _packet);
+            if (err < 0 && err != AVERROR(EAGAIN))
+                throw_error("Error submitting a video packet for decoding", err);
+        }
+    }
+}
+
+auto VideoReader::seek_to(double time_in_seconds) -> bool
+{
+    auto const timestamp = static_cast<int64_t>(time_in_seconds / av_q2d(video_stream().time_base));
+    int const  err       = avformat_seek_file(_format_ctx, _video_stream_idx, INT64_MIN, timestamp, timestamp, 0);
+    if (err < 0)
+        return false;
+
+    avcodec_flush_buffers(_decoder_ctx);
+    _is_draining_decoder = false;
+    return true;
+}
+
+auto VideoReader::keyframes_times() const -> std::vector<double>
+{
+    AVStream* const stream     = _format_ctx->streams[_video_stream_idx]; // NOLINT(*pointer-arithmetic)
+    int const       nb_entries = avformat_index_get_entries_count(stream);
+    double const    time_base  = av_q2d(stream->time_base);
+    auto            times      = std::vector<double>{};
+    times.reserve(static_cast<size_t>(std::max(nb_entries, 0)));
+    for (int i = 0; i < nb_entries; ++i)
+    {
+        AVIndexEntry const* entry = avformat_index_get_entry(stream, i);
+        if (entry && (entry->flags & AVINDEX_KEYFRAME))
+            times.push_back(static_cast<double>(entry->timestamp) * time_base);
+    }
+    return times; // The index is already sorted by timestamp
+}
+
+auto VideoReader::present_time(AVFrame const& frame) const -> double
+{
+    return static_cast<double>(frame.pts) * av_q2d(video_stream().time_base);
+}
+
+auto VideoReader::duration_in_seconds() const -> double
+{
+    return static_cast<double>(_format_ctx->duration) / static_cast<double>(AV_TIME_BASE);
+}
+
+auto VideoReader::video_stream() const -> AVStream const&
+{
+    return *_format_ctx->streams[_video_stream_idx]; // NOLINT(*pointer-arithmetic)
+}
+
+} // namespace ffmpeg
@@ -0,0 +1,49 @@
+#pragma once
+#include <vector>
+#include "Input.hpp"
+
+struct AVFormatContext;
+struct AVCodecContext;
+struct AVFrame;
+struct AVStream;
+struct AVPacket;
+
+namespace ffmpeg {
+
+/// Demuxer + decoder of the best video stream of an input, without any threading nor queue.
+/// This is the building block of the helpers that need their own independent decoding (batch extraction, etc.), and can't share the one of a VideoDecoder.
+class VideoReader {
+public:
+    /// Throws a `std::runtime_error` if the creation fails (file not found / invalid video file / format not supported, etc.)
+    explicit VideoReader(Input const& input);
+    ~VideoReader();
+    VideoReader(VideoReader const&)                        = delete;
+    auto operator=(VideoReader const&) -> VideoReader&     = delete;
+    VideoReader(VideoReader&&) noexcept                    = delete;
+    auto operator=(VideoReader&&) noexcept -> VideoReader& = delete;
+
+    /// Throws on error
+    /// Returns false once all the frames of the file have been read (this includes the ones that were still buffered inside the decoder).
+    [[nodiscard]] auto read_next_frame(AVFrame* frame) -> bool;
+
+    /// Moves to the closest keyframe before `time_in_seconds`.
+    /// Returns false if seeking failed, in which case the reader stays where it was.
+    auto seek_to(double time_in_seconds) -> bool;
+
+    /// Times of all the keyframes known by the demuxer, sorted.
+    /// Might be empty for formats that don't have an index (in which case you have to seek blindly).
+    [[nodiscard]] auto keyframes_times() const -> std::vector<double>;
+
+    [[nodiscard]] auto present_time(AVFrame const&) const -> double;
+    [[nodiscard]] auto duration_in_seconds() const -> double;
+    [[nodiscard]] auto video_stream() const -> AVStream const&;
+
+private:
+    AVFormatContext* _format_ctx{};
+    AVCodecContext*  _decoder_ctx{};
+    AVPacket*        _packet{};
+    int              _video_stream_idx{};
+    bool             _is_draining_decoder{false};
+};
+
+} // namespace ffmpeg
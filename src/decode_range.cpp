@@ -0,0 +1,267 @@
+#include "decode_range.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <vector>
+#include "FrameConverter.hpp"
+#include "VideoReader.hpp"
+#include "utils.hpp"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+namespace ffmpeg {
+
+namespace {
+
+struct ConvertedFrame {
+    std::vector<uint8_t> data{};
+    int                  width{};
+    int                  height{};
+    double               time_in_seconds{};
+    double               duration_in_seconds{};
+};
+
+/// All the frames whose present time is in [begin, end) are decoded by the same worker
+struct Segment {
+    double begin{};
+    double end{};
+
+    // Reorder buffer: the frames decoded by the worker, waiting for the consumer to reach this segment
+    std::deque<ConvertedFrame> frames{};
+    bool                       is_done{false};
+    std::exception_ptr         error{};
+};
+
+class RangeDecodingJob {
+public:
+    RangeDecodingJob(Input input, std::vector<Segment> segments, AVPixelFormat pixel_format)
+        : _input{std::move(input)}
+        , _segments{std::move(segments)}
+        , _pixel_format{pixel_format}
+    {}
+
+    void run(std::function<void(Frame const&)> const& callback, unsigned int threads_count);
+
+private:
+    void worker_job();
+    void decode_segment(Segment&, FrameConverter&);
+    void push(Segment&, ConvertedFrame&&);
+    auto take_buffer() -> std::vector<uint8_t>;
+    void stop_workers();
+
+private:
+    Input                 _input;
+    std::vector<Segment>  _segments;
+    AVPixelFormat         _pixel_format;
+
+    std::vector<std::thread>          _workers{};
+    std::atomic<size_t>               _next_segment_idx{0};
+    std::atomic<bool>                 _wants_to_stop{false};
+    std::vector<std::vector<uint8_t>> _free_buffers{}; // Recycled after the frames have been given to the callback, so that we don't allocate on every frame
+    std::mutex                        _mutex{};
+    std::condition_variable           _waiting_for_push{};
+    std::condition_variable           _waiting_for_pop{};
+};
+
+} // namespace
+
+/// Max number of frames that a worker decodes ahead of the consumer. This is what bounds the memory usage of the reorder buffer.
+static constexpr size_t max_frames_per_segment_buffer = 8;
+
+void RangeDecodingJob::run(std::function<void(Frame const&)> const& callback, unsigned int threads_count)
+{
+    threads_count = std::clamp(threads_count, 1u, static_cast<unsigned int>(_segments.size()));
+    for (unsigned int i = 0; i < threads_count; ++i)
+        _workers.emplace_back(&RangeDecodingJob::worker_job, this);
+
+    try
+    {
+        for (Segment& segment : _segments)
+        {
+            while (true)
+            {
+                auto frame = ConvertedFrame{};
+                {
+                    std::unique_lock lock{_mutex};
+                    _waiting_for_push.wait(lock, [&]() { return !segment.frames.empty() || segment.is_done; });
+                    if (segment.frames.empty())
+                    {
+                        if (segment.error)
+                            std::rethrow_exception(segment.error);
+                        break; // Move on to the next segment
+                    }
+                    frame = std::move(segment.frames.front());
+                    segment.frames.pop_front();
+                }
+                _waiting_for_pop.notify_all();
+
+                callback(Frame{
+                    .data                             = frame.data.data(),
+                    .width                            = frame.width,
+                    .height                           = frame.height,
+                    .is_different_from_previous_frame = true,
+                    .is_last_frame                    = false,
+                    .time_in_seconds                  = frame.time_in_seconds,
+                    .duration_in_seconds              = frame.duration_in_seconds,
+                });
+
+                std::unique_lock lock{_mutex};
+                _free_buffers.push_back(std::move(frame.data));
+            }
+        }
+    }
+    catch (...)
+    {
+        stop_workers();
+        throw;
+    }
+    stop_workers();
+}
+
+void RangeDecodingJob::stop_workers()
+{
+    _wants_to_stop.store(true);
+    {
+        std::unique_lock lock{_mutex}; // Make sure no worker is between the check of its predicate and the start of its wait, otherwise it would miss the notification
+    }
+    _waiting_for_pop.notify_all();
+    for (std::thread& worker : _workers)
+        worker.join();
+    _workers.clear();
+}
+
+void RangeDecodingJob::worker_job()
+{
+    auto converter = FrameConverter{_pixel_format}; // Each worker needs its own, they cannot be shared between threads
+    while (!_wants_to_stop.load())
+    {
+        size_t const segment_idx = _next_segment_idx.fetch_add(1);
+        if (segment_idx >= _segments.size())
+            break;
+
+        Segment& segment = _segments[segment_idx];
+        try
+        {
+            decode_segment(segment, converter);
+        }
+        catch (...)
+        {
+            std::unique_lock lock{_mutex};
+            segment.error = std::current_exception();
+        }
+        {
+            std::unique_lock lock{_mutex};
+            segment.is_done = true;
+        }
+        _waiting_for_push.notify_all();
+    }
+}
+
+void RangeDecodingJob::decode_segment(Segment& segment, FrameConverter& converter)
+{
+    auto reader = VideoReader{_input};
+    if (segment.begin > 0.)
+        reader.seek_to(segment.begin); // Failing to seek is not a problem, we will just decode (and discard) more frames
+
+    FrameRaii const frame{};
+    while (!_wants_to_stop.load() && reader.read_next_frame(frame.frame))
+    {
+        double const time = reader.present_time(*frame.frame);
+        if (time < segment.begin) // Frames between the keyframe and the beginning of the range, or leading frames that belong to the previous GOP
+            continue;
+        if (time >= segment.end) // The decoder outputs frames in presentation order, so all the next ones will be after the end too
+            break;
+
+        auto converted = ConvertedFrame{
+            .data                = take_buffer(),
+            .width               = frame.frame->width,
+            .height              = frame.frame->height,
+            .time_in_seconds     = time,
+            .duration_in_seconds = frame_duration_in_seconds(*frame.frame, reader.video_stream()),
+        };
+        converter.convert(*frame.frame, converted.data);
+        push(segment, std::move(converted));
+    }
+}
+
+void RangeDecodingJob::push(Segment& segment, ConvertedFrame&& frame)
+{
+    {
+        std::unique_lock lock{_mutex};
+        _waiting_for_pop.wait(lock, [&]() { return segment.frames.size() < max_frames_per_segment_buffer || _wants_to_stop.load(); });
+        if (_wants_to_stop.load())
+            return;
+        segment.frames.push_back(std::move(frame));
+    }
+    _waiting_for_push.notify_all();
+}
+
+auto RangeDecodingJob::take_buffer() -> std::vector<uint8_t>
+{
+    std::unique_lock lock{_mutex};
+    if (_free_buffers.empty())
+        return {};
+    auto buffer = std::move(_free_buffers.back());
+    _free_buffers.pop_back();
+    return buffer;
+}
+
+/// Splits the range at keyframes, so that each segment can be decoded independently.
+static auto make_segments(std::vector<double> const& keyframes_times, double begin, double end, unsigned int threads_count) -> std::vector<Segment>
+{
+    auto boundaries = std::vector<double>{};
+    for (double const keyframe_time : keyframes_times)
+    {
+        if (keyframe_time > begin && keyframe_time < end)
+            boundaries.push_back(keyframe_time);
+    }
+
+    // Having a few more segments than threads balances the work when some GOPs are harder to decode than others, but each segment has the cost of opening the file, so we don't want one per GOP
+    size_t const max_segments_count = 4 * static_cast<size_t>(threads_count);
+    size_t const step               = boundaries.size() / max_segments_count + 1;
+
+    auto segments = std::vector<Segment>{};
+    segments.push_back(Segment{.begin = begin});
+    for (size_t i = step - 1; i < boundaries.size(); i += step)
+    {
+        segments.back().end = boundaries[i];
+        segments.push_back(Segment{.begin = boundaries[i]});
+    }
+    segments.back().end = end;
+    return segments;
+}
+
+void decode_range(
+    Input const&                             input,
+    double                                   begin_in_seconds,
+    double                                   end_in_seconds,
+    AVPixelFormat                            pixel_format,
+    std::function<void(Frame const&)> const& callback,
+    unsigned int                             threads_count
+)
+{
+    threads_count = std::max(threads_count, 1u);
+
+    auto const [keyframes_times, duration] = [&]() { // IIFE
+        auto const reader = VideoReader{input};
+        return std::make_pair(reader.keyframes_times(), reader.duration_in_seconds());
+    }();
+
+    begin_in_seconds = std::max(begin_in_seconds, 0.);
+    if (end_in_seconds >= duration)
+        end_in_seconds = std::numeric_limits<double>::infinity(); // Make sure we don't miss the last frame because of rounding errors in the duration
+    if (begin_in_seconds >= end_in_seconds)
+        return;
+
+    auto job = RangeDecodingJob{input, make_segments(keyframes_times, begin_in_seconds, end_in_seconds, threads_count), pixel_format};
+    job.run(callback, threads_count);
+}
+
+} // namespace ffmpeg
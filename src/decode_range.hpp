@@ -0,0 +1,30 @@
+#pragma once
+extern "C"
+{
+#include <libavutil/pixfmt.h>
+}
+#include <functional>
+#include <thread>
+#include "Frame.hpp"
+#include "Input.hpp"
+
+namespace ffmpeg {
+
+/// Decodes all the frames whose present time is in [begin_in_seconds, end_in_seconds), and calls `callback` on each of them, in order.
+/// This is meant for offline processing (export, analysis, etc.) where you need every single frame and want to get them as fast as possible:
+/// the range is split at keyframes into segments that are decoded in parallel, each by its own demuxer + decoder, on `threads_count` threads.
+/// The frames are then delivered in order, and memory usage stays bounded whatever the length of the range.
+/// Files that have no keyframe index (or with a single GOP in the range) are decoded sequentially.
+/// `callback` is called on the thread that called decode_range(). The `data` of the frame it receives is only valid until the callback returns.
+/// `input` can be a path to a file, a buffer in memory, or your own DataSource.
+/// Throws a `std::runtime_error` if the input cannot be opened or a frame cannot be decoded. Exceptions thrown by `callback` stop the decoding and are propagated.
+void decode_range(
+    Input const&                             input,
+    double                                   begin_in_seconds,
+    double                                   end_in_seconds,
+    AVPixelFormat                            pixel_format,
+    std::function<void(Frame const&)> const& callback,
+    unsigned int                             threads_count = std::thread::hardware_concurrency()
+);
+
+} // namespace ffmpeg
@@ -0,0 +1,575 @@
+#include "remux.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include "Demuxer.hpp"
+#include "utils.hpp"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+namespace ffmpeg {
+
+namespace {
+
+struct RemuxedStream {
+    int               input_index{};
+    AVStream*         output{}; // nullptr if the output container can't store this stream, in which case its packets are dropped
+    TakenPacketsQueue packets{};
+    bool              is_video{};
+    bool              is_sparse{};                 // Subtitles, data, etc. They might not have any packet after the range, so we can't wait for one to know that they are done
+    bool              has_reached_keyframe{false}; // The video packets before the first keyframe can't be decoded without the ones before them, so they are dropped
+    bool              is_done{false};              // Reached the end of the range or of the file. We still drain its packets, otherwise the Demuxer would get stuck waiting for room in its queue
+};
+
+class Remuxer {
+public:
+    Remuxer(Input const& input, std::filesystem::path const& output_path, double begin, double end, RemuxOptions const& options);
+    ~Remuxer();
+    Remuxer(Remuxer const&)                        = delete;
+    auto operator=(Remuxer const&) -> Remuxer&     = delete;
+    Remuxer(Remuxer&&) noexcept                    = delete;
+    auto operator=(Remuxer&&) noexcept -> Remuxer& = delete;
+
+    void run();
+
+private:
+    /// Moves the next packet of any of the streams into _packet, and returns its stream and the error that came with it
+    auto pop_next_packet() -> std::pair<RemuxedStream*, int>;
+    void process_packet(RemuxedStream&, int error);
+    /// Once the demuxing has passed the end of the range, the sparse streams won't have any packet in the range anymore
+    void finish_sparse_streams();
+    /// Keeps the packet if it is in the range
+    void copy_packet(RemuxedStream&, AVPacket*);
+    /// Shifts the timestamps so that the output starts at 0, and writes the packet to the output file
+    void write_packet(RemuxedStream const&, AVPacket*);
+    void hold_until_start_is_known(RemuxedStream&);
+    void start_at(double offset_in_seconds);
+
+    // Re-encoding of the boundaries
+    void buffer_gop_packet(RemuxedStream&);
+    /// Copies the GOP if it is entirely in the range, re-encodes it otherwise. `next_dts` is the decoding timestamp of the packet that comes after the GOP, if any.
+    void finish_gop(RemuxedStream&, std::optional<int64_t> next_dts);
+    void reencode_gop(RemuxedStream&, std::optional<int64_t> next_dts);
+    void decode(RemuxedStream const&, AVPacket const*);
+    void encode(RemuxedStream const&, AVFrame*);
+    void open_encoder(RemuxedStream const&, AVFrame const&);
+    void free_encoder();
+
+    [[nodiscard]] auto input_stream(RemuxedStream const&) const -> AVStream const&;
+    [[nodiscard]] auto present_time(RemuxedStream const&, AVPacket const&) const -> double;
+    [[nodiscard]] auto decoding_time(RemuxedStream const&, AVPacket const&) const -> double;
+
+private:
+    std::unique_ptr<Demuxer>   _demuxer;
+    AVFormatContext*           _format_ctx{};
+    AVPacket*                  _packet{};
+    std::vector<RemuxedStream> _streams{};
+    RemuxedStream*             _main_video{}; // The stream we cut at keyframes (the one that the Demuxer seeks in). nullptr if there is no video stream
+    size_t                     _next_stream_to_pop{0};
+    double                     _begin;
+    double                     _end;
+    bool                       _reencode_boundaries;
+
+    std::optional<double>                             _offset_in_seconds{}; // Time of the input that becomes time 0 of the output. Only known once we have read the first keyframe, unless we re-encode the boundaries
+    std::vector<std::pair<RemuxedStream*, AVPacket*>> _pending_packets{};   // Read before _offset_in_seconds was known
+
+    // Re-encoding of the boundaries
+    std::vector<AVPacket*> _gop{};             // Packets of the main video stream since its last keyframe
+    std::vector<AVPacket*> _encoded_packets{}; // Packets of the GOP that is being re-encoded
+    AVCodecContext*        _decoder_ctx{};
+    AVCodecContext*        _encoder_ctx{};
+    SwsContext*            _sws_ctx{}; // Only used if the encoder doesn't support the pixel format of the decoder
+    AVFrame*               _frame{};
+    AVFrame*               _converted_frame{};
+};
+
+} // namespace
+
+static auto is_keyframe(AVPacket const& packet) -> bool
+{
+    return (packet.flags & AV_PKT_FLAG_KEY) != 0; // NOLINT(*signed-bitwise)
+}
+
+static auto is_supported_by_container(AVFormatContext const& format_ctx, AVCodecParameters const& params) -> bool
+{
+    return avformat_query_codec(format_ctx.oformat, params.codec_id, FF_COMPLIANCE_NORMAL) != 0; // < 0 means that the container doesn't know, so we try anyway
+}
+
+Remuxer::Remuxer(Input const& input, std::filesystem::path const& output_path, double begin, double end, RemuxOptions const& options)
+    : _demuxer{std::make_unique<Demuxer>(input, options.media_types, StreamsSelection::AllOfEachType)}
+    , _begin{begin}
+    , _end{end}
+    , _reencode_boundaries{options.reencode_boundaries}
+{
+    _format_ctx = open_output_format_context(output_path);
+
+    for (AVMediaType const type : options.media_types)
+    {
+        for (int const index : _demuxer->streams_indices(type))
+        {
+            AVStream const& input = _demuxer->stream(index);
+
+            auto stream = RemuxedStream{
+                .input_index = index,
+                .packets     = _demuxer->take_packets(index),
+                .is_video    = type == AVMEDIA_TYPE_VIDEO,
+                .is_sparse   = type != AVMEDIA_TYPE_VIDEO && type != AVMEDIA_TYPE_AUDIO,
+            };
+            if (!is_supported_by_container(*_format_ctx, *input.codecpar))
+            {
+                stream.is_done = true;
+                _streams.push_back(std::move(stream));
+                continue;
+            }
+
+            stream.output = avformat_new_stream(_format_ctx, nullptr);
+            if (!stream.output)
+                throw_error("Not enough memory to create the output streams");
+            {
+                int const err = avcodec_parameters_copy(stream.output->codecpar, input.codecpar);
+                if (err < 0)
+                    throw_error("Failed to copy the parameters of the stream", err);
+            }
+            stream.output->codecpar->codec_tag = 0; // Tags are specific to each container, let the muxer pick the right one
+            stream.output->time_base           = input.time_base;
+            stream.output->sample_aspect_ratio = input.sample_aspect_ratio;
+            stream.output->disposition         = input.disposition;
+            av_dict_copy(&stream.output->metadata, input.metadata, 0);
+            _streams.push_back(std::move(stream));
+        }
+    }
+    if (std::none_of(_streams.begin(), _streams.end(), [](RemuxedStream const& stream) { return stream.output != nullptr; }))
+        throw_error("The output container can't store any of the streams of the input");
+
+    auto const main_video_index = _demuxer->stream_index(AVMEDIA_TYPE_VIDEO);
+    for (RemuxedStream& stream : _streams)
+    {
+        if (main_video_index.has_value() && stream.input_index == *main_video_index && stream.output)
+            _main_video = &stream;
+    }
+    if (_reencode_boundaries && _main_video && !avcodec_find_encoder(input_stream(*_main_video).codecpar->codec_id))
+        throw_error("Cannot re-encode the boundaries, because there is no encoder for the codec of the video. Use the keyframe-aligned cut instead");
+    if (!_main_video || _reencode_boundaries)
+        _offset_in_seconds = _begin;
+
+    {
+        int const err = avformat_write_header(_format_ctx, nullptr);
+        if (err < 0)
+            throw_error("Failed to write the header of the output file", err);
+    }
+
+    _packet = av_packet_alloc();
+    _frame  = av_frame_alloc();
+    if (!_packet || !_frame)
+        throw_error("Not enough memory to remux the file");
+
+    if (_begin > 0.)
+        _demuxer->seek_to(_begin); // If it fails we start from the beginning, and drop the packets that come before the range
+}
+
+Remuxer::~Remuxer()
+{
+    _streams.clear(); // Closes the queues of the streams, which are owned by the Demuxer
+    _demuxer.reset(); // Stop reading before we free the rest
+    for (auto& [stream, packet] : _pending_packets)
+        av_packet_free(&packet);
+    for (AVPacket*& packet : _gop)
+        av_packet_free(&packet);
+    free_encoder();
+    avcodec_free_context(&_decoder_ctx);
+    av_frame_free(&_frame);
+    av_packet_free(&_packet);
+    close_output_format_context(_format_ctx);
+}
+
+void Remuxer::run()
+{
+    while (!std::all_of(_streams.begin(), _streams.end(), [](RemuxedStream const& stream) { return stream.is_done; }))
+    {
+        PacketRaii packet_raii{_packet}; // Will unref the packet when exiting the scope, if we haven't given it to the muxer
+        auto const [stream, error] = pop_next_packet();
+        bool const is_past_end     = error >= 0 && !stream->is_sparse && decoding_time(*stream, *_packet) >= _end; // The Demuxer reads the file in decoding order, so all the packets of the range have been read
+        process_packet(*stream, error);
+        if (is_past_end || (_main_video && _main_video->is_done))
+            finish_sparse_streams();
+    }
+
+    if (!_offset_in_seconds.has_value()) // We never found a keyframe
+        start_at(_begin);
+    if (_main_video && _reencode_boundaries)
+        finish_gop(*_main_video, std::nullopt);
+
+    int const err = av_write_trailer(_format_ctx);
+    if (err < 0)
+        throw_error("Failed to finalize the output file", err);
+}
+
+auto Remuxer::pop_next_packet() -> std::pair<RemuxedStream*, int>
+{
+    while (true)
+    {
+        for (size_t i = 0; i < _streams.size(); ++i)
+        {
+            RemuxedStream& stream = _streams[(_next_stream_to_pop + i) % _streams.size()]; // Round-robin, so that all the queues get drained at the same pace
+            int            error{};
+            {
+                std::unique_lock lock{stream.packets->mutex()};
+                if (stream.packets->is_empty_no_lock())
+                    continue;
+                error = stream.packets->pop_no_lock(_packet);
+            }
+            stream.packets->waiting_for_queue_to_empty_out().notify_one();
+            _next_stream_to_pop = (_next_stream_to_pop + i + 1) % _streams.size();
+            return {&stream, error};
+        }
+
+        // All the queues are empty, wait for the Demuxer to fill one of them
+        PacketsQueue&    packets = *_streams[_next_stream_to_pop].packets;
+        std::unique_lock lock{packets.mutex()};
+        packets.waiting_for_queue_to_fill_up().wait_for(lock, std::chrono::milliseconds{10}, [&]() { return !packets.is_empty_no_lock(); }); // We can't wait on all the queues at once, so we poll the other ones
+    }
+}
+
+void Remuxer::process_packet(RemuxedStream& stream, int error)
+{
+    if (error == AVERROR_EOF)
+    {
+        stream.is_done = true;
+        return;
+    }
+    if (error < 0)
+        throw_error("Failed to read the input", error);
+    if (stream.is_done)
+        return;
+
+    if (stream.is_video && !stream.has_reached_keyframe)
+    {
+        if (!is_keyframe(*_packet))
+            return;
+        stream.has_reached_keyframe = true;
+        if (&stream == _main_video && !_offset_in_seconds.has_value())
+            start_at(present_time(stream, *_packet));
+    }
+    if (!_offset_in_seconds.has_value())
+    {
+        hold_until_start_is_known(stream);
+        return;
+    }
+
+    if (&stream == _main_video && _reencode_boundaries)
+        buffer_gop_packet(stream);
+    else
+        copy_packet(stream, _packet);
+}
+
+void Remuxer::finish_sparse_streams()
+{
+    for (RemuxedStream& stream : _streams)
+    {
+        if (stream.is_sparse)
+            stream.is_done = true;
+    }
+}
+
+void Remuxer::copy_packet(RemuxedStream& stream, AVPacket* packet)
+{
+    if (stream.is_video)
+    {
+        if (decoding_time(stream, *packet) >= _end) // Cut in decoding order, so that all the frames we keep can be decoded
+        {
+            stream.is_done = true;
+            return;
+        }
+    }
+    else
+    {
+        double const time = present_time(stream, *packet);
+        if (time >= _end)
+        {
+            stream.is_done = true;
+            return;
+        }
+        if (time < *_offset_in_seconds) // Read between the keyframe we seeked to and the beginning of the range
+            return;
+    }
+    write_packet(stream, packet);
+}
+
+void Remuxer::write_packet(RemuxedStream const& stream, AVPacket* packet)
+{
+    AVRational const time_base = input_stream(stream).time_base;
+    auto const       offset    = std::llround(*_offset_in_seconds / av_q2d(time_base));
+    if (packet->pts != AV_NOPTS_VALUE)
+        packet->pts -= offset;
+    if (packet->dts != AV_NOPTS_VALUE)
+        packet->dts -= offset;
+    av_packet_rescale_ts(packet, time_base, stream.output->time_base);
+    packet->stream_index = stream.output->index;
+    packet->pos          = -1;
+
+    int const err = av_interleaved_write_frame(_format_ctx, packet);
+    if (err < 0)
+        throw_error("Failed to write to the output file", err);
+}
+
+void Remuxer::hold_until_start_is_known(RemuxedStream& stream)
+{
+    AVPacket* const packet = av_packet_alloc();
+    if (!packet)
+        throw_error("Not enough memory to remux the file");
+    av_packet_move_ref(packet, _packet);
+    _pending_packets.emplace_back(&stream, packet);
+}
+
+void Remuxer::start_at(double offset_in_seconds)
+{
+    _offset_in_seconds = offset_in_seconds;
+    for (auto& [stream, packet] : _pending_packets)
+    {
+        if (!stream->is_done)
+            copy_packet(*stream, packet);
+        av_packet_free(&packet);
+    }
+    _pending_packets.clear();
+}
+
+void Remuxer::buffer_gop_packet(RemuxedStream& stream)
+{
+    if (is_keyframe(*_packet))
+    {
+        finish_gop(stream, _packet->dts);
+        if (present_time(stream, *_packet) >= _end) // The next GOP starts after the range
+        {
+            stream.is_done = true;
+            return;
+        }
+    }
+    AVPacket* const packet = av_packet_alloc();
+    if (!packet)
+        throw_error("Not enough memory to remux the file");
+    av_packet_move_ref(packet, _packet);
+    _gop.push_back(packet);
+}
+
+void Remuxer::finish_gop(RemuxedStream& stream, std::optional<int64_t> next_dts)
+{
+    if (_gop.empty())
+        return;
+
+    bool const starts_before_range = present_time(stream, *_gop.front()) < _begin;
+    bool const ends_after_range    = std::any_of(_gop.begin(), _gop.end(), [&](AVPacket const* packet) { return present_time(stream, *packet) >= _end; });
+    if (starts_before_range || ends_after_range)
+    {
+        reencode_gop(stream, next_dts);
+    }
+    else
+    {
+        for (AVPacket* const packet : _gop)
+            write_packet(stream, packet);
+    }
+
+    for (AVPacket*& packet : _gop)
+        av_packet_free(&packet);
+    _gop.clear();
+}
+
+void Remuxer::reencode_gop(RemuxedStream& stream, std::optional<int64_t> next_dts)
+{
+    if (!_decoder_ctx)
+        _decoder_ctx = open_decoder(*input_stream(stream).codecpar);
+    else
+        avcodec_flush_buffers(_decoder_ctx);
+
+    for (AVPacket const* packet : _gop)
+        decode(stream, packet);
+    decode(stream, nullptr); // Get the frames that the decoder was still holding
+    if (_encoder_ctx)
+        encode(stream, nullptr);
+    free_encoder(); // A flushed encoder can't be reused, the next GOP that needs it will get a new one
+
+    // The encoder doesn't use B-frames, so its packets come in presentation order and their decoding timestamps could be equal or greater than the ones of the copied packets that follow. Move them back so that they stay strictly increasing.
+    size_t const count = _encoded_packets.size();
+    for (size_t i = 0; i < count; ++i)
+    {
+        AVPacket*& packet = _encoded_packets[i];
+        if (next_dts.has_value() && *next_dts != AV_NOPTS_VALUE)
+            packet->dts = std::min(packet->pts, *next_dts - static_cast<int64_t>(count - i));
+        write_packet(stream, packet);
+        av_packet_free(&packet);
+    }
+    _encoded_packets.clear();
+}
+
+void Remuxer::decode(RemuxedStream const& stream, AVPacket const* packet)
+{
+    {
+        int const err = avcodec_send_packet(_decoder_ctx, packet);
+        if (err < 0 && err != AVERROR_EOF)
+            throw_error("Error while decoding the video", err);
+    }
+
+    int64_t const keyframe_pts = _gop.front()->pts;
+    while (true)
+    {
+        {
+            int const err = avcodec_receive_frame(_decoder_ctx, _frame);
+            if (err == AVERROR(EAGAIN) || err == AVERROR_EOF)
+                return;
+            if (err < 0)
+                throw_error("Error while decoding the video", err);
+        }
+
+        _frame->pts       = _frame->best_effort_timestamp;
+        double const time = static_cast<double>(_frame->pts) * av_q2d(input_stream(stream).time_base);
+        if (time >= _begin && time < _end && (keyframe_pts == AV_NOPTS_VALUE || _frame->pts >= keyframe_pts)) // Skip the frames out of the range, and the leading frames of an open GOP, which can't be decoded properly without the previous GOP
+            encode(stream, _frame);
+        av_frame_unref(_frame);
+    }
+}
+
+void Remuxer::encode(RemuxedStream const& stream, AVFrame* frame)
+{
+    AVFrame const* frame_to_encode = frame;
+    if (frame)
+    {
+        if (!_encoder_ctx)
+            open_encoder(stream, *frame);
+        frame->pict_type = AV_PICTURE_TYPE_NONE; // Let the encoder choose, instead of copying the type that the frame had in the input
+        if (_sws_ctx)
+        {
+            int const err = av_frame_make_writable(_converted_frame); // The encoder might still be referencing the previous frame
+            if (err < 0)
+                throw_error("Not enough memory to remux the file", err);
+            sws_scale(_sws_ctx, frame->data, frame->linesize, 0, frame->height, _converted_frame->data, _converted_frame->linesize);
+            _converted_frame->pts = frame->pts;
+            frame_to_encode       = _converted_frame;
+        }
+    }
+
+    {
+        int const err = avcodec_send_frame(_encoder_ctx, frame_to_encode);
+        if (err < 0)
+            throw_error("Error submitting a frame for encoding", err);
+    }
+    while (true)
+    {
+        AVPacket* packet = av_packet_alloc();
+        if (!packet)
+            throw_error("Not enough memory to remux the file");
+        int const err = avcodec_receive_packet(_encoder_ctx, packet);
+        if (err < 0)
+        {
+            av_packet_free(&packet);
+            if (err == AVERROR(EAGAIN) || err == AVERROR_EOF)
+                return;
+            throw_error("Error while encoding the video", err);
+        }
+        _encoded_packets.push_back(packet);
+    }
+}
+
+void Remuxer::open_encoder(RemuxedStream const& stream, AVFrame const& frame)
+{
+    AVStream const&     input   = input_stream(stream);
+    AVCodec const*      encoder = avcodec_find_encoder(input.codecpar->codec_id);
+    AVPixelFormat const format  = [&]() { // IIFE
+        auto const* formats = static_cast<AVPixelFormat const*>(nullptr);
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(61, 13, 100) // avcodec_get_supported_config() was added in FFmpeg 7.1, and AVCodec::pix_fmts deprecated
+        int count{};
+        if (avcodec_get_supported_config(nullptr, encoder, AV_CODEC_CONFIG_PIX_FORMAT, 0, reinterpret_cast<void const**>(&formats), &count) < 0) // NOLINT(*reinterpret-cast)
+            formats = nullptr;
+#else
+        formats = encoder->pix_fmts;
+#endif
+        if (!formats)
+            return static_cast<AVPixelFormat>(frame.format); // Supports everything
+        return avcodec_find_best_pix_fmt_of_list(formats, static_cast<AVPixelFormat>(frame.format), 0, nullptr);
+    }();
+
+    _encoder_ctx = avcodec_alloc_context3(encoder);
+    if (!_encoder_ctx)
+        throw_error("Not enough memory to create the video encoder");
+    _encoder_ctx->width               = frame.width;
+    _encoder_ctx->height              = frame.height;
+    _encoder_ctx->pix_fmt             = format;
+    _encoder_ctx->sample_aspect_ratio = frame.sample_aspect_ratio;
+    _encoder_ctx->color_range         = input.codecpar->color_range;
+    _encoder_ctx->color_primaries     = input.codecpar->color_primaries;
+    _encoder_ctx->color_trc           = input.codecpar->color_trc;
+    _encoder_ctx->colorspace          = input.codecpar->color_space;
+    _encoder_ctx->time_base           = input.time_base;
+    _encoder_ctx->framerate           = input.avg_frame_rate;
+    _encoder_ctx->max_b_frames        = 0; // So that the packets come out in presentation order, see reencode_gop()
+    if (input.codecpar->bit_rate > 0)
+        _encoder_ctx->bit_rate = input.codecpar->bit_rate;
+    {
+        int const err = avcodec_open2(_encoder_ctx, encoder, nullptr);
+        if (err < 0)
+            throw_error("Failed to open the encoder to re-encode the boundaries", err);
+    }
+
+    if (format == frame.format)
+        return;
+    _sws_ctx = sws_getContext(
+        frame.width, frame.height, static_cast<AVPixelFormat>(frame.format),
+        frame.width, frame.height, format,
+        SWS_BICUBIC, nullptr, nullptr, nullptr
+    );
+    _converted_frame = av_frame_alloc();
+    if (!_sws_ctx || !_converted_frame)
+        throw_error("Failed to create conversion context");
+    _converted_frame->format = format;
+    _converted_frame->width  = frame.width;
+    _converted_frame->height = frame.height;
+    int const err            = av_frame_get_buffer(_converted_frame, 0);
+    if (err < 0)
+        throw_error("Not enough memory to remux the file", err);
+}
+
+void Remuxer::free_encoder()
+{
+    avcodec_free_context(&_encoder_ctx);
+    sws_freeContext(_sws_ctx);
+    _sws_ctx = nullptr;
+    av_frame_free(&_converted_frame);
+    for (AVPacket*& packet : _encoded_packets)
+        av_packet_free(&packet);
+    _encoded_packets.clear();
+}
+
+auto Remuxer::input_stream(RemuxedStream const& stream) const -> AVStream const&
+{
+    return _demuxer->stream(stream.input_index);
+}
+
+auto Remuxer::present_time(RemuxedStream const& stream, AVPacket const& packet) const -> double
+{
+    int64_t const timestamp = packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts;
+    return static_cast<double>(timestamp) * av_q2d(input_stream(stream).time_base);
+}
+
+auto Remuxer::decoding_time(RemuxedStream const& stream, AVPacket const& packet) const -> double
+{
+    int64_t const timestamp = packet.dts != AV_NOPTS_VALUE ? packet.dts : packet.pts;
+    return static_cast<double>(timestamp) * av_q2d(input_stream(stream).time_base);
+}
+
+void remux(Input const& input, std::filesystem::path const& output_path, double begin_in_seconds, double end_in_seconds, RemuxOptions const& options)
+{
+    if (end_in_seconds <= begin_in_seconds)
+        throw_error("The end of the range must be after its beginning");
+    auto remuxer = Remuxer{input, output_path, begin_in_seconds, end_in_seconds, options};
+    remuxer.run();
+}
+
+} // namespace ffmpeg
@@ -0,0 +1,36 @@
+#pragma once
+#include <filesystem>
+#include <vector>
+#include "Input.hpp"
+
+extern "C"
+{
+#include <libavutil/avutil.h> // Must come after the standard headers, otherwise it complains that __STDC_CONSTANT_MACROS is not defined
+}
+
+namespace ffmpeg {
+
+struct RemuxOptions {
+    std::vector<AVMediaType> media_types{AVMEDIA_TYPE_VIDEO, AVMEDIA_TYPE_AUDIO, AVMEDIA_TYPE_SUBTITLE}; /// All the streams of these types are copied, except the ones that the output container can't store.
+    bool                     reencode_boundaries{false};                                                 /// Re-encodes the GOPs that contain `begin_in_seconds` and `end_in_seconds`, so that the cut is exact instead of keyframe-aligned. All the other GOPs are still copied. See the NB of remux().
+};
+
+/// Copies the packets whose present time is in [begin_in_seconds, end_in_seconds) into a new file, without decoding nor re-encoding them.
+/// This is the way to trim a clip: it runs at the speed of the disk and doesn't lose any quality.
+/// Since a video can only start at a keyframe, the output actually starts at the keyframe just before `begin_in_seconds`, and its timestamps are shifted so that this keyframe is at time 0.
+/// The video is cut at the end in decoding order, so that all the frames that are kept can be decoded: with B-frames, a few frames after `end_in_seconds` might be kept.
+/// The container is deduced from the extension of `output_path` (e.g. ".mp4", ".mov", ".mkv").
+/// `input` can be a path to a file, a buffer in memory, or your own DataSource.
+/// Throws a `std::runtime_error` if the input cannot be opened / read, or if the output cannot be written.
+/// NB: with `reencode_boundaries`, the output starts exactly at `begin_in_seconds`. The re-encoded packets are inserted in a stream whose parameters (and headers) are copied from the input,
+/// so this only works with codecs whose encoder produces packets that a decoder configured for the original stream can read (intra-only codecs like ProRes or MJPEG, MPEG-4 Part 2, etc.).
+/// With codecs like H.264 the re-encoded GOPs would most likely not be decodable, so keep the default keyframe-aligned cut.
+void remux(
+    Input const&                 input,
+    std::filesystem::path const& output_path,
+    double                       begin_in_seconds,
+    double                       end_in_seconds,
+    RemuxOptions const&          options = {}
+);
+
+} // namespace ffmpeg
@@ -0,0 +1,266 @@
+#include "test_video.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "VideoEncoder.hpp"
+#include "utils.hpp"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/pixfmt.h>
+}
+
+namespace ffmpeg {
+
+// The index is written twice: as is on a first row of blocks, and with all its bits flipped on a second row, so that we can tell when a frame is not readable.
+static constexpr int bits_count{16};
+
+/// Size of the blocks that represent the bits. A multiple of 8 pixels, so that the blocks are aligned with the blocks of the codecs, and stay sharp after compression.
+static auto block_size(int width) -> int
+{
+    return std::max(8, width / bits_count / 8 * 8);
+}
+
+/// The two rows of blocks must fit in the frame
+static auto has_room_for_the_index(int width, int height) -> bool
+{
+    return width >= bits_count * 8 && height >= 2 * block_size(width);
+}
+
+/// Returns the bit represented by the pixel, or nullopt if it is outside of the two rows of blocks.
+static auto bit_at(int x, int y, int block) -> std::optional<int>
+{
+    if (y >= 2 * block || x >= bits_count * block)
+        return std::nullopt;
+    return x / block;
+}
+
+static void draw_frame(std::vector<uint8_t>& pixels, int width, int height, int frame_index)
+{
+    int const  block = block_size(width);
+    auto const index = static_cast<unsigned int>(frame_index);
+    auto       i     = size_t{0};
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            if (auto const bit = bit_at(x, y, block))
+            {
+                bool const    is_complement_row = y >= block;
+                bool const    is_set            = ((index >> static_cast<unsigned int>(*bit)) & 1U) != (is_complement_row ? 1U : 0U);
+                uint8_t const value             = is_set ? 255 : 0;
+                pixels[i++]                     = value;
+                pixels[i++]                     = value;
+                pixels[i++]                     = value;
+            }
+            else
+            {
+                pixels[i++] = static_cast<uint8_t>(x + 4 * frame_index);
+                pixels[i++] = static_cast<uint8_t>(y + 2 * frame_index);
+                pixels[i++] = static_cast<uint8_t>((x ^ y) + frame_index);
+            }
+            pixels[i++] = 255;
+        }
+    }
+}
+
+static constexpr int audio_sample_rate{48000};
+
+/// Writes a mono WAV file with 16-bit samples
+static void write_test_audio(std::filesystem::path const& path, TestVideoOptions const& options)
+{
+    auto const samples_count = static_cast<uint32_t>(std::lround(options.duration_in_seconds * audio_sample_rate));
+    auto       bytes         = std::vector<uint8_t>{};
+    auto const write         = [&](uint32_t value, int bytes_count) { // Little-endian, as WAV requires
+        for (int i = 0; i < bytes_count; ++i)
+            bytes.push_back(static_cast<uint8_t>(value >> (8U * static_cast<unsigned int>(i))));
+    };
+    auto const write_tag = [&](char const* tag) {
+        bytes.insert(bytes.end(), tag, tag + 4); // NOLINT(*pointer-arithmetic)
+    };
+    write_tag("RIFF");
+    write(36 + 2 * samples_count, 4);
+    write_tag("WAVE");
+    write_tag("fmt ");
+    write(16, 4);                    // Size of the format chunk
+    write(1, 2);                     // PCM
+    write(1, 2);                     // Channels count
+    write(audio_sample_rate, 4);     //
+    write(2 * audio_sample_rate, 4); // Bytes per second
+    write(2, 2);                     // Bytes per sample frame
+    write(16, 2);                    // Bits per sample
+    write_tag("data");
+    write(2 * samples_count, 4);
+    for (uint32_t i = 0; i < samples_count; ++i)
+        write(static_cast<uint32_t>(std::lround(32767. * test_audio_sample_at(i / static_cast<double>(audio_sample_rate), options))), 2);
+
+    auto file = std::ofstream{path, std::ios::binary};
+    file.write(reinterpret_cast<char const*>(bytes.data()), static_cast<std::streamsize>(bytes.size())); // NOLINT(*reinterpret-cast)
+    if (!file)
+        throw_error("Failed to write the audio of the test video to " + path.string());
+}
+
+/// Copies the stream of each of the `inputs` (which have been written by us, with a single stream) into its own stream of the output, without re-encoding them
+static void mux_into_one_file(std::vector<std::filesystem::path> const& inputs, std::filesystem::path const& output_path)
+{
+    struct Contexts { // NOLINT(*special-member-functions)
+        std::vector<AVFormatContext*> inputs{};
+        AVFormatContext*              output{};
+        AVPacket*                     packet{};
+
+        ~Contexts()
+        {
+            for (AVFormatContext*& input : inputs)
+                close_format_context(input);
+            close_output_format_context(output);
+            av_packet_free(&packet);
+        }
+    } contexts{};
+
+    for (std::filesystem::path const& input : inputs)
+        contexts.inputs.push_back(open_format_context(input));
+    contexts.output = open_output_format_context(output_path);
+    for (AVFormatContext const* input : contexts.inputs)
+    {
+        AVStream const& input_stream  = *input->streams[0]; // NOLINT(*pointer-arithmetic)
+        AVStream* const output_stream = avformat_new_stream(contexts.output, nullptr);
+        if (!output_stream)
+            throw_error("Not enough memory to create the test video");
+        int const err = avcodec_parameters_copy(output_stream->codecpar, input_stream.codecpar);
+        if (err < 0)
+            throw_error("Failed to copy the parameters of the stream", err);
+        output_stream->codecpar->codec_tag = 0; // Let the output container pick its own tag
+        output_stream->time_base           = input_stream.time_base;
+    }
+    {
+        int const err = avformat_write_header(contexts.output, nullptr);
+        if (err < 0)
+            throw_error("Failed to write the header of the test video", err);
+    }
+
+    contexts.packet = av_packet_alloc();
+    if (!contexts.packet)
+        throw_error("Not enough memory to create the test video");
+    auto has_reached_end = std::vector<bool>(inputs.size(), false);
+    while (std::find(has_reached_end.begin(), has_reached_end.end(), false) != has_reached_end.end())
+    {
+        for (size_t i = 0; i < inputs.size(); ++i) // Take one packet of each input in turn, so that the streams are interleaved
+        {
+            if (has_reached_end[i])
+                continue;
+            int err = av_read_frame(contexts.inputs[i], contexts.packet);
+            if (err == AVERROR_EOF)
+            {
+                has_reached_end[i] = true;
+                continue;
+            }
+            if (err < 0)
+                throw_error("Failed to read the test video", err);
+            av_packet_rescale_ts(contexts.packet, contexts.inputs[i]->streams[0]->time_base, contexts.output->streams[i]->time_base); // NOLINT(*pointer-arithmetic)
+            contexts.packet->stream_index = static_cast<int>(i);
+            contexts.packet->pos          = -1;
+            err                           = av_interleaved_write_frame(contexts.output, contexts.packet); // Takes ownership of the content of the packet
+            if (err < 0)
+                throw_error("Failed to write the test video", err);
+        }
+    }
+    int const err = av_write_trailer(contexts.output);
+    if (err < 0)
+        throw_error("Failed to finish writing the test video", err);
+}
+
+void generate_test_video(std::filesystem::path const& path, TestVideoOptions const& options)
+{
+    if (options.video_streams_count < 1)
+        throw_error("The test video must have at least one video stream");
+    if (options.video_streams_count > 1 || options.has_audio)
+    {
+        // Each stream is encoded in its own file, and then they are all copied into the final one
+        auto const stream_path = [&](std::string const& name) {
+            return std::filesystem::path{path}.replace_filename(path.stem().string() + "_" + name);
+        };
+        auto streams_paths = std::vector<std::filesystem::path>{};
+        for (int i = 0; i < options.video_streams_count; ++i)
+        {
+            auto stream_options                = options;
+            stream_options.video_streams_count = 1;
+            stream_options.has_audio           = false;
+            stream_options.keyframes_interval  = (i + 1) * options.keyframes_interval;
+            streams_paths.push_back(stream_path("stream_" + std::to_string(i) + ".mkv"));
+            generate_test_video(streams_paths.back(), stream_options);
+        }
+        if (options.has_audio)
+        {
+            streams_paths.push_back(stream_path("audio.wav"));
+            write_test_audio(streams_paths.back(), options);
+        }
+        mux_into_one_file(streams_paths, path);
+        for (std::filesystem::path const& stream_path : streams_paths)
+            std::filesystem::remove(stream_path);
+        return;
+    }
+
+    if (!has_room_for_the_index(options.width, options.height))
+        throw_error("The test video is too small to have room for the index of the frames: it must be at least 128 pixels wide, and at least " + std::to_string(2 * block_size(options.width)) + " pixels high for that width");
+    if (options.frames_per_second <= 0. || options.duration_in_seconds <= 0.)
+        throw_error("The frame rate and the duration of the test video must be positive");
+    auto const frames_count = static_cast<int>(std::lround(options.frames_per_second * options.duration_in_seconds));
+    if (frames_count >= (1 << bits_count))
+        throw_error("The test video can have at most " + std::to_string((1 << bits_count) - 1) + " frames");
+
+    auto encoder = VideoEncoder{
+        path, options.width, options.height, options.frames_per_second, AV_PIX_FMT_RGBA,
+        {
+            .codec                = options.codec,
+            .keyframes_interval   = options.keyframes_interval,
+            .max_b_frames         = options.max_b_frames,
+            .threads_count        = 1, // Makes sure the output is the same from one machine to another
+            .encoded_pixel_format = options.codec == "mjpeg" ? AV_PIX_FMT_YUVJ420P : AV_PIX_FMT_YUV420P,
+        }
+    };
+    auto pixels = std::vector<uint8_t>(encoder.frame_size_in_bytes());
+    for (int frame_index = 0; frame_index < frames_count; ++frame_index)
+    {
+        draw_frame(pixels, options.width, options.height, frame_index);
+        encoder.push_frame(pixels);
+    }
+    encoder.finish();
+}
+
+auto test_audio_sample_at(double time_in_seconds, TestVideoOptions const& options) -> float
+{
+    return static_cast<float>(std::clamp(time_in_seconds / options.duration_in_seconds, 0., 1.));
+}
+
+auto read_test_video_frame_index(Frame const& frame) -> std::optional<int>
+{
+    if (!frame.data || !has_room_for_the_index(frame.width, frame.height))
+        return std::nullopt;
+
+    int const  block    = block_size(frame.width);
+    auto const is_white = [&](int bit, int row) {
+        auto const  x     = static_cast<size_t>(bit * block + block / 2); // Read the center of the block, its edges might be blurred by the compression
+        auto const  y     = static_cast<size_t>(row * block + block / 2);
+        auto const* pixel = frame.data + 4 * (y * static_cast<size_t>(frame.width) + x); // NOLINT(*pointer-arithmetic)
+        return pixel[0] + pixel[1] + pixel[2] > 3 * 128;                                 // NOLINT(*pointer-arithmetic)
+    };
+
+    unsigned int index{0};
+    for (int bit = 0; bit < bits_count; ++bit)
+    {
+        bool const value = is_white(bit, 0);
+        if (value == is_white(bit, 1)) // The complement row must have the opposite bit
+            return std::nullopt;
+        if (value)
+            index |= 1U << static_cast<unsigned int>(bit);
+    }
+    return static_cast<int>(index);
+}
+
+} // namespace ffmpeg
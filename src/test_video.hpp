@@ -0,0 +1,34 @@
+#pragma once
+#include <filesystem>
+#include <optional>
+#include <string>
+#include "Frame.hpp"
+
+namespace ffmpeg {
+
+struct TestVideoOptions {
+    std::string codec{"mpeg4"};          /// Name of the encoder, as listed by `ffmpeg -encoders` (e.g. "libx264", "mpeg4", "mjpeg", "ffv1"). Make sure the container (deduced from the extension of the path) supports it, ".mkv" supports all of them.
+    int         width{640};              /// At least 128
+    int         height{360};             /// At least twice the size of the blocks that encode the frame index, which is width / 16 rounded down to a multiple of 8 (and at least 8). E.g. at least 16 for a width of 128, and 240 for a width of 1920.
+    double      frames_per_second{30.};  ///
+    double      duration_in_seconds{5.}; ///
+    int         keyframes_interval{30};  /// 1 makes every frame a keyframe. 0 lets the encoder decide.
+    int         max_b_frames{0};         /// Number of consecutive B-frames, to test the decoding of frames that don't come out of the decoder in order. Not all codecs support them (e.g. MJPEG and FFV1 don't).
+    int         video_streams_count{1};  /// To test files with several video streams (multi-camera files, etc.). They all show the same frames, but stream `i` has a keyframe every `(i + 1) * keyframes_interval` frames, so that their keyframes are not aligned. The container must support several streams (".mkv" does).
+    bool        has_audio{false};        /// Adds a mono 48 kHz PCM audio stream, whose samples go linearly from 0 at the beginning of the video to 1 at the end, so that you can tell which time a sample comes from (see test_audio_sample_at()).
+};
+
+/// Encodes a video that is always the same for the same options, so that you can test and benchmark decoding on any machine, without shipping big video files.
+/// Each frame shows its index as a row of black and white blocks (one per bit) at the top of the image, that survive compression, and that read_test_video_frame_index() can read back. So you can check that seeking to a given time gives you the right frame.
+/// The rest of the image is a moving pattern, so that the video is not trivial to compress (nor to decode).
+/// Throws a `std::runtime_error` if the encoder is not available, or doesn't support the options.
+void generate_test_video(std::filesystem::path const& path, TestVideoOptions const& options = {});
+
+/// Reads the index of a frame of a video generated by generate_test_video(). The frame must be in AV_PIX_FMT_RGBA, and have the size of the generated video.
+/// Returns nullopt if the blocks are not readable (e.g. if the frame doesn't come from such a video, or has been damaged too much by the compression).
+[[nodiscard]] auto read_test_video_frame_index(Frame const& frame) -> std::optional<int>;
+
+/// Value, between 0 and 1, of the audio sample at `time_in_seconds` in a video generated by generate_test_video() with `has_audio`.
+[[nodiscard]] auto test_audio_sample_at(double time_in_seconds, TestVideoOptions const& options) -> float;
+
+} // namespace ffmpeg
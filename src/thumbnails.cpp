@@ -0,0 +1,131 @@
+#include "thumbnails.hpp"
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <future>
+#include <limits>
+#include <optional>
+#include <thread>
+#include "FrameConverter.hpp"
+#include "VideoReader.hpp"
+#include "utils.hpp"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+namespace ffmpeg {
+
+/// Takes ownership of `frame`
+static void convert_to_thumbnail(AVFrame* frame, Thumbnail& thumbnail, AVPixelFormat pixel_format)
+{
+    FrameRaii const frame_raii{frame}; // Will free the frame when exiting the scope
+    auto            converter = FrameConverter{pixel_format, SWS_BILINEAR}; // Each conversion runs on its own thread, and a converter cannot be shared between threads, so each of them creates its own
+    converter.convert(*frame, thumbnail.width, thumbnail.height, thumbnail.data);
+}
+
+/// Returns the time of the last keyframe that is before `time_in_seconds`
+static auto keyframe_before(std::vector<double> const& keyframes_times, double time_in_seconds) -> std::optional<double>
+{
+    auto const it = std::upper_bound(keyframes_times.begin(), keyframes_times.end(), time_in_seconds);
+    if (it == keyframes_times.begin())
+        return std::nullopt;
+    return *std::prev(it);
+}
+
+auto extract_thumbnails(
+    Input const&                 input,
+    std::vector<double> const&   times_in_seconds,
+    int width, int height,
+    AVPixelFormat pixel_format
+) -> std::vector<Thumbnail>
+{
+    assert(std::is_sorted(times_in_seconds.begin(), times_in_seconds.end()));
+    auto thumbnails = std::vector<Thumbnail>(times_in_seconds.size());
+    if (times_in_seconds.empty())
+        return thumbnails;
+
+    auto       reader          = VideoReader{input};
+    auto const keyframes_times = reader.keyframes_times();
+
+    // We always keep the frame that comes after the current one, because that is how we know that the current one is the one visible at a given time
+    FrameRaii current{};
+    FrameRaii next{};
+    bool has_current{false};
+    bool has_next{false};
+
+    auto const max_conversions_in_flight = std::max(std::thread::hardware_concurrency(), 1u);
+    auto       conversions               = std::deque<std::future<void>>{};
+    auto       is_duplicate              = std::vector<bool>(times_in_seconds.size(), false);
+
+    for (size_t i = 0; i < times_in_seconds.size(); ++i)
+    {
+        double const time_in_seconds = std::clamp(times_in_seconds[i], 0., reader.duration_in_seconds());
+
+        bool const should_seek = [&]() { // IIFE
+            auto const current_time = has_current ? reader.present_time(*current.frame) : -std::numeric_limits<double>::infinity();
+            if (keyframes_times.empty()) // We don't know where the keyframes are, so use the same heuristic as the VideoDecoder
+                return time_in_seconds - std::max(current_time, 0.) > 1.;
+
+            auto const keyframe = keyframe_before(keyframes_times, time_in_seconds);
+            if (!keyframe.has_value())
+                return false;
+            if (!has_current) // We are at the beginning of the file
+                return *keyframe > keyframes_times.front();
+            return *keyframe > current_time; // Otherwise the target is in the GOP that we are currently decoding, and reading forward is cheaper than seeking back to its keyframe
+        }();
+
+        if (should_seek && reader.seek_to(time_in_seconds))
+        {
+            has_current = false;
+            has_next    = false;
+        }
+
+        if (!has_current)
+        {
+            has_current = reader.read_next_frame(current.frame);
+            if (!has_current)
+                throw_error("Could not read any frame from the file");
+            has_next = reader.read_next_frame(next.frame);
+        }
+        while (has_next && reader.present_time(*next.frame) <= time_in_seconds)
+        {
+            std::swap(current.frame, next.frame);
+            has_next = reader.read_next_frame(next.frame);
+        }
+
+        thumbnails[i].width           = width;
+        thumbnails[i].height          = height;
+        thumbnails[i].time_in_seconds = reader.present_time(*current.frame);
+        if (i > 0 && thumbnails[i].time_in_seconds == thumbnails[i - 1].time_in_seconds) // NOLINT(*float-equal)
+        {
+            is_duplicate[i] = true; // No need to convert the same frame twice, we will copy the previous thumbnail once it is ready
+            continue;
+        }
+
+        if (conversions.size() >= max_conversions_in_flight)
+        {
+            conversions.front().get(); // Will rethrow any exception that occurred during the conversion
+            conversions.pop_front();
+        }
+        AVFrame* const frame_to_convert = av_frame_clone(current.frame); // Only adds a reference to the frame's buffers, no copy
+        if (!frame_to_convert)
+            throw_error("Not enough memory to extract the thumbnails");
+        conversions.push_back(std::async(std::launch::async, &convert_to_thumbnail, frame_to_convert, std::ref(thumbnails[i]), pixel_format));
+    }
+
+    for (auto& conversion : conversions)
+        conversion.get();
+    for (size_t i = 1; i < thumbnails.size(); ++i)
+    {
+        if (is_duplicate[i])
+            thumbnails[i].data = thumbnails[i - 1].data;
+    }
+
+    return thumbnails;
+}
+
+} // namespace ffmpeg
@@ -0,0 +1,31 @@
+#pragma once
+extern "C"
+{
+#include <libavutil/pixfmt.h>
+}
+#include <cstdint>
+#include <vector>
+#include "Input.hpp"
+
+namespace ffmpeg {
+
+struct Thumbnail {
+    std::vector<uint8_t> data{};            /// All the pixels, in the color space that you requested. If there is some alpha it will always be straight alpha, never premultiplied.
+    int                  width{};           /// In pixels
+    int                  height{};          /// In pixels
+    double               time_in_seconds{}; /// Present time of the frame that was used. It is the frame that is visible at the requested time, so it might be slightly before the requested time.
+};
+
+/// Extracts the frames visible at each of the `times_in_seconds`, and resizes them to `width` x `height`.
+/// This is a lot faster than calling VideoDecoder::get_frame_at() in a loop: we look at the keyframes of the file to only seek when it actually saves some decoding, we decode all the frames that share a GOP in one go, and the resizing / color conversion happens in parallel on several threads.
+/// `times_in_seconds` must be sorted in increasing order. The returned vector has one thumbnail per requested time, in the same order.
+/// `input` can be a path to a file, a buffer in memory, or your own DataSource.
+/// Throws a `std::runtime_error` if the input cannot be opened (file not found / invalid video file / format not supported, etc.) or if a frame cannot be decoded.
+[[nodiscard]] auto extract_thumbnails(
+    Input const&                 input,
+    std::vector<double> const&   times_in_seconds,
+    int width, int height,
+    AVPixelFormat pixel_format
+) -> std::vector<Thumbnail>;
+
+} // namespace ffmpeg
@@ -0,0 +1,270 @@
+#include "utils.hpp"
+#include <array>
+#include <cassert>
+#include <cstdio>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+}
+
+namespace ffmpeg {
+
+auto format_error(std::string message, int err) -> std::string
+{
+    assert(err < 0);
+    auto err_str_buffer = std::array<char, AV_ERROR_MAX_STRING_SIZE>{};
+    av_strerror(err, err_str_buffer.data(), err_str_buffer.size());
+    message += ":\n";
+    message += err_str_buffer.data();
+    return message;
+}
+
+void throw_error(std::string const& message)
+{
+    throw std::runtime_error(message);
+}
+
+void throw_error(std::string const& message, int err)
+{
+    throw_error(format_error(message, err));
+}
+
+namespace {
+/// The state of one demuxer reading from a DataSource. Each demuxer has its own, so that they can read from the same source independently.
+struct DataSourceCursor {
+    std::shared_ptr<DataSource> source;
+    int64_t                     position{0};
+};
+} // namespace
+
+static auto read_from_data_source(void* opaque, uint8_t* buffer, int buffer_size) -> int
+{
+    auto& cursor = *static_cast<DataSourceCursor*>(opaque);
+    try
+    {
+        auto const bytes_count = cursor.source->read_at(cursor.position, std::span<uint8_t>{buffer, static_cast<size_t>(buffer_size)});
+        if (bytes_count == 0)
+            return AVERROR_EOF;
+        cursor.position += static_cast<int64_t>(bytes_count);
+        return static_cast<int>(bytes_count);
+    }
+    catch (std::exception const&)
+    {
+        return AVERROR(EIO);
+    }
+}
+
+static auto seek_in_data_source(void* opaque, int64_t offset, int whence) -> int64_t
+{
+    auto& cursor = *static_cast<DataSourceCursor*>(opaque);
+    whence &= ~AVSEEK_FORCE; // We can always seek, this flag doesn't change anything for us
+    if (whence == AVSEEK_SIZE)
+        return cursor.source->size();
+
+    int64_t const new_position = [&]() { // IIFE
+        switch (whence)
+        {
+        case SEEK_SET: return offset;
+        case SEEK_CUR: return cursor.position + offset;
+        case SEEK_END: return cursor.source->size() + offset;
+        default: return std::numeric_limits<int64_t>::min();
+        }
+    }();
+    if (new_position < 0)
+        return AVERROR(EINVAL);
+    cursor.position = new_position;
+    return new_position;
+}
+
+/// Size of the buffer used by the demuxer to read from a DataSource
+static constexpr int data_source_buffer_size = 32 * 1024;
+
+static auto make_io_context(std::shared_ptr<DataSource> const& data_source) -> AVIOContext*
+{
+    auto* const buffer = static_cast<uint8_t*>(av_malloc(data_source_buffer_size));
+    if (!buffer)
+        throw_error("Not enough memory to open the video file");
+
+    auto* const   cursor = new DataSourceCursor{.source = data_source}; // NOLINT(*owning-memory) Freed in close_format_context()
+    AVIOContext* io_ctx  = avio_alloc_context(buffer, data_source_buffer_size, 0 /*write_flag*/, cursor, &read_from_data_source, nullptr, &seek_in_data_source);
+    if (!io_ctx)
+    {
+        delete cursor; // NOLINT(*owning-memory)
+        av_free(buffer);
+        throw_error("Not enough memory to open the video file");
+    }
+    return io_ctx;
+}
+
+static void free_io_context(AVIOContext*& io_ctx)
+{
+    if (!io_ctx)
+        return;
+    delete static_cast<DataSourceCursor*>(io_ctx->opaque); // NOLINT(*owning-memory)
+    av_freep(&io_ctx->buffer); // Might not be the buffer that we allocated, the demuxer is allowed to reallocate it
+    avio_context_free(&io_ctx);
+}
+
+auto open_format_context(Input const& input) -> AVFormatContext*
+{
+    AVFormatContext* format_ctx{};
+    if (auto const* data_source = input.data_source())
+    {
+        AVIOContext* io_ctx = make_io_context(*data_source);
+        format_ctx          = avformat_alloc_context();
+        if (!format_ctx)
+        {
+            free_io_context(io_ctx);
+            throw_error("Not enough memory to open the video file");
+        }
+        format_ctx->pb = io_ctx; // Having a pb tells avformat_open_input() to use our custom IO instead of opening a file
+
+        int const err = avformat_open_input(&format_ctx, nullptr, nullptr, nullptr);
+        if (err < 0)
+        {
+            free_io_context(io_ctx); // avformat_open_input() has freed the format context, but never frees a custom IO context
+            throw_error("Could not open the data. Make sure it is an actual video file", err);
+        }
+    }
+    else
+    {
+        int const err = avformat_open_input(&format_ctx, input.path()->string().c_str(), nullptr, nullptr);
+        if (err < 0)
+            throw_error("Could not open file. Make sure the path is valid and is an actual video file", err);
+    }
+
+    {
+        int const err = avformat_find_stream_info(format_ctx, nullptr);
+        if (err < 0)
+        {
+            close_format_context(format_ctx);
+            throw_error("Could not find stream information. Your file is most likely corrupted or not a valid video file", err);
+        }
+    }
+    return format_ctx;
+}
+
+void close_format_context(AVFormatContext*& format_ctx)
+{
+    if (!format_ctx)
+        return;
+    AVIOContext* custom_io_ctx = (format_ctx->flags & AVFMT_FLAG_CUSTOM_IO) ? format_ctx->pb : nullptr;
+    avformat_close_input(&format_ctx);
+    free_io_context(custom_io_ctx); // avformat_close_input() never frees a custom IO context
+}
+
+auto open_output_format_context(std::filesystem::path const& path) -> AVFormatContext*
+{
+    AVFormatContext* format_ctx{};
+    {
+        int const err = avformat_alloc_output_context2(&format_ctx, nullptr, nullptr, path.string().c_str());
+        if (err < 0)
+            throw_error("Could not deduce the format of the file from its extension. Make sure it is a video extension, like .mp4", err);
+    }
+    if (!(format_ctx->oformat->flags & AVFMT_NOFILE)) // NOLINT(*signed-bitwise) Some formats (like image sequences) open their files themselves
+    {
+        int const err = avio_open(&format_ctx->pb, path.string().c_str(), AVIO_FLAG_WRITE);
+        if (err < 0)
+        {
+            avformat_free_context(format_ctx);
+            throw_error("Could not open file for writing. Make sure its folder exists and that you have the permission to write there", err);
+        }
+    }
+    return format_ctx;
+}
+
+void close_output_format_context(AVFormatContext*& format_ctx)
+{
+    if (!format_ctx)
+        return;
+    if (!(format_ctx->oformat->flags & AVFMT_NOFILE)) // NOLINT(*signed-bitwise)
+        avio_closep(&format_ctx->pb);
+    avformat_free_context(format_ctx);
+    format_ctx = nullptr;
+}
+
+auto find_video_stream(AVFormatContext const& format_ctx) -> int
+{
+    int const err = av_find_best_stream(const_cast<AVFormatContext*>(&format_ctx), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0); // NOLINT(*const-cast)
+    if (err < 0)
+        throw_error("Could not find video stream. Make sure your file is a video file and not an audio file", err);
+    return err;
+}
+
+auto open_decoder(AVCodecParameters const& params) -> AVCodecContext*
+{
+    AVCodec const* decoder = avcodec_find_decoder(params.codec_id);
+    if (!decoder)
+    {
+        auto const* desc = avcodec_descriptor_get(params.codec_id);
+        throw_error("Codec \"" + std::string{desc ? desc->name : "Unknown"} + "\" is not supported (" + std::string{desc ? desc->long_name : "Unknown"} + ")");
+    }
+
+    AVCodecContext* decoder_ctx = avcodec_alloc_context3(decoder);
+    if (!decoder_ctx)
+        throw_error("Not enough memory to open the video file");
+
+    {
+        int const err = avcodec_parameters_to_context(decoder_ctx, &params);
+        if (err < 0)
+        {
+            avcodec_free_context(&decoder_ctx);
+            throw_error("Failed to copy codec parameters to decoder context", err);
+        }
+    }
+
+    {
+        int const err = avcodec_open2(decoder_ctx, decoder, nullptr);
+        if (err < 0)
+        {
+            avcodec_free_context(&decoder_ctx);
+            auto const* desc = avcodec_descriptor_get(params.codec_id);
+            throw_error("Failed to open codec \"" + std::string{desc ? desc->name : "Unknown"} + "\" (" + std::string{desc ? desc->long_name : "Unknown"} + ")", err);
+        }
+    }
+
+    return decoder_ctx;
+}
+
+auto frame_duration_in_seconds(AVFrame const& frame, AVStream const& stream) -> double
+{
+#if LIBAVUTIL_VERSION_MAJOR >= 58 // AVFrame::duration was added in FFmpeg 6.0, and pkt_duration removed in FFmpeg 7.0
+    int64_t const duration = frame.duration;
+#else
+    int64_t const duration = frame.pkt_duration;
+#endif
+    if (duration > 0)
+        return static_cast<double>(duration) * av_q2d(stream.time_base);
+    if (stream.avg_frame_rate.num > 0 && stream.avg_frame_rate.den > 0)
+        return av_q2d(av_inv_q(stream.avg_frame_rate));
+    return 0.;
+}
+
+PacketRaii::~PacketRaii()
+{
+    av_packet_unref(packet);
+}
+
+FrameRaii::FrameRaii()
+    : frame{av_frame_alloc()}
+{
+    if (!frame)
+        throw_error("Not enough memory to allocate a frame");
+}
+
+FrameRaii::FrameRaii(AVFrame* frame)
+    : frame{frame}
+{}
+
+FrameRaii::~FrameRaii()
+{
+    av_frame_free(&frame);
+}
+
+} // namespace ffmpeg
@@ -0,0 +1,60 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include "Input.hpp"
+
+struct AVFormatContext;
+struct AVCodecContext;
+struct AVCodecParameters;
+struct AVPacket;
+struct AVFrame;
+struct AVStream;
+
+namespace ffmpeg {
+
+[[nodiscard]] auto format_error(std::string message, int err) -> std::string;
+
+void throw_error(std::string const& message);
+void throw_error(std::string const& message, int err);
+
+/// Opens the input and reads its stream information.
+/// Throws a `std::runtime_error` on failure.
+/// The context must be closed with close_format_context(), which also frees our custom IO context if the input is a DataSource.
+[[nodiscard]] auto open_format_context(Input const& input) -> AVFormatContext*;
+void               close_format_context(AVFormatContext*& format_ctx);
+
+/// Creates the context of a file to write to, and opens that file. The container is deduced from the extension of `path`.
+/// Throws a `std::runtime_error` on failure.
+/// The context must be closed with close_output_format_context().
+[[nodiscard]] auto open_output_format_context(std::filesystem::path const& path) -> AVFormatContext*;
+void               close_output_format_context(AVFormatContext*& format_ctx);
+
+/// Returns the index of the best video stream in the file.
+/// Throws a `std::runtime_error` on failure.
+[[nodiscard]] auto find_video_stream(AVFormatContext const&) -> int;
+
+/// Creates a decoder context ready to receive packets described by `params`.
+/// Throws a `std::runtime_error` on failure.
+[[nodiscard]] auto open_decoder(AVCodecParameters const& params) -> AVCodecContext*;
+
+/// Calls the callback set by set_frame_decoding_error_callback(). Thread-safe.
+void report_frame_decoding_error(std::string const& error_message);
+
+/// How long the frame stays visible. Falls back to the frame rate of the stream if the frame doesn't say it.
+[[nodiscard]] auto frame_duration_in_seconds(AVFrame const&, AVStream const&) -> double;
+
+struct PacketRaii { // NOLINT(*special-member-functions)
+    AVPacket* packet;
+
+    ~PacketRaii();
+};
+
+struct FrameRaii { // NOLINT(*special-member-functions)
+    AVFrame* frame;
+
+    FrameRaii();
+    explicit FrameRaii(AVFrame*);
+    ~FrameRaii();
+};
+
+} // namespace ffmpeg
@@ -2,16 +2,27 @@
 //
 #include <glfw/include/GLFW/glfw3.h>
 #include <imgui.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <coroutine>
 #include <cstdint>
+#include <deque>
 #include <exception>
 #include <fstream>
+#include <iterator>
+#include <mutex>
 #include <quick_imgui/quick_imgui.hpp>
+#include <thread>
+#include <tuple>
 #include "easy_ffmpeg/easy_ffmpeg.hpp"
 #include "exe_path/exe_path.h"
 #define DOCTEST_CONFIG_IMPLEMENT
 #include <doctest/doctest.h>
 
-void check_equal(ffmpeg::Frame const& frame, std::filesystem::path const& path_to_expected_values)
+template<typename FrameT> // Works both with ffmpeg::Frame and with frames whose data has been copied into a std::vector
+void check_equal(FrameT const& frame, std::filesystem::path const& path_to_expected_values)
 {
     static constexpr size_t expected_width  = 256;
     static constexpr size_t expected_height = 144;
@@ -31,6 +42,29 @@ void check_equal(ffmpeg::Frame const& frame, std::filesystem::path const& path_t
         REQUIRE(frame.data[i] == expected_values[i]); // NOLINT(*avoid-do-while, *pointer-arithmetic)
 }
 
+/// For the videos generated with ffmpeg::generate_test_video(), we compare the frames given by two decoders instead of comparing them with files
+void check_same_pixels(ffmpeg::Frame const& frame, ffmpeg::Frame const& expected_frame)
+{
+    REQUIRE(frame.width == expected_frame.width);   // NOLINT(*avoid-do-while)
+    REQUIRE(frame.height == expected_frame.height); // NOLINT(*avoid-do-while)
+    auto const size = 4 * static_cast<size_t>(frame.width) * static_cast<size_t>(frame.height);
+    CHECK(std::equal(frame.data, frame.data + size, expected_frame.data)); // NOLINT(*avoid-do-while, *pointer-arithmetic)
+}
+
+/// 4 seconds at 25 fps, with a keyframe every 2 seconds and B-frames (that test.gif doesn't have), in the temporary directory. Remove it at the end of your test.
+auto make_video_with_b_frames(std::string const& name) -> std::filesystem::path
+{
+    auto const path = std::filesystem::temp_directory_path() / ("easy_ffmpeg_test_" + name + ".mkv");
+    ffmpeg::generate_test_video(path, {.codec = "mpeg4", .width = 256, .height = 144, .frames_per_second = 25., .duration_in_seconds = 4., .keyframes_interval = 50, .max_b_frames = 2});
+    return path;
+}
+
+/// Index of the frame shown at `time_in_seconds` in the videos made by make_video_with_b_frames()
+auto frame_index_at(double time_in_seconds) -> int
+{
+    return static_cast<int>(std::floor(time_in_seconds * 25. + 0.001));
+}
+
 TEST_CASE("VideoDecoder")
 {
     auto decoder = ffmpeg::VideoDecoder{exe_path::dir() / "test.gif", AV_PIX_FMT_RGBA};
@@ -39,6 +73,724 @@ TEST_CASE("VideoDecoder")
     std::cout << decoder.detailed_info();
 }
 
+namespace {
+struct Task { // Minimal coroutine type, just enough to test async_get_frame_at()
+    struct promise_type {
+        auto get_return_object() -> Task { return {}; }
+        auto initial_suspend() -> std::suspend_never { return {}; }
+        auto final_suspend() noexcept -> std::suspend_never { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+} // namespace
+
+auto check_async_get_frame_at(ffmpeg::VideoDecoder& decoder, ffmpeg::Executor executor, bool& is_done) -> Task
+{
+    auto const frame = co_await decoder.async_get_frame_at(0.13, ffmpeg::SeekMode::Exact, std::move(executor));
+    CHECK(frame.has_value()); // NOLINT(*avoid-do-while)
+    if (frame.has_value())
+        check_equal(*frame, exe_path::dir() / "expected_frame_3.txt");
+    is_done = true;
+}
+
+TEST_CASE("VideoDecoder::async_get_frame_at")
+{
+    // Simple event loop, running on the test thread
+    auto tasks           = std::deque<std::function<void()>>{};
+    auto tasks_mutex     = std::mutex{};
+    auto tasks_available = std::condition_variable{};
+    auto executor        = [&](std::function<void()> task) {
+        {
+            std::unique_lock lock{tasks_mutex};
+            tasks.push_back(std::move(task));
+        }
+        tasks_available.notify_one();
+    };
+
+    auto decoder = ffmpeg::VideoDecoder{exe_path::dir() / "test.gif", AV_PIX_FMT_RGBA};
+    bool is_done{false};
+    check_async_get_frame_at(decoder, executor, is_done);
+    while (!is_done)
+    {
+        auto task = std::function<void()>{};
+        {
+            std::unique_lock lock{tasks_mutex};
+            tasks_available.wait(lock, [&]() { return !tasks.empty(); });
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+TEST_CASE("VideoDecoder from memory")
+{
+    auto bytes = std::vector<uint8_t>{};
+    {
+        auto file = std::ifstream{exe_path::dir() / "test.gif", std::ios::binary};
+        bytes     = std::vector<uint8_t>{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    }
+    auto decoder = ffmpeg::VideoDecoder{std::span<uint8_t const>{bytes}, AV_PIX_FMT_RGBA};
+    check_equal(*decoder.get_frame_at(0., ffmpeg::SeekMode::Exact), exe_path::dir() / "expected_frame_0.txt");
+    check_equal(*decoder.get_frame_at(0.13, ffmpeg::SeekMode::Exact), exe_path::dir() / "expected_frame_3.txt");
+}
+
+TEST_CASE("Input conversions")
+{
+    // All of these must compile without any explicit conversion
+    CHECK_THROWS_AS(ffmpeg::VideoDecoder("this_file_does_not_exist.gif", AV_PIX_FMT_RGBA), std::runtime_error);              // NOLINT(*avoid-do-while)
+    CHECK_THROWS_AS(ffmpeg::VideoDecoder(std::string{"this_file_does_not_exist.gif"}, AV_PIX_FMT_RGBA), std::runtime_error); // NOLINT(*avoid-do-while)
+    {
+        auto decoder = ffmpeg::VideoDecoder{(exe_path::dir() / "test.gif").string(), AV_PIX_FMT_RGBA};
+        check_equal(*decoder.get_frame_at(0., ffmpeg::SeekMode::Exact), exe_path::dir() / "expected_frame_0.txt");
+    }
+
+    auto bytes = std::vector<uint8_t>{};
+    {
+        auto file = std::ifstream{exe_path::dir() / "test.gif", std::ios::binary};
+        bytes     = std::vector<uint8_t>{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    }
+    auto decoder = ffmpeg::VideoDecoder{bytes, AV_PIX_FMT_RGBA};
+    check_equal(*decoder.get_frame_at(0., ffmpeg::SeekMode::Exact), exe_path::dir() / "expected_frame_0.txt");
+}
+
+TEST_CASE("VideoDecoder from a memory-mapped file")
+{
+    auto decoder = ffmpeg::VideoDecoder{std::make_shared<ffmpeg::MappedFileDataSource>(exe_path::dir() / "test.gif"), AV_PIX_FMT_RGBA};
+    check_equal(*decoder.get_frame_at(0., ffmpeg::SeekMode::Exact), exe_path::dir() / "expected_frame_0.txt");
+    check_equal(*decoder.get_frame_at(0.13, ffmpeg::SeekMode::Exact), exe_path::dir() / "expected_frame_3.txt");
+    check_equal(*decoder.get_frame_at(0., ffmpeg::SeekMode::Exact), exe_path::dir() / "expected_frame_0.txt"); // Seeks backward
+}
+
+TEST_CASE("VideoDecoder seeking back and forth")
+{
+    // Short seeks re-decode the packets that are still in memory, check that they give the same frames as a regular decoding
+    auto decoder = ffmpeg::VideoDecoder{exe_path::dir() / "test.gif", AV_PIX_FMT_RGBA};
+    for (int i = 0; i < 3; ++i)
+    {
+        check_equal(*decoder.get_frame_at(0.13, ffmpeg::SeekMode::Exact), exe_path::dir() / "expected_frame_3.txt");
+        check_equal(*decoder.get_frame_at(0., ffmpeg::SeekMode::Exact), exe_path::dir() / "expected_frame_0.txt");
+    }
+    CHECK(decoder.stats().seeks_replayed_from_memory >= 1); // NOLINT(*avoid-do-while) Otherwise this test would only check the seeks in the file
+}
+
+TEST_CASE("VideoDecoder fast seeking")
+{
+    // Catching up skips the frames that are far before the target, check that it still lands on the exact frame
+    auto decoder = ffmpeg::VideoDecoder{exe_path::dir() / "test.gif", AV_PIX_FMT_RGBA};
+    std::ignore  = decoder.get_frame_at(0.5, ffmpeg::SeekMode::Exact);
+    auto frame   = decoder.get_frame_at(0.13, ffmpeg::SeekMode::Fast); // Seeks backward
+    for (int i = 0; i < 1000 && frame.has_value() && frame->time_in_seconds < 0.11; ++i)
+    {
+        std::this_thread::yield();
+        frame = decoder.get_frame_at(0.13, ffmpeg::SeekMode::Fast);
+    }
+    REQUIRE(frame.has_value()); // NOLINT(*avoid-do-while)
+    check_equal(*frame, exe_path::dir() / "expected_frame_3.txt");
+}
+
+TEST_CASE("VideoDecoder fast seeking with B-frames")
+{
+    // The gif doesn't have any non-reference frame, so the test above can't check that skipping them still lands on the exact frame
+    auto const path = make_video_with_b_frames("fast_seeking");
+    {
+        auto decoder = ffmpeg::VideoDecoder{path, AV_PIX_FMT_RGBA};
+        REQUIRE(decoder.get_frame_at(3.9, ffmpeg::SeekMode::Exact).has_value()); // NOLINT(*avoid-do-while)
+        auto const stats_before_seek = decoder.stats();
+
+        static constexpr double target = 1.7; // The keyframe before it is the first frame
+        auto                    frame  = decoder.get_frame_at(target, ffmpeg::SeekMode::Fast); // Seeks backward
+        auto const              start  = std::chrono::steady_clock::now();
+        while (frame.has_value() && frame->time_in_seconds < target - 1. / 25. && std::chrono::steady_clock::now() - start < std::chrono::seconds{10})
+        {
+            std::this_thread::yield();
+            frame = decoder.get_frame_at(target, ffmpeg::SeekMode::Fast);
+        }
+        REQUIRE(frame.has_value());                                                   // NOLINT(*avoid-do-while)
+        CHECK(ffmpeg::read_test_video_frame_index(*frame) == frame_index_at(target)); // NOLINT(*avoid-do-while)
+
+        auto const stats = decoder.stats();
+        CHECK(stats.backward_seeks == stats_before_seek.backward_seeks + 1);                                                          // NOLINT(*avoid-do-while)
+        CHECK(stats.frames_discarded > stats_before_seek.frames_discarded);                                                           // NOLINT(*avoid-do-while) The reference frames far before the target are decoded, but never pushed to the queue
+        CHECK(stats.decoding.frames_count - stats_before_seek.decoding.frames_count < static_cast<uint64_t>(frame_index_at(target))); // NOLINT(*avoid-do-while) The B-frames far before the target are not even decoded
+    }
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("VideoDecoder with preview quality")
+{
+    // The gif decoder doesn't support any of the preview options, so it must still give the exact frames
+    auto decoder = ffmpeg::VideoDecoder{exe_path::dir() / "test.gif", AV_PIX_FMT_RGBA};
+    decoder.set_decoding_quality(ffmpeg::DecodingQuality::Preview);
+    check_equal(*decoder.get_frame_at(0.13, ffmpeg::SeekMode::Exact), exe_path::dir() / "expected_frame_3.txt");
+    decoder.set_decoding_quality(ffmpeg::DecodingQuality::Full);
+    check_equal(*decoder.get_frame_at(0., ffmpeg::SeekMode::Exact), exe_path::dir() / "expected_frame_0.txt");
+}
+
+TEST_CASE("VideoDecoder catching up after a fast seek")
+{
+    // While catching up, some frames are decoded with a lower quality. Check that it doesn't leak into the requested frame, nor into the ones after it.
+    auto const path = make_video_with_b_frames("fast_seek_quality");
+    {
+        auto fast_decoder  = ffmpeg::VideoDecoder{path, AV_PIX_FMT_RGBA};
+        auto exact_decoder = ffmpeg::VideoDecoder{path, AV_PIX_FMT_RGBA};
+        REQUIRE(fast_decoder.get_frame_at(3., ffmpeg::SeekMode::Exact).has_value()); // NOLINT(*avoid-do-while) So that going to the target needs a backward seek to the first keyframe, and catching up from there
+
+        static constexpr double target = 1.5;
+        auto                    frame  = std::optional<ffmpeg::Frame>{};
+        auto const              start  = std::chrono::steady_clock::now();
+        while (!(frame.has_value() && ffmpeg::read_test_video_frame_index(*frame) == frame_index_at(target)) && std::chrono::steady_clock::now() - start < std::chrono::seconds{10})
+            frame = fast_decoder.get_frame_at(target, ffmpeg::SeekMode::Fast);
+        REQUIRE(frame.has_value());                                                     // NOLINT(*avoid-do-while)
+        REQUIRE(ffmpeg::read_test_video_frame_index(*frame) == frame_index_at(target)); // NOLINT(*avoid-do-while)
+        check_same_pixels(*frame, *exact_decoder.get_frame_at(target, ffmpeg::SeekMode::Exact));
+
+        for (int i = 1; i <= 10; ++i) // The frames after the target are decoded from the same references
+        {
+            double const time = (frame_index_at(target) + i) / 25.;
+            check_same_pixels(*fast_decoder.get_frame_at(time, ffmpeg::SeekMode::Exact), *exact_decoder.get_frame_at(time, ffmpeg::SeekMode::Exact));
+        }
+    }
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("AudioDecoder on a file without audio")
+{
+    CHECK_THROWS_AS(ffmpeg::AudioDecoder(exe_path::dir() / "test.gif", AV_SAMPLE_FMT_FLT, 48000, 2), std::runtime_error); // NOLINT(*avoid-do-while)
+    CHECK_THROWS_AS(ffmpeg::AudioDecoder(exe_path::dir() / "test.gif", AV_SAMPLE_FMT_FLTP, 48000, 2), std::runtime_error); // NOLINT(*avoid-do-while) Planar formats are not supported
+}
+
+TEST_CASE("AudioDecoder")
+{
+    auto const options = ffmpeg::TestVideoOptions{.width = 256, .height = 144, .frames_per_second = 25., .duration_in_seconds = 4., .has_audio = true};
+    auto const path    = std::filesystem::temp_directory_path() / "easy_ffmpeg_test_audio.mkv";
+    ffmpeg::generate_test_video(path, options);
+    {
+        auto decoder = ffmpeg::AudioDecoder{path, AV_SAMPLE_FMT_FLT, 48000, 1, 0.5 /*buffer_duration_in_seconds*/};
+        auto samples = std::vector<float>(480);
+
+        // read_samples() never blocks, so we keep calling it (like an audio callback would) until the decoding thread has reached the requested time
+        auto const check_samples_at = [&](double time_in_seconds) {
+            auto const output = std::span<uint8_t>{reinterpret_cast<uint8_t*>(samples.data()), samples.size() * sizeof(float)}; // NOLINT(*reinterpret-cast)
+            auto const start  = std::chrono::steady_clock::now();
+            while (decoder.read_samples(time_in_seconds, output) < samples.size() && std::chrono::steady_clock::now() - start < std::chrono::seconds{10})
+                std::this_thread::sleep_for(std::chrono::milliseconds{1});
+            CHECK(std::abs(samples.front() - ffmpeg::test_audio_sample_at(time_in_seconds, options)) < 0.001f); // NOLINT(*avoid-do-while) Not silent, and from the right time
+            CHECK(std::abs(samples.back() - ffmpeg::test_audio_sample_at(time_in_seconds, options)) < 0.001f);  // NOLINT(*avoid-do-while)
+        };
+        check_samples_at(0.5); // Seeks
+        check_samples_at(0.51);
+        std::this_thread::sleep_for(std::chrono::milliseconds{100}); // Lets the decoding thread fill the buffer
+        check_samples_at(1.5);                                       // Further than the end of the buffer, but close enough to be reached without seeking
+        check_samples_at(0.2);                                       // Seeks backward
+        check_samples_at(3.);
+    }
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Demuxer shared between decoders")
+{
+    auto const demuxer = std::make_shared<ffmpeg::Demuxer>(exe_path::dir() / "test.gif", std::vector{AVMEDIA_TYPE_VIDEO, AVMEDIA_TYPE_AUDIO}); // The gif only has a video stream
+    CHECK(demuxer->stream_index(AVMEDIA_TYPE_VIDEO).has_value());                                                              // NOLINT(*avoid-do-while)
+    CHECK(!demuxer->stream_index(AVMEDIA_TYPE_AUDIO).has_value());                                                             // NOLINT(*avoid-do-while)
+    CHECK_THROWS_AS(ffmpeg::AudioDecoder(demuxer, AV_SAMPLE_FMT_FLT, 48000, 2), std::runtime_error);                          // NOLINT(*avoid-do-while)
+
+    auto decoder = ffmpeg::VideoDecoder{demuxer, AV_PIX_FMT_RGBA};
+    check_equal(*decoder.get_frame_at(0., ffmpeg::SeekMode::Exact), exe_path::dir() / "expected_frame_0.txt");
+    check_equal(*decoder.get_frame_at(0.13, ffmpeg::SeekMode::Exact), exe_path::dir() / "expected_frame_3.txt");
+    check_equal(*decoder.get_frame_at(0., ffmpeg::SeekMode::Exact), exe_path::dir() / "expected_frame_0.txt"); // Seeks backward
+}
+
+TEST_CASE("Demuxer with a stream that nobody decodes")
+{
+    auto const path = std::filesystem::temp_directory_path() / "easy_ffmpeg_test_untaken_stream.mkv";
+    ffmpeg::generate_test_video(path, {.width = 256, .height = 144, .frames_per_second = 10., .duration_in_seconds = 12., .has_audio = true}); // Long enough for the audio to fill its queue
+    {
+        CHECK(!ffmpeg::Demuxer{path}.stream_index(AVMEDIA_TYPE_AUDIO).has_value()); // NOLINT(*avoid-do-while) Only the video by default
+
+        auto const demuxer = std::make_shared<ffmpeg::Demuxer>(path, std::vector{AVMEDIA_TYPE_VIDEO, AVMEDIA_TYPE_AUDIO});
+        std::ignore        = demuxer->take_packets(demuxer->stream_index(AVMEDIA_TYPE_AUDIO).value()); // Like a decoder whose constructor throws after taking the stream: the queue is closed right away
+        auto decoder       = ffmpeg::VideoDecoder{demuxer, AV_PIX_FMT_RGBA};
+        for (int frame_index = 0; frame_index < 120; ++frame_index) // Plays the whole video, so that the Demuxer never seeks (which would clear the audio queue)
+            CHECK(ffmpeg::read_test_video_frame_index(*decoder.get_frame_at((frame_index + 0.5) / 10., ffmpeg::SeekMode::Exact)) == frame_index); // NOLINT(*avoid-do-while) The audio packets that nobody consumes don't block the video
+    }
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("VideoDecoder stream selection")
+{
+    auto decoder = ffmpeg::VideoDecoder{exe_path::dir() / "test.gif", AV_PIX_FMT_RGBA, 0 /*stream_index*/};
+    check_equal(*decoder.get_frame_at(0.13, ffmpeg::SeekMode::Exact), exe_path::dir() / "expected_frame_3.txt");
+    CHECK_THROWS_AS(ffmpeg::VideoDecoder(exe_path::dir() / "test.gif", AV_PIX_FMT_RGBA, 1 /*stream_index*/), std::runtime_error); // NOLINT(*avoid-do-while) The gif only has one stream
+
+    auto const demuxer = std::make_shared<ffmpeg::Demuxer>(exe_path::dir() / "test.gif", std::vector{AVMEDIA_TYPE_VIDEO}, ffmpeg::StreamsSelection::AllOfEachType);
+    CHECK(demuxer->streams_indices(AVMEDIA_TYPE_VIDEO) == std::vector{0}); // NOLINT(*avoid-do-while)
+    auto decoder2 = ffmpeg::VideoDecoder{demuxer, AV_PIX_FMT_RGBA, 0 /*stream_index*/};
+    CHECK_THROWS_AS(ffmpeg::VideoDecoder(demuxer, AV_PIX_FMT_RGBA, 0 /*stream_index*/), std::runtime_error); // NOLINT(*avoid-do-while) Each stream can only be decoded once
+    check_equal(*decoder2.get_frame_at(0., ffmpeg::SeekMode::Exact), exe_path::dir() / "expected_frame_0.txt");
+}
+
+TEST_CASE("VideoDecoders of several video streams sharing a Demuxer")
+{
+    auto const path = std::filesystem::temp_directory_path() / "easy_ffmpeg_test_several_video_streams.mkv";
+    ffmpeg::generate_test_video(path, {.codec = "mpeg4", .width = 256, .height = 144, .frames_per_second = 25., .duration_in_seconds = 4., .keyframes_interval = 10, .video_streams_count = 2}); // The second stream only has a keyframe every 20 frames
+    {
+        auto const demuxer = std::make_shared<ffmpeg::Demuxer>(path, std::vector{AVMEDIA_TYPE_VIDEO}, ffmpeg::StreamsSelection::AllOfEachType);
+        REQUIRE(demuxer->streams_indices(AVMEDIA_TYPE_VIDEO) == (std::vector{0, 1})); // NOLINT(*avoid-do-while)
+        auto decoder0 = ffmpeg::VideoDecoder{demuxer, AV_PIX_FMT_RGBA, 0 /*stream_index*/};
+        auto decoder1 = ffmpeg::VideoDecoder{demuxer, AV_PIX_FMT_RGBA, 1 /*stream_index*/};
+
+        auto const check_both_at = [&](double time_in_seconds, ffmpeg::VideoDecoder& first, ffmpeg::VideoDecoder& second) {
+            CHECK(ffmpeg::read_test_video_frame_index(*first.get_frame_at(time_in_seconds, ffmpeg::SeekMode::Exact)) == frame_index_at(time_in_seconds));  // NOLINT(*avoid-do-while)
+            CHECK(ffmpeg::read_test_video_frame_index(*second.get_frame_at(time_in_seconds, ffmpeg::SeekMode::Exact)) == frame_index_at(time_in_seconds)); // NOLINT(*avoid-do-while) Follows the Demuxer that the first one moved
+        };
+        check_both_at(0., decoder0, decoder1);
+        check_both_at(3.9, decoder0, decoder1);
+        check_both_at(2.9, decoder0, decoder1); // The Demuxer must go back to the keyframe of the second stream (at 2.4s), not the one of the first stream (at 2.8s)
+        check_both_at(1.3, decoder1, decoder0); // Same when the second decoder moves it: the keyframe of the first stream is at 1.2s, the one of the second stream at 0.8s
+        CHECK(demuxer->stats().seeks_count >= 2); // NOLINT(*avoid-do-while)
+    }
+    std::filesystem::remove(path);
+}
+
+/// Reads a file in small chunks, with a delay before each read, so that the decoder ends up waiting for the demuxer (like it does with a slow disk or network)
+class SlowDataSource : public ffmpeg::DataSource {
+public:
+    explicit SlowDataSource(std::filesystem::path const& path)
+        : _source{path}
+    {}
+
+    [[nodiscard]] auto size() const -> int64_t override { return _source.size(); }
+    [[nodiscard]] auto read_at(int64_t position, std::span<uint8_t> buffer) -> size_t override
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{2});
+        return _source.read_at(position, buffer.first(std::min(buffer.size(), size_t{4096})));
+    }
+
+private:
+    ffmpeg::MappedFileDataSource _source;
+};
+
+TEST_CASE("VideoDecoder::stats().packets_queue")
+{
+    auto const path = std::filesystem::temp_directory_path() / "easy_ffmpeg_test_packets_queue.mkv";
+    ffmpeg::generate_test_video(path, {.width = 256, .height = 144, .frames_per_second = 25., .duration_in_seconds = 4., .keyframes_interval = 10});
+    {
+        auto decoder = ffmpeg::VideoDecoder{std::make_shared<SlowDataSource>(path), AV_PIX_FMT_RGBA};
+        std::ignore  = decoder.get_frame_at(2., ffmpeg::SeekMode::Exact);
+
+        // Once the frames queue is full the decoder stops reading packets, so the demuxer gets ahead of it
+        auto const start = std::chrono::steady_clock::now();
+        while (decoder.stats().packets_queue.packets_count == 0 && std::chrono::steady_clock::now() - start < std::chrono::seconds{10})
+            std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        auto const stats_before_seek = decoder.stats().packets_queue;
+        REQUIRE(stats_before_seek.packets_count >= 1); // NOLINT(*avoid-do-while)
+
+        std::ignore = decoder.get_frame_at(0., ffmpeg::SeekMode::Exact); // Seeks backward, further than the packets kept in memory, so the packets read ahead are thrown away
+
+        auto const stats = decoder.stats().packets_queue;
+        CHECK(stats.peak_packets_count >= 1);                                               // NOLINT(*avoid-do-while)
+        CHECK(stats.packets_count <= stats.peak_packets_count);                             // NOLINT(*avoid-do-while)
+        CHECK(stats.size_in_bytes <= stats.peak_size_in_bytes);                             // NOLINT(*avoid-do-while)
+        CHECK(stats.times_decoder_waited >= 1);                                             // NOLINT(*avoid-do-while) The decoder is faster than our slow reads
+        CHECK(stats.outdated_packets_dropped > stats_before_seek.outdated_packets_dropped); // NOLINT(*avoid-do-while)
+        CHECK(decoder.stats().backward_seeks >= 1);                                         // NOLINT(*avoid-do-while)
+    }
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("VideoDecoder::stats")
+{
+    auto decoder = ffmpeg::VideoDecoder{exe_path::dir() / "test.gif", AV_PIX_FMT_RGBA};
+    std::ignore  = decoder.get_frame_at(0.13, ffmpeg::SeekMode::Exact);
+    std::ignore  = decoder.get_frame_at(0., ffmpeg::SeekMode::Exact); // Seeks backward
+
+    // The decoding thread keeps going while we read the stats, so we can only check lower bounds for what it does
+    auto const stats = decoder.stats();
+    CHECK(stats.decoding.frames_count >= 4);                  // NOLINT(*avoid-do-while)
+    CHECK(stats.decoding_time_histogram.total_count() >= 4);  // NOLINT(*avoid-do-while)
+    CHECK(stats.conversion.frames_count == 2);                // NOLINT(*avoid-do-while)
+    CHECK(stats.frames_returned == 2);                        // NOLINT(*avoid-do-while)
+    CHECK(stats.get_frame_time_histogram.total_count() == 2); // NOLINT(*avoid-do-while)
+    CHECK(stats.backward_seeks == 1);                         // NOLINT(*avoid-do-while)
+    CHECK(stats.demuxer.reading.frames_count >= 4);           // NOLINT(*avoid-do-while)
+    CHECK(stats.demuxer.bytes_read > 0);                      // NOLINT(*avoid-do-while)
+    CHECK(stats.errors_count == 0);                           // NOLINT(*avoid-do-while)
+}
+
+TEST_CASE("VideoDecoder seek decisions")
+{
+    auto const path = std::filesystem::temp_directory_path() / "easy_ffmpeg_test_seek_decisions.mkv";
+    ffmpeg::generate_test_video(path, {.codec = "mpeg4", .width = 256, .height = 144, .frames_per_second = 25., .duration_in_seconds = 12., .keyframes_interval = 125}); // A keyframe every 5 seconds
+    {
+        auto decoder = ffmpeg::VideoDecoder{path, AV_PIX_FMT_RGBA};
+        CHECK(ffmpeg::read_test_video_frame_index(*decoder.get_frame_at(0., ffmpeg::SeekMode::Exact)) == 0); // NOLINT(*avoid-do-while)
+
+        // In the GOP that we are decoding: seeking would bring us back to where we already are
+        CHECK(ffmpeg::read_test_video_frame_index(*decoder.get_frame_at(3., ffmpeg::SeekMode::Exact)) == frame_index_at(3.)); // NOLINT(*avoid-do-while)
+        CHECK(!decoder.last_seek_decision().has_seeked);                                                                       // NOLINT(*avoid-do-while)
+        CHECK(decoder.stats().forward_seeks == 0);                                                                             // NOLINT(*avoid-do-while)
+
+        // Far forward: the keyframe at 10s is much closer than decoding all the frames from 3s
+        CHECK(ffmpeg::read_test_video_frame_index(*decoder.get_frame_at(11., ffmpeg::SeekMode::Exact)) == frame_index_at(11.)); // NOLINT(*avoid-do-while)
+        auto const decision = decoder.last_seek_decision();
+        CHECK(decision.has_seeked);                                                          // NOLINT(*avoid-do-while)
+        CHECK(decision.seeking_time_in_seconds < decision.decoding_forward_time_in_seconds); // NOLINT(*avoid-do-while)
+        CHECK(decoder.stats().forward_seeks == 1);                                           // NOLINT(*avoid-do-while)
+
+        // In the GOP that we seeked to
+        CHECK(ffmpeg::read_test_video_frame_index(*decoder.get_frame_at(11.5, ffmpeg::SeekMode::Exact)) == frame_index_at(11.5)); // NOLINT(*avoid-do-while)
+        CHECK(!decoder.last_seek_decision().has_seeked);                                                                           // NOLINT(*avoid-do-while)
+        CHECK(decoder.stats().forward_seeks == 1);                                                                                 // NOLINT(*avoid-do-while)
+        CHECK(decoder.stats().backward_seeks == 0);                                                                                // NOLINT(*avoid-do-while)
+    }
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("ChromeTraceWriter")
+{
+    auto const path = std::filesystem::temp_directory_path() / "easy_ffmpeg_test_trace.json";
+    {
+        auto const trace = std::make_shared<ffmpeg::ChromeTraceWriter>(path);
+        ffmpeg::set_trace_sink(trace);
+        {
+            auto decoder = ffmpeg::VideoDecoder{exe_path::dir() / "test.gif", AV_PIX_FMT_RGBA};
+            std::ignore  = decoder.get_frame_at(0.13, ffmpeg::SeekMode::Exact);
+            std::ignore  = decoder.get_frame_at(0., ffmpeg::SeekMode::Exact); // Seeks backward
+        }
+        ffmpeg::set_trace_sink(nullptr);
+    }
+
+    auto file     = std::ifstream{path};
+    auto contents = std::string{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    file.close();
+    CHECK(contents.starts_with(R"({"traceEvents":[)"));                 // NOLINT(*avoid-do-while)
+    CHECK(contents.ends_with("]}\n"));                                 // NOLINT(*avoid-do-while)
+    CHECK(contents.find("av_read_frame") != std::string::npos);         // NOLINT(*avoid-do-while)
+    CHECK(contents.find("avcodec_receive_frame") != std::string::npos); // NOLINT(*avoid-do-while)
+    CHECK(contents.find("sws_scale") != std::string::npos);             // NOLINT(*avoid-do-while)
+    CHECK(contents.find("VideoDecoder::seek_to") != std::string::npos); // NOLINT(*avoid-do-while)
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("VideoDecoder::try_get_frame_at")
+{
+    auto decoder = ffmpeg::VideoDecoder{exe_path::dir() / "test.gif", AV_PIX_FMT_RGBA};
+    for (auto const& [time, expected_frame] : {std::make_pair(0.13, "expected_frame_3.txt"), std::make_pair(0., "expected_frame_0.txt")}) // The second one needs a backward seek
+    {
+        auto       exact_frame = std::optional<ffmpeg::Frame>{};
+        auto const start       = std::chrono::steady_clock::now();
+        while (!exact_frame.has_value() && std::chrono::steady_clock::now() - start < std::chrono::seconds{10}) // Polling, like a real-time renderer would do once per frame
+        {
+            auto const closest_frame = decoder.try_get_frame_at(time);
+            if (closest_frame.has_value() && closest_frame->is_exact)
+                exact_frame = closest_frame->frame;
+            else
+                std::this_thread::yield();
+        }
+        REQUIRE(exact_frame.has_value()); // NOLINT(*avoid-do-while)
+        check_equal(*exact_frame, exe_path::dir() / expected_frame);
+    }
+}
+
+TEST_CASE("extract_thumbnails")
+{
+    auto const thumbnails = ffmpeg::extract_thumbnails(exe_path::dir() / "test.gif", {0., 0.13}, 256, 144, AV_PIX_FMT_RGBA);
+    REQUIRE(thumbnails.size() == 2); // NOLINT(*avoid-do-while)
+    check_equal(thumbnails[0], exe_path::dir() / "expected_frame_0.txt");
+    check_equal(thumbnails[1], exe_path::dir() / "expected_frame_3.txt");
+}
+
+TEST_CASE("decode_range")
+{
+    struct CopiedFrame { // The frames given to the callback are only valid during the call
+        std::vector<uint8_t> data{};
+        int                  width{};
+        int                  height{};
+        double               time_in_seconds{};
+    };
+    auto frames = std::vector<CopiedFrame>{};
+    ffmpeg::decode_range(exe_path::dir() / "test.gif", 0., 0.1301, AV_PIX_FMT_RGBA, [&](ffmpeg::Frame const& frame) {
+        if (!frames.empty())
+            CHECK(frame.time_in_seconds > frames.back().time_in_seconds); // NOLINT(*avoid-do-while)
+        frames.push_back(CopiedFrame{
+            .data            = std::vector<uint8_t>(frame.data, frame.data + 4 * frame.width * frame.height), // NOLINT(*pointer-arithmetic)
+            .width           = frame.width,
+            .height          = frame.height,
+            .time_in_seconds = frame.time_in_seconds,
+        });
+    });
+    REQUIRE(frames.size() >= 2); // NOLINT(*avoid-do-while)
+    check_equal(frames.front(), exe_path::dir() / "expected_frame_0.txt");
+    check_equal(frames.back(), exe_path::dir() / "expected_frame_3.txt");
+}
+
+TEST_CASE("decode_range on several GOPs")
+{
+    auto const path = std::filesystem::temp_directory_path() / "easy_ffmpeg_test_decode_range.mkv";
+    ffmpeg::generate_test_video(path, {.codec = "mpeg4", .width = 256, .height = 144, .frames_per_second = 25., .duration_in_seconds = 4., .keyframes_interval = 10, .max_b_frames = 2});
+
+    // [0.5, 3.5) starts and ends in the middle of a GOP, and is split into several segments decoded in parallel
+    auto frames_indices = std::vector<int>{};
+    ffmpeg::decode_range(path, 0.5, 3.5, AV_PIX_FMT_RGBA, [&](ffmpeg::Frame const& frame) {
+        auto const index = ffmpeg::read_test_video_frame_index(frame);
+        REQUIRE(index.has_value()); // NOLINT(*avoid-do-while)
+        frames_indices.push_back(*index);
+    }, 4 /*threads_count*/);
+
+    auto expected_indices = std::vector<int>{};
+    for (int index = 13; index < 88; ++index) // Frame 13 is the first one at or after 0.5s (it starts at 0.52s), and frame 87 the last one before 3.5s
+        expected_indices.push_back(index);
+    CHECK(frames_indices == expected_indices); // NOLINT(*avoid-do-while) Every frame once, in order
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("FrameStream")
+{
+    auto   frames_count = size_t{0};
+    double previous_time{-1.};
+    for (ffmpeg::Frame const& frame : ffmpeg::FrameStream{exe_path::dir() / "test.gif", AV_PIX_FMT_RGBA})
+    {
+        CHECK(frame.time_in_seconds > previous_time); // NOLINT(*avoid-do-while)
+        CHECK(frame.duration_in_seconds > 0.);        // NOLINT(*avoid-do-while)
+        if (frames_count == 0)
+            check_equal(frame, exe_path::dir() / "expected_frame_0.txt");
+        previous_time = frame.time_in_seconds;
+        ++frames_count;
+    }
+    CHECK(frames_count > 1); // NOLINT(*avoid-do-while)
+}
+
+TEST_CASE("VideoEncoder")
+{
+    auto const path         = std::filesystem::temp_directory_path() / "easy_ffmpeg_test_VideoEncoder.mp4";
+    auto       frames_count = size_t{0};
+    {
+        auto encoder = ffmpeg::VideoEncoder{path, 256, 144, 25. /*fps*/, AV_PIX_FMT_RGBA, {.codec = "mpeg4", .threads_count = 2}}; // mpeg4 is always built into FFmpeg, unlike libx264
+        CHECK(encoder.frame_size_in_bytes() == 4 * 256 * 144);                                                                      // NOLINT(*avoid-do-while)
+        for (ffmpeg::Frame const& frame : ffmpeg::FrameStream{exe_path::dir() / "test.gif", AV_PIX_FMT_RGBA})
+        {
+            encoder.push_frame({frame.data, encoder.frame_size_in_bytes()});
+            ++frames_count;
+        }
+        CHECK_THROWS_AS(encoder.push_frame(std::span<uint8_t const>{}), std::runtime_error); // NOLINT(*avoid-do-while) Wrong size
+        auto const frame_after_finish = std::vector<uint8_t>(encoder.frame_size_in_bytes());
+        encoder.finish();
+        CHECK_THROWS_AS(encoder.push_frame({frame_after_finish.data(), frame_after_finish.size()}), std::runtime_error); // NOLINT(*avoid-do-while)
+    }
+
+    auto decoded_frames_count = size_t{0};
+    for (ffmpeg::Frame const& frame : ffmpeg::FrameStream{path, AV_PIX_FMT_RGBA})
+    {
+        CHECK(frame.width == 256);  // NOLINT(*avoid-do-while)
+        CHECK(frame.height == 144); // NOLINT(*avoid-do-while)
+        ++decoded_frames_count;
+    }
+    CHECK(decoded_frames_count == frames_count); // NOLINT(*avoid-do-while)
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("remux")
+{
+    auto const path         = std::filesystem::temp_directory_path() / "easy_ffmpeg_test_remux.gif";
+    auto const count_frames = [&]() {
+        auto count = size_t{0};
+        for (ffmpeg::Frame const& frame : ffmpeg::FrameStream{path, AV_PIX_FMT_RGBA})
+        {
+            if (count == 0)
+                check_equal(frame, exe_path::dir() / "expected_frame_0.txt");
+            ++count;
+        }
+        return count;
+    };
+
+    auto original_frames_count = size_t{0};
+    for ([[maybe_unused]] ffmpeg::Frame const& frame : ffmpeg::FrameStream{exe_path::dir() / "test.gif", AV_PIX_FMT_RGBA})
+        ++original_frames_count;
+
+    ffmpeg::remux(exe_path::dir() / "test.gif", path, 0., 1000.);
+    CHECK(count_frames() == original_frames_count); // NOLINT(*avoid-do-while)
+
+    ffmpeg::remux(exe_path::dir() / "test.gif", path, 0., 0.1301);
+    auto const trimmed_frames_count = count_frames();
+    CHECK(trimmed_frames_count >= 1);                    // NOLINT(*avoid-do-while)
+    CHECK(trimmed_frames_count < original_frames_count); // NOLINT(*avoid-do-while)
+
+    CHECK_THROWS_AS(ffmpeg::remux(exe_path::dir() / "test.gif", path, 1., 0.5), std::runtime_error); // NOLINT(*avoid-do-while)
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("remux of a range in the middle of a video")
+{
+    auto const original_path = std::filesystem::temp_directory_path() / "easy_ffmpeg_test_remux_original.mkv";
+    auto const path          = std::filesystem::temp_directory_path() / "easy_ffmpeg_test_remux_range.mkv";
+    ffmpeg::generate_test_video(original_path, {.codec = "mpeg4", .width = 256, .height = 144, .frames_per_second = 25., .duration_in_seconds = 4., .keyframes_interval = 25, .has_audio = true}); // A keyframe every second
+    auto const frames_indices = [&]() {
+        auto indices = std::vector<int>{};
+        for (ffmpeg::Frame const& frame : ffmpeg::FrameStream{path, AV_PIX_FMT_RGBA})
+            indices.push_back(ffmpeg::read_test_video_frame_index(frame).value_or(-1));
+        return indices;
+    };
+    auto const check_contiguous = [](std::vector<int> const& indices, int first, int last) {
+        REQUIRE(!indices.empty());                                      // NOLINT(*avoid-do-while)
+        CHECK(indices.front() == first);                                // NOLINT(*avoid-do-while)
+        CHECK(indices.back() == last);                                  // NOLINT(*avoid-do-while)
+        CHECK(indices.size() == static_cast<size_t>(last - first + 1)); // NOLINT(*avoid-do-while)
+        CHECK(std::is_sorted(indices.begin(), indices.end()));          // NOLINT(*avoid-do-while) Every frame is readable (-1 otherwise) and in order
+    };
+
+    ffmpeg::remux(original_path, path, 1.5, 2.5);
+    check_contiguous(frames_indices(), 25, 62); // Starts at the keyframe at 1s, and ends with the last frame before 2.5s
+    {
+        auto       decoder = ffmpeg::VideoDecoder{path, AV_PIX_FMT_RGBA};
+        auto const frame   = decoder.get_frame_at(0., ffmpeg::SeekMode::Exact);
+        REQUIRE(frame.has_value());                               // NOLINT(*avoid-do-while)
+        CHECK(std::abs(frame->time_in_seconds) < 0.001);          // NOLINT(*avoid-do-while) The keyframe has been shifted to time 0
+        CHECK(ffmpeg::read_test_video_frame_index(*frame) == 25); // NOLINT(*avoid-do-while)
+    }
+
+    ffmpeg::remux(original_path, path, 1.5, 2.5, {.reencode_boundaries = true});
+    check_contiguous(frames_indices(), 38, 62); // Starts exactly at the first frame after 1.5s
+    {
+        auto       decoder = ffmpeg::VideoDecoder{path, AV_PIX_FMT_RGBA};
+        auto const frame   = decoder.get_frame_at(0.03, ffmpeg::SeekMode::Exact);
+        REQUIRE(frame.has_value());                               // NOLINT(*avoid-do-while)
+        CHECK(std::abs(frame->time_in_seconds - 0.02) < 0.001);   // NOLINT(*avoid-do-while) The frame at 1.52s in the original, since the output starts at 1.5s
+        CHECK(ffmpeg::read_test_video_frame_index(*frame) == 38); // NOLINT(*avoid-do-while)
+    }
+
+    std::filesystem::remove(path);
+    std::filesystem::remove(original_path);
+}
+
+TEST_CASE("Transcoder")
+{
+    auto const path = std::filesystem::temp_directory_path() / "easy_ffmpeg_test_Transcoder.mp4";
+
+    auto original_times = std::vector<double>{};
+    for (ffmpeg::Frame const& frame : ffmpeg::FrameStream{exe_path::dir() / "test.gif", AV_PIX_FMT_RGBA})
+        original_times.push_back(frame.time_in_seconds);
+    auto const original_frames_count = original_times.size();
+
+    {
+        auto transcoder = ffmpeg::Transcoder{exe_path::dir() / "test.gif", path, {.height = 72, .encoder = {.codec = "mpeg4"}}};
+        transcoder.wait();
+        auto const stats = transcoder.stats();
+        CHECK(stats.decoding.frames_count == original_frames_count);   // NOLINT(*avoid-do-while)
+        CHECK(stats.conversion.frames_count == original_frames_count); // NOLINT(*avoid-do-while)
+        CHECK(stats.encoding.frames_count == original_frames_count);   // NOLINT(*avoid-do-while)
+        CHECK(stats.muxing.frames_count > 0);                          // NOLINT(*avoid-do-while)
+    }
+
+    auto decoded_frames_count = size_t{0};
+    for (ffmpeg::Frame const& frame : ffmpeg::FrameStream{path, AV_PIX_FMT_RGBA})
+    {
+        CHECK(frame.width == 128); // NOLINT(*avoid-do-while) The aspect ratio has been preserved
+        CHECK(frame.height == 72); // NOLINT(*avoid-do-while)
+        if (decoded_frames_count < original_frames_count)
+            CHECK(std::abs(frame.time_in_seconds - original_times[decoded_frames_count]) <= frame.duration_in_seconds / 2. + 0.001); // NOLINT(*avoid-do-while) The timestamps have been kept, up to the rounding to the output frame rate
+        ++decoded_frames_count;
+    }
+    CHECK(decoded_frames_count == original_frames_count); // NOLINT(*avoid-do-while)
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("ProxyVideoDecoder")
+{
+    auto const path = std::filesystem::temp_directory_path() / "easy_ffmpeg_test_ProxyVideoDecoder.mkv";
+    std::filesystem::remove(path);
+
+    {
+        auto decoder = ffmpeg::ProxyVideoDecoder{exe_path::dir() / "test.gif", AV_PIX_FMT_RGBA, {.path = path}};
+
+        auto const start = std::chrono::steady_clock::now();
+        while (!decoder.is_proxy_ready() && std::chrono::steady_clock::now() - start < std::chrono::seconds{10})
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        REQUIRE(decoder.is_proxy_ready());    // NOLINT(*avoid-do-while)
+        CHECK(std::filesystem::exists(path));    // NOLINT(*avoid-do-while)
+
+        auto const frame_from_proxy = decoder.get_frame_at(0.5, ffmpeg::SeekMode::Fast);
+        REQUIRE(frame_from_proxy.has_value());                // NOLINT(*avoid-do-while)
+        CHECK(frame_from_proxy->width == 64);                 // NOLINT(*avoid-do-while) A quarter of the original size
+        CHECK(frame_from_proxy->height == 36);                // NOLINT(*avoid-do-while)
+        CHECK(frame_from_proxy->time_in_seconds <= 0.5);      // NOLINT(*avoid-do-while)
+        CHECK(frame_from_proxy->time_in_seconds > 0.5 - 0.1); // NOLINT(*avoid-do-while)
+
+        auto const frame_from_original = decoder.get_frame_at(0.5, ffmpeg::SeekMode::Exact);
+        REQUIRE(frame_from_original.has_value()); // NOLINT(*avoid-do-while)
+        CHECK(frame_from_original->width == 256); // NOLINT(*avoid-do-while)
+
+        auto const small_frame = decoder.get_frame_at(0.5, ffmpeg::SeekMode::Exact, 64);
+        REQUIRE(small_frame.has_value()); // NOLINT(*avoid-do-while)
+        CHECK(small_frame->width == 64);  // NOLINT(*avoid-do-while) The proxy is big enough for that size
+    }
+    {
+        auto decoder = ffmpeg::ProxyVideoDecoder{exe_path::dir() / "test.gif", AV_PIX_FMT_RGBA, {.path = path}};
+        CHECK(decoder.is_proxy_ready()); // NOLINT(*avoid-do-while) Reuses the proxy that we generated previously
+    }
+    {
+        auto decoder = ffmpeg::ProxyVideoDecoder{std::make_shared<ffmpeg::MappedFileDataSource>(exe_path::dir() / "test.gif"), AV_PIX_FMT_RGBA, {.path = path}};
+        CHECK(decoder.is_proxy_ready()); // NOLINT(*avoid-do-while) Same original, read from memory this time: the fingerprint matches
+    }
+    {
+        auto const other_path = std::filesystem::temp_directory_path() / "easy_ffmpeg_test_ProxyVideoDecoder_other.mkv";
+        ffmpeg::generate_test_video(other_path, {.width = 512, .height = 288, .frames_per_second = 25., .duration_in_seconds = 1.});
+        {
+            auto decoder = ffmpeg::ProxyVideoDecoder{std::make_shared<ffmpeg::MappedFileDataSource>(other_path), AV_PIX_FMT_RGBA, {.path = path}};
+
+            auto const start = std::chrono::steady_clock::now();
+            while (!decoder.is_proxy_ready() && std::chrono::steady_clock::now() - start < std::chrono::seconds{10})
+                std::this_thread::sleep_for(std::chrono::milliseconds{10});
+            REQUIRE(decoder.is_proxy_ready()); // NOLINT(*avoid-do-while)
+
+            auto const frame_from_proxy = decoder.get_frame_at(0.5, ffmpeg::SeekMode::Fast);
+            REQUIRE(frame_from_proxy.has_value());                             // NOLINT(*avoid-do-while)
+            CHECK(frame_from_proxy->height == 72);                             // NOLINT(*avoid-do-while) The proxy of the previous original has not been reused
+            CHECK(std::abs(frame_from_proxy->time_in_seconds - 0.48) < 0.001); // NOLINT(*avoid-do-while) Same timestamps as the original (the frame at 0.5 starts at 12/25)
+        }
+        std::filesystem::remove(other_path);
+    }
+    {
+        std::ofstream{path, std::ios::binary | std::ios::trunc} << "Not a video"; // Like a proxy that has been corrupted, and that is more recent than the original
+        auto decoder = ffmpeg::ProxyVideoDecoder{exe_path::dir() / "test.gif", AV_PIX_FMT_RGBA, {.path = path}};
+
+        auto const start = std::chrono::steady_clock::now();
+        while (!decoder.is_proxy_ready() && std::chrono::steady_clock::now() - start < std::chrono::seconds{10})
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        REQUIRE(decoder.is_proxy_ready());                                      // NOLINT(*avoid-do-while) It has been generated again, instead of throwing
+        CHECK(decoder.get_frame_at(0.5, ffmpeg::SeekMode::Fast)->height == 36); // NOLINT(*avoid-do-while)
+    }
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("generate_test_video")
+{
+    auto const path = std::filesystem::temp_directory_path() / "easy_ffmpeg_test_generate_test_video.mkv";
+    ffmpeg::generate_test_video(path, {.codec = "mpeg4", .width = 256, .height = 144, .frames_per_second = 25., .duration_in_seconds = 1., .keyframes_interval = 10, .max_b_frames = 2});
+
+    {
+        int frames_count{0};
+        for (ffmpeg::Frame const& frame : ffmpeg::FrameStream{path, AV_PIX_FMT_RGBA})
+        {
+            CHECK(ffmpeg::read_test_video_frame_index(frame) == frames_count); // NOLINT(*avoid-do-while) The B-frames must come out in display order
+            ++frames_count;
+        }
+        CHECK(frames_count == 25); // NOLINT(*avoid-do-while)
+    }
+    {
+        auto decoder = ffmpeg::VideoDecoder{path, AV_PIX_FMT_RGBA};
+        for (double const time : {0.5, 0.9, 0.1, 0.46, 0.}) // Goes backward too, to test the seeks
+        {
+            auto const frame = decoder.get_frame_at(time, ffmpeg::SeekMode::Exact);
+            REQUIRE(frame.has_value());                                                                           // NOLINT(*avoid-do-while)
+            CHECK(ffmpeg::read_test_video_frame_index(*frame) == static_cast<int>(std::floor(time * 25. + 0.001))); // NOLINT(*avoid-do-while)
+        }
+    }
+    std::filesystem::remove(path);
+}
+
 auto make_texture() -> GLuint
 {
     GLuint textureID; // NOLINT(*init-variables)
@@ -118,6 +870,11 @@ auto main(int argc, char* argv[]) -> int // NOLINT(*cognitive-complexity)
                     if (ImGui::Button("+10s"))
                         time_offset += 10.;
                     timer.imgui_plot();
+                    {
+                        auto const stats = decoder->stats().packets_queue;
+                        ImGui::Text("Packets queue: %zu packets (peak %zu), %.2f MB (peak %.2f MB)", stats.packets_count, stats.peak_packets_count, static_cast<double>(stats.size_in_bytes) / 1e6, static_cast<double>(stats.peak_size_in_bytes) / 1e6);
+                        ImGui::Text("Decoder waited %llu times, demuxer waited %llu times", static_cast<unsigned long long>(stats.times_decoder_waited), static_cast<unsigned long long>(stats.times_demuxer_waited)); // NOLINT(*runtime-int)
+                    }
                     ImGui::Image(static_cast<ImTextureID>(reinterpret_cast<void*>(static_cast<uint64_t>(texture_id))), ImVec2{850.f * static_cast<float>(frame->width) / static_cast<float>(frame->height), 850.f}); // NOLINT(performance-no-int-to-ptr, *reinterpret-cast)
                     ImGui::End();
 